@@ -20,10 +20,42 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 */
+/* POSIX and Linux interfaces (ftruncate, mmap, shm_open, fallocate, O_DIRECT) are hidden under -std=c99 otherwise. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+
 #ifndef HAVE_GETOPT_LONG
 #define HAVE_GETOPT_LONG 1
 #endif
 
+#if defined(__linux__) && !defined(HAVE_INOTIFY)
+#define HAVE_INOTIFY 1
+#endif
+
+#if defined(__linux__) && !defined(HAVE_SHM_FEED)
+#define HAVE_SHM_FEED 1
+#endif
+
+#if defined(__linux__) && !defined(HAVE_EVSERVER)
+#define HAVE_EVSERVER 1
+#endif
+
+#if defined(__linux__) && !defined(HAVE_CAPTURE_FD)
+#define HAVE_CAPTURE_FD 1
+#endif
+
+#if defined(__linux__) && !defined(HAVE_METRICS_HTTP)
+#define HAVE_METRICS_HTTP 1
+#endif
+
+/* USDT static probes from systemtap's sys/sdt.h, where installed; -DNO_USDT leaves them out. */
+#if !defined(NO_USDT) && !defined(HAVE_SYS_SDT_H) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SYS_SDT_H 1
+#endif
+#endif
+
 
 #ifdef HAVE_GETOPT_LONG
 #include <getopt.h>
@@ -32,9 +64,125 @@
 /* safe to comment out the following line. */
 #include <unistd.h>
 
+#ifdef HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#ifdef HAVE_SHM_FEED
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_EVSERVER
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifdef HAVE_CAPTURE_FD
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_METRICS_HTTP
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+/* with semaphores, so per-event probes can skip their loops until a tracer attaches. */
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#endif
+
+/* USDT probes, provider sdl_dumpevents, for bpftrace or perf; each is a nop until a tracer attaches.
+   event_ingest(type, which, timestamp, batch)  event taken from SDL's queue, in a batch of that many.
+   handler_entry(type, which, timestamp)       before the event's app_on_* handler,
+   handler_return(type, which, timestamp)      and after it.
+   log_append(text, gen, ticks)                line committed to a column.
+   raster_start(text), raster_done(text, w, h) text rasterized by TTF, on any thread.
+   present_start(frame), present_done(frame)   around SDL_RenderPresent().
+   which is the field after the timestamp: instance id for joystick and controller events,
+   window id for keyboard and mouse events; timestamp is SDL's, in ms.
+   PROBE_ENABLED(name) is nonzero while a tracer that sets semaphores (bpftrace, systemtap) is attached to name.
+*/
+#ifdef HAVE_SYS_SDT_H
+#define PROBE1(name, a) DTRACE_PROBE1(sdl_dumpevents, name, a)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(sdl_dumpevents, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(sdl_dumpevents, name, a, b, c, d)
+#define PROBE_SEMAPHORE(name) __extension__ unsigned short sdl_dumpevents_##name##_semaphore __attribute__((unused)) __attribute__((section(".probes")))
+#define PROBE_ENABLED(name) __builtin_expect(sdl_dumpevents_##name##_semaphore, 0)
+PROBE_SEMAPHORE(event_ingest);
+PROBE_SEMAPHORE(handler_entry);
+PROBE_SEMAPHORE(handler_return);
+PROBE_SEMAPHORE(log_append);
+PROBE_SEMAPHORE(raster_start);
+PROBE_SEMAPHORE(raster_done);
+PROBE_SEMAPHORE(present_start);
+PROBE_SEMAPHORE(present_done);
+#else
+#define PROBE1(name, a) do { } while (0)
+#define PROBE3(name, a, b, c) do { } while (0)
+#define PROBE4(name, a, b, c, d) do { } while (0)
+#define PROBE_ENABLED(name) 0
+#endif /* HAVE_SYS_SDT_H */
+#define PROBE_EVENT(name, evt) PROBE3(name, (evt)->type, (evt)->jaxis.which, (evt)->common.timestamp)
+
+/* Fixed-size event records, shared by --feed, --serve and --record. */
+#include "evfeed.h"
+
 #include <SDL.h>
 #include <SDL_ttf.h>
 
+/* Blend kernels for CPU compositing; SSE2 at compile time, AVX2 at run time. */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && SDL_VERSION_ATLEAST(2,0,4)
+#define HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_NEON_KERNEL 1
+#include <arm_neon.h>
+#endif
+
+/* Batched textured quads (one draw call per texture). */
+#if SDL_VERSION_ATLEAST(2,0,18)
+#define HAVE_RENDER_GEOMETRY 1
+#endif
+/* Allocator hooks, for counting heap allocations per frame. */
+#if SDL_VERSION_ATLEAST(2,0,7)
+#define HAVE_MEMORY_FUNCTIONS 1
+#endif
+/* Standalone motion sensors (SENSORUPDATE). */
+#if SDL_VERSION_ATLEAST(2,0,9)
+#define HAVE_SENSORS 1
+#endif
+/* Game controller gyro, accelerometer and touchpad events. */
+#if SDL_VERSION_ATLEAST(2,0,14)
+#define HAVE_CONTROLLER_SENSORS 1
+#endif
+/* Log text drawn as quads from one glyph sheet texture, no texture per line. */
+#if defined(HAVE_GLYPH_ATLAS) && defined(HAVE_RENDER_GEOMETRY)
+#define HAVE_GLYPH_BATCH 1
+#endif
+
+/* Prebaked glyph atlas for built-in font, generated at build time by mkatlas. */
+#ifdef HAVE_GLYPH_ATLAS
+#include "glyph_atlas.h"
+#endif
+
 #define PACKAGE "SDL_DumpEvents"
 #define VERSION "0.01"
 
@@ -62,10 +210,8 @@ MISC       | KEYB      | MOUSE     | JOY      | CONTROLLER
 #define MAX_LINELENGTH 256
 /* Maximum number of log lines per category. */ /* 2400p / 16perRow */
 #define MAX_NUMLINES 150
-/* Max number of joystick devices to recognize. */
-#define MAX_JOYSTICKS 8
-/* Max number of game controller (gamepad) devices to recognize. */
-#define MAX_GAMEPADS 8
+/* Initial number of hash slots in device registry (power of two; grows as needed). */
+#define DEVREG_INITIAL_SLOTS 16
 /* Max number of permanent graphics decorations supported. */
 #define MAX_GFXDECOR 30
 /* Max number of heartbeat data to store for reporting. */
@@ -73,6 +219,50 @@ MISC       | KEYB      | MOUSE     | JOY      | CONTROLLER
 /* Number of mainloop cycles to advance heartbeat by one. */
 #define MAINLOOP_PER_HEARTBEAT 500
 
+/* Max number of startup phases timed by --trace-startup. */
+#define MAX_STARTUP_PHASES 16
+
+/* Trace records buffered per thread before conversion to JSON (--trace). */
+#define TRACE_BUFFER_RECORDS 65536
+
+/* Initial capacity of display list, draw commands (grows as needed). */
+#define DISPLIST_INITIAL_CMDS 256
+/* Glyph cells per row in the glyph sheet texture. */
+#define GLYPH_SHEET_COLUMNS 16
+
+/* Events taken from SDL's queue per SDL_PeepEvents call. */
+#define EVENT_BATCH 256
+/* Power-of-two buckets of batch size histogram (1 through EVENT_BATCH). */
+#define EVENT_HIST_BUCKETS 9
+
+/* Overload: a column is summarized when lines arrive faster than its rows could show at this frame rate. */
+#define OVERLOAD_NOMINAL_FPS 60
+/* Overload ends when rate stays below entry threshold divided by this... */
+#define OVERLOAD_EXIT_RATIO 4
+/* ... for this long, ms. */
+#define OVERLOAD_HOLD_MS 1000
+/* Rate sampling and summary refresh period, ms. */
+#define OVERLOAD_WINDOW_MS 250
+/* Distinct line types tracked per summarized column. */
+#define MAX_SUMMARY_KEYS 64
+
+/* Upper limit of text rasterization worker threads. */
+#define MAX_RASTER_THREADS 8
+/* Rasterization jobs in flight (queued, running, or awaiting upload). */
+#define RASTER_QUEUE_LEN 256
+/* Default main thread time per frame for rasterizing and uploading text, ms. */
+#define DEFAULT_RASTER_BUDGET_MS 4
+/* Rows per shared sheet texture in the log line row pool. */
+#define ROWPOOL_SHEET_ROWS 32
+/* Upper limit of row pool sheets; beyond that, lines get textures of their own. */
+#define ROWPOOL_MAX_SHEETS 32
+/* Frames ignored by --check-alloc while caches and queues fill, ms. */
+#define CHECK_ALLOC_WARMUP_MS 2000
+/* Frames that allocated, logged individually by --check-alloc. */
+#define CHECK_ALLOC_REPORT 8
+/* Assumed glyph advance for placeholder of line not yet rasterized, pixels. */
+#define PLACEHOLDER_ADVANCE 12
+
 /* Default window size. */
 #define DEFAULT_WIDTH 1280
 #define DEFAULT_HEIGHT 720
@@ -87,6 +277,109 @@ MISC       | KEYB      | MOUSE     | JOY      | CONTROLLER
 #define DECORID_FOOTER (DECORID_ENTRYBOX + 1)
 
 #define DEFAULT_MAPPING_ENVVAR "SDL_DUMPEVENTS_MAPPING"
+/* Read size when streaming mapping databases, bytes. */
+#define MAPDB_CHUNK 65536
+/* Axes per device with noise statistics and deadband. */
+#define NOISE_MAX_AXES 8
+/* Changes up to this size count as noise when estimating jitter. */
+#define NOISE_SMALL 256
+/* Automatic deadband, in multiples of the measured jitter. */
+#define DEADBAND_AUTO_FACTOR 3
+#define DEADBAND_AUTO_MAX 2048
+/* Time an axis must stay within its jitter band before small changes update its resting value, ms. */
+#define NOISE_SETTLE 500
+/* --deadband value selecting the automatic deadband. */
+#define DEADBAND_AUTO -1
+/* Sensor types tracked per device (SDL_SensorType values up to SDL_SENSOR_GYRO_R). */
+#define SENSOR_MAX_TYPES 7
+/* Standalone sensors opened at once (--sensors=all). */
+#define MAX_SENSORS 8
+#define DEFAULT_SENSOR_WINDOW_MS 250
+#define DEFAULT_TOUCH_DECIMATE 4
+/* Controller touchpads and fingers per touchpad with their own --touch-decimate count. */
+#define TOUCHPAD_MAX 2
+#define TOUCHPAD_MAX_FINGERS 4
+/* Touch screen fingers down at once with their own --touch-decimate count. */
+#define MAX_FINGERS 10
+/* Records in shared-memory event feed ring (power of two). */
+#define FEED_RECORDS 65536
+/* Records queued from main thread to socket server thread (power of two). */
+#define SERVE_QUEUE 16384
+/* Socket server subscribers at once. */
+#define SERVE_MAX_CLIENTS 16
+/* Bytes buffered per subscriber before its events are dropped. */
+#define SERVE_CLIENT_BUFFER 65536
+/* Entries per subscriber filter list (devices, event types). */
+#define SERVE_MAX_FILTER 16
+/* Bytes per capture buffer; a multiple of CAPTURE_ALIGN and of the record size. */
+#define CAPTURE_BUFFER (1 << 20)
+/* Capture buffers filled by main thread and written by writer thread. */
+#define CAPTURE_BUFFERS 4
+/* Alignment of capture buffers, file offsets and lengths, for O_DIRECT. */
+#define CAPTURE_ALIGN 4096
+/* Capture file space reserved ahead of writes. */
+#define CAPTURE_PREALLOC (64 << 20)
+/* Partly filled capture buffer is written after this long (ms), except with O_DIRECT. */
+#define CAPTURE_FLUSH_MS 250
+#define DEFAULT_TRIGGER_WINDOW_S 30
+/* Most bytes of device list at start of capture file. */
+#define CAPTURE_META_MAX 16384
+/* Recent capture segments tracked for triggers; twice the most --segment-keep allows. */
+#define CAPTURE_SEGMENT_RING 1024
+/* Capture segment file names, longest. */
+#define CAPTURE_PATH_MAX 4096
+/* Prometheus metrics: exposition size, distinct event types counted, histogram buckets. */
+#define METRICS_TEXT_MAX 65536
+#define METRICS_MAX_TYPES 64
+#define METRICS_BUCKETS 12
+/* Metrics snapshot taken this often (ms); metrics thread wakes this often to check for work. */
+#define METRICS_REFRESH_MS 1000
+#define METRICS_POLL_MS 100
+#define DEFAULT_METRICS_INTERVAL_S 15
+/* Records read from each capture at a time when diffing. */
+#define DIFF_READ_RECORDS 4096
+/* Unmatched events held per capture when diffing (power of two). */
+#define DIFF_PENDING 65536
+/* Distinct devices and controls aligned when diffing (power of two). */
+#define DIFF_MAX_KEYS 4096
+/* How long an event waits for its counterpart in the other capture. */
+#define DIFF_WINDOW_MS 1000
+/* Events of one control scanned for an exact partner when diffing. */
+#define DIFF_LOOKAHEAD 8
+/* Timing drift histogram buckets, powers of two microseconds. */
+#define DIFF_DRIFT_BUCKETS 24
+#define DEFAULT_DIFF_DRIFT_MS 10
+/* Capture analysis: threads, and fewest records worth a thread of their own. */
+#define ANALYZE_MAX_THREADS 64
+#define ANALYZE_MIN_CHUNK 65536
+#define ANALYZE_READ_RECORDS 4096
+/* Devices, axes and buttons per device analyzed. */
+#define ANALYZE_MAX_DEVICES 32
+#define ANALYZE_MAX_AXES 8
+#define ANALYZE_MAX_BUTTONS 32
+/* Axis value histogram buckets over the Sint16 range. */
+#define ANALYZE_AXIS_BUCKETS 32
+/* Report interval histogram buckets (log-linear microseconds) and press duration buckets (powers of two ms). */
+#define ANALYZE_IAT_BUCKETS 608
+#define ANALYZE_DUR_BUCKETS 24
+/* Anomalies: silence after streaming, reports packed too tightly, buttons held too long. */
+#define ANALYZE_GAP_MS 250
+#define ANALYZE_BURST_REPORTS 20
+#define ANALYZE_BURST_MS 10
+#define ANALYZE_STUCK_MS 10000
+/* Hotplug events and anomalies kept (earliest first), and printed. */
+#define ANALYZE_MAX_NOTES 4096
+#define ANALYZE_PRINT_NOTES 200
+/* Longest accepted mapping line, bytes. */
+#define MAPDB_MAX_LINE 1024
+/* Minimum interval between checks for mapping file changes, ms. */
+#define MAPDB_POLL_PERIOD 100
+
+/* Synthetic (virtual) joystick load generator defaults. */
+#define DEFAULT_SYNTH_RATE 100
+#define SYNTH_NAXES 6
+#define SYNTH_NBUTTONS 15
+#define SYNTH_NHATS 1
 
 /* Fade effect parameters. */
 #define DEFAULT_AGE_FADE_PERIOD 1000
@@ -111,6 +404,18 @@ enum {
     MAX_CATEGORIES
 };
 
+/* Font slots, opened on first use. */
+enum {
+    FONT_SMALL,
+    FONT_MEDIUM,
+    FONT_LARGE,  /* all on-screen text. */
+
+    MAX_FONTS
+};
+
+/* Point size per font slot. */
+static const int fontsizes[MAX_FONTS] = { 12, 16, 20 };
+
 /* Category labels. */
 static const char * catlabel[MAX_CATEGORIES] = {
     "MISC",
@@ -121,6 +426,65 @@ static const char * catlabel[MAX_CATEGORIES] = {
 };
 
 
+/* Spans and counters recorded for trace export (--trace). */
+enum trace_id_e {
+    TRACE_CYCLE_EVENTS,
+    TRACE_CYCLE_UPDATES,
+    TRACE_UPDATES_FADE,
+    TRACE_UPDATES_RASTER,
+    TRACE_CYCLE_GFX,
+    TRACE_GFX_COLUMNS,
+    TRACE_GFX_DECOR,
+    TRACE_GFX_PRESENT,
+    TRACE_GFX_UPLOAD,
+    TRACE_GFX_SUBMIT,
+    TRACE_RASTER_JOB,
+    TRACE_COUNT_EVENTS,
+    TRACE_COUNT_TEXTURES,
+    TRACE_COUNT_LINES,
+    TRACE_COUNT_DRAWCALLS,
+
+    MAX_TRACE_IDS
+};
+
+static const char * trace_names[MAX_TRACE_IDS] = {
+    "app_cycle_events",
+    "app_cycle_updates",
+    "fade",
+    "rasterize",
+    "app_cycle_gfx",
+    "columns",
+    "app_render_decor",
+    "SDL_RenderPresent",
+    "SDL_UpdateTexture",
+    "displist_submit",
+    "raster job",
+    "events ingested",
+    "textures created",
+    "lines drawn",
+    "draw calls",
+};
+
+/* One trace record; converted to JSON only when buffer is flushed. */
+typedef struct tracerec_s {
+    Uint64 t;      /* performance counter. */
+    Sint32 value;  /* counter value. */
+    Uint16 id;     /* enum trace_id_e. */
+    char ph;       /* phase: 'B'egin, 'E'nd, 'C'ounter. */
+} tracerec_t;
+
+/* Preallocated per-thread record buffer, in two halves: one filled by its thread, the other written out. */
+typedef struct tracebuf_s {
+    int tid;
+    const char * name;
+    int len;            /* records in recs. */
+    tracerec_t * recs;  /* half being filled, by owning thread only. */
+    tracerec_t * full;  /* half handed to the writer thread; NULL once written. */
+    int fulllen;
+    struct tracebuf_s * next;
+    tracerec_t halves[2][TRACE_BUFFER_RECORDS];
+} tracebuf_t;
+
 /* One log entry line. */
 typedef struct logentry_s {
     char line[MAX_LINELENGTH];
@@ -131,8 +495,14 @@ typedef struct logentry_s {
 	unsigned char intensity;  /* alpha value. */
     } fade;
 
-    SDL_Surface * surf;
-    SDL_Texture * tex;
+    SDL_Surface * surf;  /* ARGB8888 text, or INDEX8 coverage mask when compositing on CPU. */
+    SDL_Texture * tex;   /* NULL when compositing on CPU, or when text is in a pooled row. */
+    int row;             /* pooled row holding text (see rowpool_t), 0 if none. */
+    int w;               /* text size within row. */
+    int h;
+    SDL_bool glyphs;     /* drawn from glyph sheet; no surface or texture needed. */
+    SDL_bool pending;    /* queued for rasterization on worker thread. */
+    Uint32 gen;          /* generation id; tells stale raster results apart. */
 } logentry_t;
 
 /* List of logentry instances; one per category column. */
@@ -142,6 +512,8 @@ typedef struct logbuf_s {
     int cap;   // maximum lines permitted.
     int len;   // current lines valid.
     int head;  // ring buffer.
+    Uint32 gen;  // last generation id handed to an entry.
+    struct rowpool_s * rows;  // where pooled rows of entries return to; NULL if none.
 
     logentry_t _static[MAX_NUMLINES];
     logentry_t * buf;
@@ -155,12 +527,438 @@ enum mapping_protocol_e {
     MAPPING_HELP
 };
 
+/* Streaming noise statistics and deadband state of one axis. */
+typedef struct axisnoise_s {
+    SDL_bool seen;
+    Sint16 value;  /* latest. */
+    Sint16 shown;  /* last logged; the deadband is centered here (hysteresis). */
+    int mean;      /* resting value, 1/256 units, moving average over small changes once settled. */
+    int jitter;    /* size of small changes, 1/256 units, moving average. */
+    long events, quiet;  /* all changes, and those not logged. */
+    long small;          /* small changes in current second. */
+    long smallrate;      /* small changes in last full second. */
+    Uint32 second;       /* event timestamp starting current second. */
+    Sint16 anchor;       /* value the axis has stayed within jitter band of, */
+    Uint32 still;        /* since this event timestamp. */
+} axisnoise_t;
+
+/* Axis sets per device with noise statistics. */
+enum {
+    NOISE_JOYSTICK,
+    NOISE_CONTROLLER,
+    MAX_NOISE_KINDS
+};
+
+/* Which sensors to enable (--sensors). */
+enum {
+    SENSORS_OFF,
+    SENSORS_CONTROLLER,  /* gyro and accelerometer of game controllers. */
+    SENSORS_ALL          /* also standalone sensors, through the SDL sensor subsystem. */
+};
+
+/* Samples of one sensor over the current summary window (--sensor-window). */
+typedef struct sensorwin_s {
+    int n;         /* samples in window; 0 until the next one starts it. */
+    Uint32 start;  /* event timestamp of first sample. */
+    float min[3], max[3];
+    double sum[3];
+    long samples;  /* all samples, for --sensor-decimate. */
+} sensorwin_t;
+
+/* Standalone sensor opened through the SDL sensor subsystem. */
+typedef struct sensordev_s {
+    Sint32 instid;
+    void * sensor;  /* SDL_Sensor. */
+    int type;       /* SDL_SensorType, clamped to SENSOR_MAX_TYPES. */
+    sensorwin_t win;
+} sensordev_t;
+
+/* One input device (joystick and/or game controller), keyed by joystick instance id.
+   Metadata is computed once at attach time, and kept until device is removed. */
+typedef struct gamedev_s {
+    SDL_JoystickID instid;
+    SDL_Joystick * js;        /* opened as joystick, or NULL. */
+    SDL_GameController * gc;  /* opened as game controller, or NULL. */
+    char guid[33];
+    char name[80];
+    char * mapping;  /* controller mapping string (SDL_free()), or NULL if unmapped. */
+    axisnoise_t noise[MAX_NOISE_KINDS][NOISE_MAX_AXES];
+    sensorwin_t sensors[SENSOR_MAX_TYPES];  /* by SDL_SensorType. */
+    long touchmotion[TOUCHPAD_MAX][TOUCHPAD_MAX_FINGERS];  /* motions of each finger since it touched. */
+    Uint64 events;  /* events from this device, for metrics. */
+} gamedev_t;
+
+/* Registry of attached devices; open-addressing hash map on instance id. */
+typedef struct devreg_s {
+    int alloc;  /* number of hash slots, power of two (0 until first insert). */
+    int len;    /* number of devices registered. */
+    gamedev_t ** slots;
+} devreg_t;
+
+/* Location of one mapping line in a mapping database, indexed for hotplug. */
+typedef struct mapent_s {
+    char key[32];  /* GUID hex digits, CRC field zeroed (see mapdb_guidkey()). */
+    long offset;
+    int len;
+} mapent_t;
+
+/* Streamed controller mapping database (e.g. community gamecontrollerdb.txt).
+   Only lines matching connected devices are handed to SDL; the rest are indexed by GUID and applied when such a device is hotplugged. */
+typedef struct mapdb_s {
+    const char * path;  /* NULL for stdin (not indexed, not watched). */
+
+    int nlines;    /* mapping lines for this platform in last load. */
+    int napplied;  /* applied to connected devices in last load. */
+    int nentries;  /* indexed for hotplug. */
+    int alloc;
+    mapent_t * entries;  /* sorted by key, then offset. */
+
+    int watch_fd;  /* inotify descriptor, or -1. */
+    long last_poll;
+} mapdb_t;
+
+/* Input patterns driven by the synthetic joystick generator. */
+enum synth_pattern_e {
+    SYNTH_SWEEP = 0,  /* axes triangle-wave, hat rotates, buttons walk. */
+    SYNTH_NOISE,      /* random values on every control. */
+    SYNTH_MASH,       /* all buttons toggle every step, axes slam end to end. */
+
+    MAX_SYNTH_PATTERNS
+};
+
+static const char * synth_pattern_names[MAX_SYNTH_PATTERNS] = {
+    "sweep",
+    "noise",
+    "mash",
+};
+
+/* Virtual joysticks attached for load testing, and their generator thread. */
+typedef struct synth_s {
+    int count;  /* number of virtual joysticks requested. */
+    int rate;   /* generator steps per second. */
+    enum synth_pattern_e pattern;
+    SDL_bool gamepad;  /* attach as game controllers (with mapping). */
+
+    int nattached;
+    SDL_JoystickID * instids;
+    SDL_Joystick ** js;  /* generator's own references, opened on main thread. */
+    SDL_atomic_t alive;
+    SDL_Thread * thread;
+} synth_t;
+
+/* Shared-memory event feed (--feed); layout and reader protocol in evfeed.h. */
+typedef struct feed_s {
+    const char * name;  /* shm object name, or NULL if not publishing. */
+#ifdef HAVE_SHM_FEED
+    int fd;
+    size_t size;
+    evfeed_header_t * hdr;
+    evfeed_record_t * recs;
+    Uint64 seq;  /* last sequence number published. */
+    Uint64 frequency;
+#endif /* HAVE_SHM_FEED */
+} feed_t;
+
+/* One --serve subscriber; owned by the server thread. */
+typedef struct subscriber_s {
+    int fd;  /* -1 if slot is free. */
+    SDL_bool subscribed;  /* request line received; events flow. */
+    SDL_bool binary;      /* evfeed_record_t instead of JSON lines. */
+    SDL_bool close_on_lag;  /* policy=close: disconnect instead of dropping. */
+    unsigned cats;  /* bit per category; 0 for all. */
+    int nwhich;
+    Sint32 which[SERVE_MAX_FILTER];
+    int ntypes;
+    Uint32 types[SERVE_MAX_FILTER];
+    char req[256];
+    int reqlen;
+    char * out;  /* SERVE_CLIENT_BUFFER bytes pending write, from outpos to outlen. */
+    int outpos, outlen;
+    SDL_bool waiting;  /* EPOLLOUT armed. */
+    SDL_bool eof;      /* subscriber shut down its sending side; EPOLLIN disarmed, events still flow. */
+    long lagged;  /* events dropped since the last lag notice sent. */
+    long sent, lost;
+} subscriber_t;
+
+/* Unix-domain socket event server (--serve).
+   The main thread only copies records into a bounded queue and pokes an eventfd; filtering, encoding and all socket I/O happen on the server thread.
+*/
+typedef struct server_s {
+    const char * path;  /* socket path, or NULL if not serving. */
+#ifdef HAVE_EVSERVER
+    int listenfd, epfd, wakefd;
+    SDL_Thread * thread;
+    SDL_atomic_t alive;
+    evfeed_record_t * queue;
+    SDL_atomic_t head;  /* records queued; written by main thread. */
+    SDL_atomic_t tail;  /* records taken; written by server thread. */
+    SDL_atomic_t dropped;  /* records the main thread found no room for. */
+    Uint64 seq;  /* main thread. */
+    int dropseen;  /* server thread. */
+    subscriber_t clients[SERVE_MAX_CLIENTS];
+#endif /* HAVE_EVSERVER */
+} server_t;
+
+/* Event capture file being recorded (--record).
+   Main thread fills one buffer at a time and hands it to the writer thread, which writes all buffers
+   queued so far in one call; main thread never waits for the file.  If every buffer is queued,
+   events are dropped from the capture and counted as a stall.
+   With --segment-size or --segment-time, the capture is a series of files PATH.000001, PATH.000002, ...
+   each starting with its own header and device list.  The writer thread switches files, and removes
+   the segment --segment-keep back unless a trigger marked it.
+*/
+typedef struct capture_s {
+    const char * path;  /* NULL if not recording. */
+    SDL_bool direct;    /* bypass page cache (--record-direct). */
+    Uint64 segment_bytes;  /* start next segment at this size, or 0. */
+    int segment_s;         /* start next segment after this long, or 0. */
+    int keep;              /* segments kept, current included; 0 keeps all. */
+    int window_s;          /* trigger keeps segments this far before and after it. */
+#ifdef HAVE_CAPTURE_FD
+    int fd;
+    Uint64 reserved;    /* file space preallocated up to; writer thread. */
+#else
+    SDL_RWops * io;
+#endif
+    /* writer thread. */
+    unsigned fileseg;   /* segment of open file. */
+    Uint64 offset;      /* bytes written to open file. */
+    Uint64 length;      /* of them, without O_DIRECT padding. */
+
+    Uint8 * mem;
+    Uint8 * bufs[CAPTURE_BUFFERS];
+    size_t lens[CAPTURE_BUFFERS];  /* bytes to write from each queued buffer. */
+    size_t pads[CAPTURE_BUFFERS];  /* of them, padding to be truncated. */
+    unsigned segs[CAPTURE_BUFFERS];  /* segment each queued buffer belongs to. */
+    SDL_Thread * thread;
+    SDL_mutex * lock;
+    SDL_cond * cond;
+
+    /* main thread. */
+    Uint64 seq;
+    Uint64 size;     /* bytes of capture produced. */
+    Uint64 segsize;  /* of them, in current segment. */
+    unsigned segment;  /* current segment, from 1; 0 if not segmented. */
+    SDL_bool needhead;  /* header of current segment not written yet. */
+    Uint32 segstarts[CAPTURE_SEGMENT_RING];  /* ticks when each recent segment started. */
+    int fill;        /* buffer being filled, or -1 if none was free. */
+    size_t filled;   /* bytes in it. */
+    size_t padding;  /* of them, padding. */
+    Uint32 started;  /* ticks when first byte went into it. */
+    int stalls;      /* times no buffer was free. */
+    Uint64 dropped;  /* events lost to stalls. */
+
+    /* under lock. */
+    SDL_bool alive;
+    int qhead;       /* oldest queued buffer. */
+    int queued;      /* buffers handed to writer and not yet written. */
+    int peak;        /* most buffers queued at once. */
+    SDL_bool failed;
+    int flushes;
+    Uint64 written;
+    Uint64 flush_us;  /* total time in writes. */
+    Uint32 flush_max_us;
+    Uint32 flush_last_us;
+    SDL_bool kept[CAPTURE_SEGMENT_RING];  /* segment marked by a trigger. */
+    Uint32 keep_until;  /* segments started before these ticks are kept. */
+    int triggers;
+} capture_t;
+
+/* Capture comparison (--diff). */
+typedef struct capdiff_s {
+    const char * patha;  /* NULL if not diffing. */
+    const char * pathb;
+    int tolerance;  /* allowed difference in analog values. */
+    int drift_ms;   /* timing drift reported per event beyond this. */
+} capdiff_t;
+
+/* Prometheus histogram; bucket i counts observations up to metrics_bounds[i] (not cumulative). */
+typedef struct histogram_s {
+    Uint64 buckets[METRICS_BUCKETS + 1];  /* last is +Inf. */
+    Uint64 count;
+    double sum;
+} histogram_t;
+
+/* Metrics export (--metrics-file, --metrics-port).
+   Main thread counts, and renders the Prometheus text format into a snapshot every METRICS_REFRESH_MS.
+   The metrics thread writes the latest snapshot to the textfile every --metrics-interval (through a
+   temporary file renamed into place, as node_exporter expects), and answers HTTP scrapes on 127.0.0.1.
+*/
+typedef struct metrics_s {
+    const char * path;  /* textfile, or NULL. */
+    int port;           /* localhost HTTP port, or 0. */
+    int interval_s;     /* between textfile writes. */
+
+    /* main thread. */
+    char * text;        /* exposition being rendered (METRICS_TEXT_MAX); NULL if not exporting. */
+    int len;
+    SDL_bool truncated;
+    long refreshed;     /* ticks of last snapshot. */
+    double s_per_tick;
+    Uint64 events[MAX_CATEGORIES];
+    Uint32 types[METRICS_MAX_TYPES];
+    Uint64 typecounts[METRICS_MAX_TYPES];
+    int ntypes;
+    Uint64 othertypes;  /* events of types past METRICS_MAX_TYPES. */
+    Uint64 quiet;       /* axis changes within the deadband. */
+    histogram_t loop;   /* start of one main loop cycle to the next. */
+    histogram_t frame;  /* drawing and presenting the frame. */
+    Uint64 cyclemark;   /* counter at start of previous cycle. */
+
+    /* under lock. */
+    SDL_mutex * lock;
+    char * snapshot;
+    int snaplen;
+    SDL_bool alive;
+    SDL_Thread * thread;
+#ifdef HAVE_METRICS_HTTP
+    int listenfd;
+#endif
+} metrics_t;
+
+/* When to composite the frame on the CPU instead of per-line texture copies. */
+enum composite_mode_e {
+    COMPOSITE_AUTO = 0,  /* only with the software renderer. */
+    COMPOSITE_ALWAYS,
+    COMPOSITE_NEVER,
+
+    MAX_COMPOSITE_MODES
+};
+
+static const char * composite_mode_names[MAX_COMPOSITE_MODES] = {
+    "auto",
+    "always",
+    "never",
+};
+
+/* CPU framebuffer, uploaded to one streaming texture per frame. */
+typedef struct composite_s {
+    SDL_bool active;
+    int w;
+    int h;
+    Uint32 * fb;  /* ARGB8888, w*h, rows packed. */
+    SDL_Texture * tex;
+} composite_t;
+
+/* Row textures for log lines: rows of shared streaming sheets, one column wide,
+   rewritten in place with SDL_UpdateTexture() as lines come and go. Rows are numbered from 1. */
+typedef struct rowpool_s {
+    int roww;
+    int rowh;  /* taken from first line placed; 0 until then. */
+    int nsheets;
+    SDL_Texture * sheets[ROWPOOL_MAX_SHEETS];
+    int nfree;
+    int freerows[ROWPOOL_MAX_SHEETS * ROWPOOL_SHEET_ROWS];
+    int inuse;
+    int peak;
+    long hits;       /* rows handed out without creating a texture. */
+    long newsheets;  /* rows that needed a new sheet. */
+    long exhausted;  /* rows refused, all sheets full. */
+    long oversized;  /* lines taller or wider than a row, given a texture of their own. */
+} rowpool_t;
+
+/* One textured quad in a display list. */
+typedef struct drawcmd_s {
+    SDL_Texture * tex;
+    SDL_Rect src;  /* w == 0 for whole texture. */
+    SDL_Rect dst;
+    Uint8 alpha;
+    int seq;  /* submission order; later duplicate wins. */
+} drawcmd_t;
+
+/* Draw commands collected over one frame, submitted sorted by texture in batches. */
+typedef struct displist_s {
+    int len;
+    int alloc;
+    drawcmd_t * cmds;
+
+    int nfills;
+    int fillalloc;
+    SDL_Rect * fills;  /* solid rectangles in current draw color. */
+
+    int ntransient;
+    int transientalloc;
+    SDL_Texture ** transient;  /* one-frame textures, destroyed after submit. */
+
+#ifdef HAVE_RENDER_GEOMETRY
+    int quadalloc;
+    SDL_Vertex * verts;  /* scratch, 4 per quad. */
+    int * indices;       /* scratch, 6 per quad. */
+#endif /* HAVE_RENDER_GEOMETRY */
+} displist_t;
+
+/* One line type in an overload summary; type is the text before ": ". */
+typedef struct summary_s {
+    char key[32];
+    char last[64];  /* text after ": " of latest line. */
+    long count;
+    long window;  /* count in current rate window. */
+    int rate;     /* per second, over last window. */
+} summary_t;
+
+/* Overload state of one column. */
+typedef struct overload_s {
+    SDL_bool active;  /* showing summary instead of lines. */
+    long window_t;    /* start of current rate window. */
+    long window;      /* lines in current rate window. */
+    int rate;         /* lines per second, over last window. */
+    long calm_t;      /* since when rate is below exit threshold; 0 if not. */
+    long summarized;  /* lines folded into summary since overload began. */
+    long other;       /* lines of types beyond MAX_SUMMARY_KEYS. */
+    int nkeys;
+    summary_t keys[MAX_SUMMARY_KEYS];
+} overload_t;
+
+/* Text to rasterize off the main thread; result comes back in surf. */
+typedef struct rasterjob_s {
+    int catnum;
+    int slot;    /* index into logbuf->buf. */
+    Uint32 gen;  /* logentry generation when queued. */
+    int fontnum;
+    SDL_bool mask;  /* coverage mask for CPU compositing. */
+    char text[MAX_LINELENGTH];
+    SDL_Surface * surf;
+} rasterjob_t;
+
+/* One rasterization thread, with its own font instances. */
+typedef struct rasterworker_s {
+    struct rasterpool_s * pool;
+    SDL_Thread * thread;
+    TTF_Font * fonts[MAX_FONTS];  /* opened on first use, from in-memory font data. */
+} rasterworker_t;
+
+/* Text rasterization worker pool; started on first line needing TTF rendering. */
+typedef struct rasterpool_s {
+    int nthreads;  /* requested; -1 for automatic, 0 to rasterize on main thread. */
+    int nworkers;  /* running. */
+    rasterworker_t workers[MAX_RASTER_THREADS];
+
+    const void * font_data;
+    size_t font_size;
+
+    SDL_mutex * lock;      /* guards queues and alive. */
+    SDL_cond * jobcond;    /* signalled on new job, or shutdown. */
+    SDL_mutex * fontlock;  /* app's; serializes opening and closing fonts (shared FreeType library). */
+    SDL_bool alive;
+
+    int outstanding;  /* submitted but not yet collected; main thread only. */
+    int jobhead;
+    int njobs;
+    rasterjob_t jobs[RASTER_QUEUE_LEN];
+    int donehead;
+    int ndone;
+    rasterjob_t done[RASTER_QUEUE_LEN];
+} rasterpool_t;
+
 /* Persistent graphics elements. */
 typedef struct gfxdecor_s {
     int x;
     int y;
     SDL_Surface * surf;
     SDL_Texture * tex;
+    SDL_bool glyphs;  /* drawn from glyph atlas every frame; no surf or tex. */
+    int fontnum;
+    char text[MAX_LINELENGTH];
 } gfxdecor_t;
 
 typedef struct app_s {
@@ -173,6 +971,13 @@ typedef struct app_s {
     int age_fade_start;
     int age_fade_end;
     SDL_bool log_heartbeat;
+    const char * trace_path;  /* Chrome trace-event output file, or NULL. */
+    enum composite_mode_e composite_mode;
+    int raster_budget_ms;  /* per frame; 0 for unlimited. */
+    int resource_log_s;  /* period of resource report; 0 for none. */
+    long resource_log_t;  /* time of last resource report. */
+    int bench_format;  /* lines to format in benchmark, then quit; 0 to run normally. */
+    int exitcode;  /* when app_init returns NULL. */
 
     int width;
     int height;
@@ -184,19 +989,60 @@ typedef struct app_s {
     int rflags;
     SDL_Renderer *r;
     SDL_GLContext glctx;
+    composite_t comp;
+    displist_t displist;
+    rowpool_t rows;  /* log line textures. */
+    SDL_Texture * glyph_sheet;  /* glyph atlas as one texture, made on first use. */
 
     int rowsize;
 
-    SDL_RWops * font_io[1];  /* SDL_RWops* type for TTF (file). */
-    TTF_Font * fonts[4];
-    SDL_Joystick * jspack[MAX_JOYSTICKS];
-    SDL_GameController * gcpack[MAX_GAMEPADS];
+    SDL_RWops * font_io[1];  /* SDL_RWops* type for TTF (in-memory font data). */
+    TTF_Font * fonts[MAX_FONTS];  /* all NULL until first text needing TTF. */
+    const void * font_data;  /* built-in font, or font_buf; NULL until first needed. */
+    size_t font_size;
+    void * font_buf;  /* font file contents, if not built-in. */
+    SDL_mutex * fontlock;  /* held by main thread around every TTF call once workers may run; see rasterpool_t. */
+
+    /* Off-thread text rasterization. */
+    rasterpool_t raster;
+
+    /* Opened joysticks and game controllers. */
+    devreg_t devices;
+
+    /* Virtual joystick load generator. */
+    synth_t synth;
+
+    /* Live event feed for other processes. */
+    feed_t feed;
+    server_t server;
+    capture_t capture;
+    metrics_t metrics;
+    capdiff_t diff;
+    const char * analyze_path;  /* capture to analyze, then quit. */
+    int deadband;  /* axis changes logged only beyond this; 0 for all, or DEADBAND_AUTO. */
+    int sensors_mode;      /* SENSORS_*. */
+    int sensor_window_ms;  /* sensor summary window; 0 for no summaries. */
+    int sensor_decimate;   /* log every Nth sensor sample; 0 for none. */
+    int touch_decimate;    /* log every Nth touchpad or finger motion. */
+    struct {
+	SDL_TouchID touchid;
+	SDL_FingerID fingerid;
+	long motion;  /* motions since touched; -1 for free slot. */
+    } fingers[MAX_FINGERS];  /* touch screen fingers down. */
+    sensordev_t sensors[MAX_SENSORS];
+    int nsensors;
+
+    /* Streamed mapping database (MAPPING_FILE). */
+    mapdb_t mapdb;
 
     /* Persistent decorations. */
     gfxdecor_t decor[MAX_GFXDECOR];
 
     /* A logbuf instance per column. */
     logbuf_t logbuf[MAX_CATEGORIES];
+    /* Overload detection and summary per column. */
+    overload_t overload[MAX_CATEGORIES];
+    char linebuf[MAX_LINELENGTH];  /* line being formatted for a summarized column. */
 
     /* Heartbeat samples. */
     struct heartbeats_s {
@@ -209,6 +1055,54 @@ typedef struct app_s {
 	char report[60];  /* text to show as heartbeat report. */
     } heartbeats;
 
+    /* Batched event ingestion. */
+    struct ingest_s {
+	SDL_Event buf[EVENT_BATCH];
+	long nbatches;
+	long nevents;
+	long nruns;  /* runs of same-type events dispatched. */
+	long hist[EVENT_HIST_BUCKETS];  /* batches by size: 1, 2-3, 4-7, ... */
+    } ingest;
+
+    /* Per-frame counts (reset every main loop cycle). */
+    struct framestats_s {
+	int events;     /* events ingested. */
+	int textures;   /* textures created. */
+	int lines;      /* log lines drawn. */
+	int deferred;   /* lines left unrasterized, over budget. */
+	int cmds;       /* display list commands. */
+	int dropped;    /* duplicate commands dropped. */
+	int drawcalls;  /* render calls submitted. */
+	int switches;   /* texture changes between draw calls. */
+	long uploaded;  /* pixel bytes uploaded to textures. */
+	int allocs;     /* heap allocations, all threads. */
+	long allocbytes;
+	int quiet;      /* axis changes within the deadband, not logged. */
+    } frame;
+    struct framestats_s stats;  /* previous frame's counts, for overlay. */
+    SDL_bool show_stats;  /* F3 toggles overlay. */
+    Uint32 allocmark;  /* allocation counters at end of previous frame; unsigned, as they wrap. */
+    Uint32 allocbytesmark;
+
+    /* Steady-state allocation check (--check-alloc). */
+    struct checkalloc_s {
+	int seconds;  /* checked run time after warmup; 0 if not checking. */
+	long t0;      /* first frame. */
+	long frames;  /* frames checked. */
+	long dirty;   /* checked frames that allocated. */
+	long allocs;
+	long bytes;
+	SDL_bool failed;
+    } checkalloc;
+
+    /* Startup phase timing (--trace-startup). */
+    struct startup_s {
+	SDL_bool trace;
+	int nphases;
+	const char * names[MAX_STARTUP_PHASES];
+	Uint64 stamps[MAX_STARTUP_PHASES];  /* performance counter at end of phase; [0] is start. */
+    } startup;
+
     /* SDL window title. */
     char title0[255];
 
@@ -247,8 +1141,173 @@ const unsigned char * ttf0_data_end = ttf0_data;
 
 
 const char BANNER[] = APP_TITLE " - add as Non-Steam Game, run from Big Picture Mode; ESCAPE to quit";
-const char FOOTER[] = "F2: TextEntry";
+const char FOOTER[] = "F2: TextEntry  F3: Render stats  F9: Keep capture";
+
+
+/* Live surfaces, textures and fonts held by the program; surfaces also come and go on worker threads. */
+static struct resstats_s {
+    SDL_atomic_t surfaces;
+    SDL_atomic_t surfacekb;
+    SDL_atomic_t textures;
+    SDL_atomic_t texturekb;  /* all textures here are 32 bits per pixel. */
+    SDL_atomic_t fonts;
+    SDL_atomic_t rasterized;  /* text rasterizations by TTF so far, not live. */
+} resstats;
+
+static
+int surface_kb (const SDL_Surface * surf)
+{
+  return (surf->h * surf->pitch + 1023) / 1024;
+}
+
+static
+int texture_kb (SDL_Texture * tex)
+{
+  int w = 0, h = 0;
+  SDL_QueryTexture(tex, NULL, NULL, &w, &h);
+  return (w * h * 4 + 1023) / 1024;
+}
+
+/* Count surface just created; passes NULL through. */
+SDL_Surface * res_surface (SDL_Surface * surf)
+{
+  if (surf)
+    {
+      SDL_AtomicAdd(&resstats.surfaces, 1);
+      SDL_AtomicAdd(&resstats.surfacekb, surface_kb(surf));
+    }
+  return surf;
+}
+
+void res_free_surface (SDL_Surface * surf)
+{
+  if (! surf)
+    return;
+  SDL_AtomicAdd(&resstats.surfaces, -1);
+  SDL_AtomicAdd(&resstats.surfacekb, -surface_kb(surf));
+  SDL_FreeSurface(surf);
+}
+
+SDL_Texture * res_texture (SDL_Texture * tex)
+{
+  if (tex)
+    {
+      SDL_AtomicAdd(&resstats.textures, 1);
+      SDL_AtomicAdd(&resstats.texturekb, texture_kb(tex));
+    }
+  return tex;
+}
+
+void res_destroy_texture (SDL_Texture * tex)
+{
+  if (! tex)
+    return;
+  SDL_AtomicAdd(&resstats.textures, -1);
+  SDL_AtomicAdd(&resstats.texturekb, -texture_kb(tex));
+  SDL_DestroyTexture(tex);
+}
+
+TTF_Font * res_font (TTF_Font * font)
+{
+  if (font)
+    SDL_AtomicAdd(&resstats.fonts, 1);
+  return font;
+}
+
+void res_close_font (TTF_Font * font)
+{
+  if (! font)
+    return;
+  SDL_AtomicAdd(&resstats.fonts, -1);
+  TTF_CloseFont(font);
+}
+
+
+/* Sheet holding row. */
+SDL_Texture * rowpool_sheet (const rowpool_t * pool, int row)
+{
+  return pool->sheets[(row - 1) / ROWPOOL_SHEET_ROWS];
+}
+
+/* Area of row within its sheet. */
+void rowpool_rect (const rowpool_t * pool, int row, SDL_Rect * rect)
+{
+  rect->x = 0;
+  rect->y = ((row - 1) % ROWPOOL_SHEET_ROWS) * pool->rowh;
+  rect->w = pool->roww;
+  rect->h = pool->rowh;
+}
+
+/* Take a free row, adding a sheet if none is left; returns 0 if exhausted. */
+int rowpool_acquire (rowpool_t * pool, SDL_Renderer * r)
+{
+  if (pool->nfree > 0)
+    {
+      pool->hits++;
+    }
+  else
+    {
+      SDL_Texture * sheet = NULL;
+      if (pool->nsheets < ROWPOOL_MAX_SHEETS)
+	sheet = res_texture(SDL_CreateTexture(r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+					      pool->roww, ROWPOOL_SHEET_ROWS * pool->rowh));
+      if (! sheet)
+	{
+	  pool->exhausted++;
+	  return 0;
+	}
+      pool->newsheets++;
+      SDL_SetTextureBlendMode(sheet, SDL_BLENDMODE_BLEND);
+      int base = pool->nsheets * ROWPOOL_SHEET_ROWS;
+      pool->sheets[pool->nsheets++] = sheet;
+      /* lowest row on top of free stack. */
+      for (int i = ROWPOOL_SHEET_ROWS; i > 0; i--)
+	pool->freerows[pool->nfree++] = base + i;
+    }
+  pool->inuse++;
+  if (pool->inuse > pool->peak)
+    pool->peak = pool->inuse;
+  return pool->freerows[--pool->nfree];
+}
+
+void rowpool_release (rowpool_t * pool, int row)
+{
+  pool->freerows[pool->nfree++] = row;
+  pool->inuse--;
+}
+
+/* Drop all sheets, for new row width; rows handed out become invalid. */
+void rowpool_reset (rowpool_t * pool, int roww)
+{
+  for (int i = 0; i < pool->nsheets; i++)
+    res_destroy_texture(pool->sheets[i]);
+  pool->nsheets = 0;
+  pool->nfree = 0;
+  pool->inuse = 0;
+  pool->rowh = 0;
+  pool->roww = roww;
+}
 
+/* Release raster of line: surface, own texture, or pooled row. */
+static
+void logbuf_release (logbuf_t * logbuf, logentry_t * entry)
+{
+  if (entry->surf)
+    {
+      res_free_surface(entry->surf);
+      entry->surf = NULL;
+    }
+  if (entry->tex)
+    {
+      res_destroy_texture(entry->tex);
+      entry->tex = NULL;
+    }
+  if (entry->row)
+    {
+      rowpool_release(logbuf->rows, entry->row);
+      entry->row = 0;
+    }
+}
 
 logbuf_t * logbuf_init (logbuf_t * logbuf, int cap)
 {
@@ -262,7 +1321,7 @@ logbuf_t * logbuf_init (logbuf_t * logbuf, int cap)
       abort();
     }
 
-  SDL_memset(logbuf, 0, sizeof(logbuf));
+  SDL_memset(logbuf, 0, sizeof(*logbuf));
   if (cap <= 0)
     {
       cap = MAX_NUMLINES;
@@ -278,7 +1337,7 @@ logbuf_t * logbuf_init (logbuf_t * logbuf, int cap)
     {
       /* use heap. */
       logbuf->alloc = sizeof(logentry_t) * cap;
-      logbuf->buf = SDL_malloc(logbuf->alloc);
+      logbuf->buf = SDL_calloc(1, logbuf->alloc);
       if (! logbuf->buf)
 	{
 	  /* fallback to static. */
@@ -294,13 +1353,25 @@ logbuf_t * logbuf_init (logbuf_t * logbuf, int cap)
   return logbuf;
 }
 
+/* Release rasters of all lines and heap space; leaves an empty buffer. */
 logbuf_t * logbuf_destroy (logbuf_t * logbuf)
 {
+  for (int i = 0; i < logbuf->cap; i++)
+    logbuf_release(logbuf, logbuf->buf + i);
+  if (logbuf->alloc)
+    SDL_free(logbuf->buf);
+  logbuf->alloc = 0;
+  logbuf->cap = SDL_min(logbuf->cap, MAX_NUMLINES);
+  logbuf->buf = logbuf->_static;
+  logbuf->head = 0;
+  logbuf->len = 0;
   return logbuf;
 }
 
 int logbuf_resize (logbuf_t * logbuf, int histlen)
 {
+  for (int i = 0; i < logbuf->cap; i++)
+    logbuf_release(logbuf, logbuf->buf + i);
   if (histlen <= MAX_NUMLINES)
     {
       /* use static space. */
@@ -311,8 +1382,11 @@ int logbuf_resize (logbuf_t * logbuf, int histlen)
   else
     {
       /* use heap. */
+      int oldcap = logbuf->alloc ? logbuf->cap : 0;
       logbuf->alloc = sizeof(logentry_t) * histlen;
-      logbuf->buf = SDL_realloc(logbuf->buf, logbuf->alloc);
+      logbuf->buf = SDL_realloc(oldcap ? logbuf->buf : NULL, logbuf->alloc);
+      if (logbuf->buf && (histlen > oldcap))
+	SDL_memset(logbuf->buf + oldcap, 0, sizeof(logentry_t) * (histlen - oldcap));
       if (! logbuf->buf)
 	{
 	  /* fallback to static. */
@@ -331,28 +1405,44 @@ int logbuf_resize (logbuf_t * logbuf, int histlen)
   return logbuf->cap;
 }
 
-/* append line to buffer. */
-int logbuf_append (logbuf_t * logbuf, const char * buf, int buflen)
+/* Slot the next line goes into, for writing text in place; follow with logbuf_commit(). */
+logentry_t * logbuf_reserve (logbuf_t * logbuf)
+{
+  int n = (logbuf->head + logbuf->len) % logbuf->cap;
+  logentry_t * entry = logbuf->buf + n;
+  /* drop raster of line being overwritten (oldest on overflow, or left over by logbuf_clear()). */
+  logbuf_release(logbuf, entry);
+  return entry;
+}
+
+/* Make reserved slot the newest line. */
+int logbuf_commit (logbuf_t * logbuf)
 {
   int n = (logbuf->head + logbuf->len) % logbuf->cap;
-  SDL_memcpy(logbuf->buf[n].line, buf, buflen);
-  logbuf->buf[n].fade.spawntime = SDL_GetTicks();
+  logentry_t * entry = logbuf->buf + n;
+  entry->fade.spawntime = SDL_GetTicks();
+  entry->glyphs = SDL_FALSE;
+  entry->pending = SDL_FALSE;
+  entry->gen = ++logbuf->gen;
+  PROBE3(log_append, entry->line, entry->gen, entry->fade.spawntime);
   logbuf->len++;
   if (logbuf->len > logbuf->cap)
     {
-      /* Overflowed. */
-      logentry_t * entry = logbuf->buf + logbuf->head;
-      SDL_FreeSurface(entry->surf);
-      entry->surf = NULL;
-      SDL_DestroyTexture(entry->tex);
-      entry->tex = NULL;
-
+      /* Overflowed; oldest line was overwritten. */
       logbuf->head = (logbuf->head + 1) % logbuf->cap;
       logbuf->len--;
     }
   return 0;
 }
 
+/* append line to buffer. */
+int logbuf_append (logbuf_t * logbuf, const char * buf, int buflen)
+{
+  logentry_t * entry = logbuf_reserve(logbuf);
+  SDL_memcpy(entry->line, buf, buflen);
+  return logbuf_commit(logbuf);
+}
+
 int logbuf_len (logbuf_t * logbuf)
 {
   return logbuf->len;
@@ -405,6 +1495,238 @@ int logbuf_test (void)
 
 
 
+/* Trace export.
+   Each traced thread owns a preallocated record buffer; recording a span is a counter read and a store.
+   When a half fills, the thread swaps halves and a writer thread converts the full one to Chrome trace-event JSON
+   (loadable in chrome://tracing or Perfetto UI), so traced threads never wait on the file.
+*/
+static struct tracer_s {
+    FILE * fp;  /* written by writer thread, then by trace_close(). */
+    SDL_mutex * lock;  /* guards buffer list, and halves handed over. */
+    SDL_cond * wake;     /* signalled on a full half, or shutdown. */
+    SDL_cond * written;  /* signalled when a full half has been written. */
+    SDL_Thread * writer;
+    SDL_bool writing;
+    Uint64 t0;
+    double us_per_tick;
+    int nthreads;
+    int nwritten;  /* JSON objects written so far. */
+    tracebuf_t * bufs;
+} tracer;
+
+#ifdef __GNUC__
+static __thread tracebuf_t * trace_local;
+#else
+static tracebuf_t * trace_local;  /* no TLS: trace main thread only. */
+#endif
+
+#define TRACE_BEGIN(id) do { if (trace_local) trace_emit((id), 'B', 0); } while (0)
+#define TRACE_END(id) do { if (trace_local) trace_emit((id), 'E', 0); } while (0)
+#define TRACE_COUNTER(id, v) do { if (trace_local) trace_emit((id), 'C', (v)); } while (0)
+
+/* Convert and write out records of thread tid.  Writer thread, or trace_close() once it has stopped. */
+static
+void trace_write (int tid, const tracerec_t * recs, int len)
+{
+  for (int i = 0; i < len; i++)
+    {
+      const tracerec_t * rec = recs + i;
+      double ts = (double)(rec->t - tracer.t0) * tracer.us_per_tick;
+      fprintf(tracer.fp, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+	      tracer.nwritten++ ? ",\n" : "",
+	      trace_names[rec->id], rec->ph, ts, tid);
+      if (rec->ph == 'C')
+	fprintf(tracer.fp, ",\"args\":{\"value\":%d}", rec->value);
+      fputs("}", tracer.fp);
+    }
+}
+
+/* Writer thread: write out full halves as traced threads hand them over, until trace_close(). */
+static
+int trace_writer (void * data)
+{
+  (void)data;
+  SDL_LockMutex(tracer.lock);
+  for (;;)
+    {
+      tracebuf_t * buf = tracer.bufs;
+      while (buf && !buf->full)
+	buf = buf->next;
+      if (buf)
+	{
+	  SDL_UnlockMutex(tracer.lock);
+	  trace_write(buf->tid, buf->full, buf->fulllen);
+	  SDL_LockMutex(tracer.lock);
+	  buf->full = NULL;
+	  SDL_CondBroadcast(tracer.written);
+	  continue;
+	}
+      if (! tracer.writing)
+	break;
+      SDL_CondWait(tracer.wake, tracer.lock);
+    }
+  SDL_UnlockMutex(tracer.lock);
+  return 0;
+}
+
+static
+void trace_emit (int id, char ph, Sint32 value)
+{
+  tracebuf_t * buf = trace_local;
+  if (buf->len == TRACE_BUFFER_RECORDS)
+    {
+      SDL_LockMutex(tracer.lock);
+      /* only if the writer is a whole half behind. */
+      while (buf->full)
+	SDL_CondWait(tracer.written, tracer.lock);
+      buf->full = buf->recs;
+      buf->fulllen = buf->len;
+      buf->recs = (buf->recs == buf->halves[0]) ? buf->halves[1] : buf->halves[0];
+      buf->len = 0;
+      SDL_CondSignal(tracer.wake);
+      SDL_UnlockMutex(tracer.lock);
+    }
+  tracerec_t * rec = buf->recs + buf->len++;
+  rec->t = SDL_GetPerformanceCounter();
+  rec->value = value;
+  rec->id = id;
+  rec->ph = ph;
+}
+
+/* Start recording spans from calling thread; no-op if tracing is off. */
+int trace_thread (const char * name)
+{
+  if (!tracer.fp || trace_local)
+    return 0;
+  tracebuf_t * buf = SDL_calloc(1, sizeof(tracebuf_t));
+  if (!buf)
+    return -1;
+  buf->name = name;
+  buf->recs = buf->halves[0];
+  SDL_LockMutex(tracer.lock);
+  buf->tid = ++tracer.nthreads;
+  buf->next = tracer.bufs;
+  tracer.bufs = buf;
+  SDL_UnlockMutex(tracer.lock);
+  trace_local = buf;
+  return buf->tid;
+}
+
+int trace_open (const char * path)
+{
+  tracer.fp = fopen(path, "w");
+  if (!tracer.fp)
+    {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to open trace file '%s'.", path);
+      return -1;
+    }
+  tracer.lock = SDL_CreateMutex();
+  tracer.wake = SDL_CreateCond();
+  tracer.written = SDL_CreateCond();
+  tracer.t0 = SDL_GetPerformanceCounter();
+  tracer.us_per_tick = 1000000.0 / SDL_GetPerformanceFrequency();
+  fputs("[\n", tracer.fp);
+  tracer.writing = SDL_TRUE;
+  tracer.writer = SDL_CreateThread(trace_writer, "trace", NULL);
+  if (!tracer.lock || !tracer.wake || !tracer.written || !tracer.writer)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed thread in trace.open");
+      abort();
+    }
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Tracing to '%s'.", path);
+  return 0;
+}
+
+/* Stop writer, flush all buffers and finish file.  Traced threads other than caller must have stopped. */
+int trace_close (void)
+{
+  if (!tracer.fp)
+    return 0;
+  SDL_LockMutex(tracer.lock);
+  tracer.writing = SDL_FALSE;
+  SDL_CondSignal(tracer.wake);
+  SDL_UnlockMutex(tracer.lock);
+  SDL_WaitThread(tracer.writer, NULL);
+  tracer.writer = NULL;
+
+  tracebuf_t * buf = tracer.bufs;
+  while (buf)
+    {
+      tracebuf_t * next = buf->next;
+      trace_write(buf->tid, buf->recs, buf->len);
+      fprintf(tracer.fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+	      tracer.nwritten++ ? ",\n" : "", buf->tid, buf->name);
+      SDL_free(buf);
+      buf = next;
+    }
+  tracer.bufs = NULL;
+  trace_local = NULL;
+  fputs("\n]\n", tracer.fp);
+  fclose(tracer.fp);
+  tracer.fp = NULL;
+  SDL_DestroyCond(tracer.wake);
+  SDL_DestroyCond(tracer.written);
+  SDL_DestroyMutex(tracer.lock);
+  tracer.wake = tracer.written = NULL;
+  tracer.lock = NULL;
+  return 0;
+}
+
+
+
+/* Heap allocations through SDL_malloc() and friends, counted across all threads. */
+static struct allocstats_s {
+    SDL_atomic_t count;
+    SDL_atomic_t bytes;  /* wraps; only differences are meaningful. */
+#ifdef HAVE_MEMORY_FUNCTIONS
+    SDL_malloc_func malloc_func;
+    SDL_calloc_func calloc_func;
+    SDL_realloc_func realloc_func;
+    SDL_free_func free_func;
+#endif /* HAVE_MEMORY_FUNCTIONS */
+} allocstats;
+
+#ifdef HAVE_MEMORY_FUNCTIONS
+static
+void * SDLCALL counting_malloc (size_t size)
+{
+  SDL_AtomicAdd(&allocstats.count, 1);
+  SDL_AtomicAdd(&allocstats.bytes, (int)size);
+  return allocstats.malloc_func(size);
+}
+
+static
+void * SDLCALL counting_calloc (size_t nmemb, size_t size)
+{
+  SDL_AtomicAdd(&allocstats.count, 1);
+  SDL_AtomicAdd(&allocstats.bytes, (int)(nmemb * size));
+  return allocstats.calloc_func(nmemb, size);
+}
+
+static
+void * SDLCALL counting_realloc (void * mem, size_t size)
+{
+  SDL_AtomicAdd(&allocstats.count, 1);
+  SDL_AtomicAdd(&allocstats.bytes, (int)size);
+  return allocstats.realloc_func(mem, size);
+}
+
+/* Route SDL's allocator through the counters; call before SDL allocates anything.
+   Memory from libraries calling malloc() directly (FreeType, GL drivers) is not seen. */
+int alloc_hook (void)
+{
+  SDL_GetMemoryFunctions(&allocstats.malloc_func, &allocstats.calloc_func, &allocstats.realloc_func, &allocstats.free_func);
+  return SDL_SetMemoryFunctions(counting_malloc, counting_calloc, counting_realloc, allocstats.free_func);
+}
+#else
+int alloc_hook (void)
+{
+  return -1;
+}
+#endif /* HAVE_MEMORY_FUNCTIONS */
+
+
+
 /*
    Determine fully-qualified path name to font file 'filename'.
 Try:
@@ -457,10 +1779,68 @@ const char * options_summary = \
 "  -V, --version             Show version information and quit.\n"
 "  -v N, --verbose=N         Set logging verbosity [0].\n"
 "  -r WxH, --resolution=WxH  Set window resolution [1280x720].\n"
-"  -m FILE, --map-file=FILE  Load SDL game controller mappings from file.\n"
+"  -m FILE, --map-file=FILE  Load SDL game controller mappings from file;\n"
+"                            reloaded live when the file changes.\n"
 "  -M MAP, --map-string=MAP  Add SDL game controller mapping.\n"
 "  --map-env=ENVNAME         SDL game controller mapping from environment.\n"
 "  --map-help                Dump controller GUIDs and names.\n"
+"  --trace-startup           Log time taken by each startup phase.\n"
+"  --trace=FILE              Write main loop phases as Chrome trace JSON.\n"
+"  --synth=N                 Attach N virtual joysticks driven by a generator.\n"
+"  --synth-rate=HZ           Generator steps per second [100].\n"
+"  --synth-pattern=PAT       Generator pattern: sweep, noise, mash [sweep].\n"
+"  --synth-gamepad           Expose virtual joysticks as game controllers.\n"
+"  --composite=MODE          Composite frame on CPU: auto (software renderer\n"
+"                            only), always, never [auto].\n"
+"  --raster-threads=N        Text rasterization threads; 0 for main thread\n"
+"                            [CPU count - 1, up to 4].\n"
+"  --raster-budget=MS        Time per frame for rasterizing and uploading\n"
+"                            text, newest lines first; 0 for unlimited [4].\n"
+;
+/* Continued; one string would pass the 4095 characters C99 compilers must accept. */
+const char * options_summary_events = \
+"  --feed=NAME               Publish events to POSIX shared memory NAME\n"
+"                            (layout in evfeed.h).\n"
+"  --serve=PATH              Stream events to subscribers on Unix socket PATH.\n"
+"  --record=FILE             Record events to capture FILE.\n"
+"  --record-direct           Write capture bypassing the page cache (O_DIRECT).\n"
+"  --segment-size=MB         Record to files FILE.000001, FILE.000002, ...,\n"
+"                            starting the next at MB megabytes.\n"
+"  --segment-time=S          Start the next segment file after S seconds.\n"
+"  --segment-keep=N          Keep only the last N segments, besides those kept by\n"
+"                            a trigger (F9, or a column overloading) [all].\n"
+"  --trigger-window=S        A trigger keeps segments from S seconds before to\n"
+"                            S seconds after it [30].\n"
+"  --metrics-file=PATH       Write Prometheus metrics to textfile PATH.\n"
+"  --metrics-port=N          Serve Prometheus metrics on 127.0.0.1 port N.\n"
+"  --metrics-interval=S      Rewrite metrics textfile every S seconds [15].\n"
+"  --diff=A B                Compare captures A and B, print differences, and\n"
+"                            quit; exit status 1 if they differ.\n"
+"  --diff-tolerance=N        Allowed difference in axis and motion values [0].\n"
+"  --diff-drift=MS           Report events whose timing differs by more than\n"
+"                            MS [10].\n"
+"  --analyze=FILE            Report device rates, intervals, axis and button\n"
+"                            statistics, hotplug and anomalies of capture\n"
+"                            FILE, and quit.\n"
+"  --deadband=N|auto         Log axis changes only beyond N units from the\n"
+"                            last logged value, or a multiple of each axis's\n"
+"                            measured jitter [0, log all].\n"
+"  --sensors=all|controller|off\n"
+"                            Enable gyro and accelerometer of game\n"
+"                            controllers, and with all also standalone\n"
+"                            sensors [controller].\n"
+"  --sensor-window=MS        Summarize each sensor every MS: rate, and mean,\n"
+"                            minimum and maximum per axis; 0 for none [250].\n"
+"  --sensor-decimate=N       Also log every Nth sensor sample; 1 for all\n"
+"                            [0, none].\n"
+"  --touch-decimate=N        Log every Nth motion of each touchpad or screen\n"
+"                            finger; touches and releases always [4].\n"
+"  --resource-log=SECONDS    Log live surfaces, textures, fonts, lines and\n"
+"                            device handles every SECONDS.\n"
+"  --bench-format=N          Time formatting N event lines, printf against\n"
+"                            templates, and quit.\n"
+"  --check-alloc=SECONDS     Run for SECONDS after warmup, then exit with\n"
+"                            failure if any frame allocated heap memory.\n"
 "\n"
 "Mapping information at https://wiki.libsdl.org/SDL_GameControllerAddMapping\n"
 ;
@@ -474,6 +1854,38 @@ const char * OPT_MAP_FILE = "map-file";
 const char * OPT_MAP_ENV = "map-env";
 const char * OPT_MAP_STRING = "map-string";
 const char * OPT_MAP_HELP = "map-help";
+const char * OPT_TRACE_STARTUP = "trace-startup";
+const char * OPT_TRACE = "trace";
+const char * OPT_SYNTH = "synth";
+const char * OPT_SYNTH_RATE = "synth-rate";
+const char * OPT_SYNTH_PATTERN = "synth-pattern";
+const char * OPT_SYNTH_GAMEPAD = "synth-gamepad";
+const char * OPT_COMPOSITE = "composite";
+const char * OPT_RASTER_THREADS = "raster-threads";
+const char * OPT_RASTER_BUDGET = "raster-budget";
+const char * OPT_FEED = "feed";
+const char * OPT_SERVE = "serve";
+const char * OPT_RECORD = "record";
+const char * OPT_RECORD_DIRECT = "record-direct";
+const char * OPT_SEGMENT_SIZE = "segment-size";
+const char * OPT_SEGMENT_TIME = "segment-time";
+const char * OPT_SEGMENT_KEEP = "segment-keep";
+const char * OPT_TRIGGER_WINDOW = "trigger-window";
+const char * OPT_METRICS_FILE = "metrics-file";
+const char * OPT_METRICS_PORT = "metrics-port";
+const char * OPT_METRICS_INTERVAL = "metrics-interval";
+const char * OPT_DIFF = "diff";
+const char * OPT_DIFF_TOLERANCE = "diff-tolerance";
+const char * OPT_DIFF_DRIFT = "diff-drift";
+const char * OPT_ANALYZE = "analyze";
+const char * OPT_DEADBAND = "deadband";
+const char * OPT_SENSORS = "sensors";
+const char * OPT_SENSOR_WINDOW = "sensor-window";
+const char * OPT_SENSOR_DECIMATE = "sensor-decimate";
+const char * OPT_TOUCH_DECIMATE = "touch-decimate";
+const char * OPT_RESOURCE_LOG = "resource-log";
+const char * OPT_CHECK_ALLOC = "check-alloc";
+const char * OPT_BENCH_FORMAT = "bench-format";
 
 app_t * app_parse_argv (app_t * app, int argc, char ** argv)
 {
@@ -492,6 +1904,38 @@ app_t * app_parse_argv (app_t * app, int argc, char ** argv)
 	{ OPT_MAP_ENV, optional_argument, NULL, 0 },
 	{ OPT_MAP_STRING, required_argument, NULL, 'M' },
 	{ OPT_MAP_HELP, no_argument, NULL, 0 },
+	{ OPT_TRACE_STARTUP, no_argument, NULL, 0 },
+	{ OPT_TRACE, required_argument, NULL, 0 },
+	{ OPT_SYNTH, required_argument, NULL, 0 },
+	{ OPT_SYNTH_RATE, required_argument, NULL, 0 },
+	{ OPT_SYNTH_PATTERN, required_argument, NULL, 0 },
+	{ OPT_SYNTH_GAMEPAD, no_argument, NULL, 0 },
+	{ OPT_COMPOSITE, required_argument, NULL, 0 },
+	{ OPT_RASTER_THREADS, required_argument, NULL, 0 },
+	{ OPT_RASTER_BUDGET, required_argument, NULL, 0 },
+	{ OPT_FEED, required_argument, NULL, 0 },
+	{ OPT_SERVE, required_argument, NULL, 0 },
+	{ OPT_RECORD, required_argument, NULL, 0 },
+	{ OPT_RECORD_DIRECT, no_argument, NULL, 0 },
+	{ OPT_SEGMENT_SIZE, required_argument, NULL, 0 },
+	{ OPT_SEGMENT_TIME, required_argument, NULL, 0 },
+	{ OPT_SEGMENT_KEEP, required_argument, NULL, 0 },
+	{ OPT_TRIGGER_WINDOW, required_argument, NULL, 0 },
+	{ OPT_METRICS_FILE, required_argument, NULL, 0 },
+	{ OPT_METRICS_PORT, required_argument, NULL, 0 },
+	{ OPT_METRICS_INTERVAL, required_argument, NULL, 0 },
+	{ OPT_DIFF, required_argument, NULL, 0 },
+	{ OPT_DIFF_TOLERANCE, required_argument, NULL, 0 },
+	{ OPT_DIFF_DRIFT, required_argument, NULL, 0 },
+	{ OPT_ANALYZE, required_argument, NULL, 0 },
+	{ OPT_DEADBAND, required_argument, NULL, 0 },
+	{ OPT_SENSORS, required_argument, NULL, 0 },
+	{ OPT_SENSOR_WINDOW, required_argument, NULL, 0 },
+	{ OPT_SENSOR_DECIMATE, required_argument, NULL, 0 },
+	{ OPT_TOUCH_DECIMATE, required_argument, NULL, 0 },
+	{ OPT_RESOURCE_LOG, required_argument, NULL, 0 },
+	{ OPT_CHECK_ALLOC, required_argument, NULL, 0 },
+	{ OPT_BENCH_FORMAT, required_argument, NULL, 0 },
 	{ 0, 0, 0, 0 }
   };
 
@@ -544,23 +1988,201 @@ app_t * app_parse_argv (app_t * app, int argc, char ** argv)
 	      app->mapping_protocol = MAPPING_ENV;
 	      app->mapping_locator = optarg ? optarg : DEFAULT_MAPPING_ENVVAR;
 	    }
-	  break;
-	}
-    }
-  if (show_usage)
-    {
-      printf("usage: %s [OPTIONS]\n\n", argv[0]);
-      puts(options_summary);
-      return NULL;
-    }
-  if (show_version)
-    {
-      puts(version_summary);
-      return NULL;
-    }
-
-  return app;
-}
+	  else if (longopts[longindex].name == OPT_TRACE_STARTUP)
+	    {
+	      app->startup.trace = SDL_TRUE;
+	    }
+	  else if (longopts[longindex].name == OPT_TRACE)
+	    {
+	      app->trace_path = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_SYNTH)
+	    {
+	      app->synth.count = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_SYNTH_RATE)
+	    {
+	      app->synth.rate = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_SYNTH_PATTERN)
+	    {
+	      int i;
+	      for (i = 0; i < MAX_SYNTH_PATTERNS; i++)
+		{
+		  if (0 == SDL_strcmp(optarg, synth_pattern_names[i]))
+		    break;
+		}
+	      if (i == MAX_SYNTH_PATTERNS)
+		{
+		  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unknown synth pattern '%s'.", optarg);
+		  show_usage = 1;
+		}
+	      else
+		{
+		  app->synth.pattern = i;
+		}
+	    }
+	  else if (longopts[longindex].name == OPT_SYNTH_GAMEPAD)
+	    {
+	      app->synth.gamepad = SDL_TRUE;
+	    }
+	  else if (longopts[longindex].name == OPT_COMPOSITE)
+	    {
+	      int i;
+	      for (i = 0; i < MAX_COMPOSITE_MODES; i++)
+		{
+		  if (0 == SDL_strcmp(optarg, composite_mode_names[i]))
+		    break;
+		}
+	      if (i == MAX_COMPOSITE_MODES)
+		{
+		  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unknown composite mode '%s'.", optarg);
+		  show_usage = 1;
+		}
+	      else
+		{
+		  app->composite_mode = i;
+		}
+	    }
+	  else if (longopts[longindex].name == OPT_RASTER_THREADS)
+	    {
+	      app->raster.nthreads = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_RASTER_BUDGET)
+	    {
+	      app->raster_budget_ms = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_FEED)
+	    {
+	      app->feed.name = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_SERVE)
+	    {
+	      app->server.path = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_RECORD)
+	    {
+	      app->capture.path = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_RECORD_DIRECT)
+	    {
+	      app->capture.direct = SDL_TRUE;
+	    }
+	  else if (longopts[longindex].name == OPT_SEGMENT_SIZE)
+	    {
+	      int mb = SDL_atoi(optarg);
+	      app->capture.segment_bytes = (mb > 0) ? (Uint64)mb << 20 : 0;
+	    }
+	  else if (longopts[longindex].name == OPT_SEGMENT_TIME)
+	    {
+	      app->capture.segment_s = SDL_max(0, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_SEGMENT_KEEP)
+	    {
+	      app->capture.keep = SDL_min(SDL_max(0, SDL_atoi(optarg)), CAPTURE_SEGMENT_RING / 2);
+	    }
+	  else if (longopts[longindex].name == OPT_TRIGGER_WINDOW)
+	    {
+	      app->capture.window_s = SDL_max(0, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_METRICS_FILE)
+	    {
+	      app->metrics.path = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_METRICS_PORT)
+	    {
+	      app->metrics.port = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_METRICS_INTERVAL)
+	    {
+	      app->metrics.interval_s = SDL_max(1, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_DIFF)
+	    {
+	      app->diff.patha = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_DIFF_TOLERANCE)
+	    {
+	      app->diff.tolerance = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_DIFF_DRIFT)
+	    {
+	      app->diff.drift_ms = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_ANALYZE)
+	    {
+	      app->analyze_path = optarg;
+	    }
+	  else if (longopts[longindex].name == OPT_DEADBAND)
+	    {
+	      if (SDL_strcmp(optarg, "auto") == 0)
+		app->deadband = DEADBAND_AUTO;
+	      else
+		app->deadband = SDL_atoi(optarg);
+	      if (app->deadband < DEADBAND_AUTO)
+		app->deadband = 0;
+	    }
+	  else if (longopts[longindex].name == OPT_SENSORS)
+	    {
+	      if (SDL_strcmp(optarg, "all") == 0)
+		app->sensors_mode = SENSORS_ALL;
+	      else if (SDL_strcmp(optarg, "controller") == 0)
+		app->sensors_mode = SENSORS_CONTROLLER;
+	      else if (SDL_strcmp(optarg, "off") == 0)
+		app->sensors_mode = SENSORS_OFF;
+	      else
+		show_usage = 1;
+	    }
+	  else if (longopts[longindex].name == OPT_SENSOR_WINDOW)
+	    {
+	      app->sensor_window_ms = SDL_max(0, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_SENSOR_DECIMATE)
+	    {
+	      app->sensor_decimate = SDL_max(0, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_TOUCH_DECIMATE)
+	    {
+	      app->touch_decimate = SDL_max(1, SDL_atoi(optarg));
+	    }
+	  else if (longopts[longindex].name == OPT_RESOURCE_LOG)
+	    {
+	      app->resource_log_s = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_CHECK_ALLOC)
+	    {
+	      app->checkalloc.seconds = SDL_atoi(optarg);
+	    }
+	  else if (longopts[longindex].name == OPT_BENCH_FORMAT)
+	    {
+	      app->bench_format = SDL_atoi(optarg);
+	    }
+	  break;
+	}
+    }
+  if (app->diff.patha)
+    {
+      /* second capture is the first non-option argument. */
+      if (optind < argc)
+	app->diff.pathb = argv[optind];
+      else
+	show_usage = 1;
+    }
+  if (show_usage)
+    {
+      printf("usage: %s [OPTIONS]\n\n", argv[0]);
+      fputs(options_summary, stdout);
+      puts(options_summary_events);
+      return NULL;
+    }
+  if (show_version)
+    {
+      puts(version_summary);
+      return NULL;
+    }
+
+  return app;
+}
 #else
 /* No GNU getopt_long. */
 
@@ -570,944 +2192,6801 @@ app_t * app_parse_argv (app_t * app, int argc, char ** argv)
   (void)argv;
   return app;
 }
-#endif
+#endif
+
+
+/* Update axis statistics with new value; returns whether it moved beyond the deadband and should be logged.
+   deadband is in axis units, 0 to log everything, or DEADBAND_AUTO for a multiple of the measured jitter.
+*/
+SDL_bool axisnoise_update (axisnoise_t * noise, Sint16 value, Uint32 timestamp, int deadband)
+{
+  if (! noise->seen)
+    {
+      noise->seen = SDL_TRUE;
+      noise->value = noise->shown = noise->anchor = value;
+      noise->mean = value * 256;
+      noise->second = noise->still = timestamp;
+      noise->events++;
+      return SDL_TRUE;
+    }
+  int delta = value - noise->value;
+  if (delta < 0)
+    delta = -delta;
+  noise->value = value;
+  noise->events++;
+  if (timestamp - noise->second >= 1000)
+    {
+      noise->smallrate = (timestamp - noise->second < 2000) ? noise->small : 0;
+      noise->small = 0;
+      noise->second = timestamp;
+    }
+  if (delta <= NOISE_SMALL)
+    {
+      noise->small++;
+      noise->jitter += (delta * 256 - noise->jitter) / 32;
+    }
+
+  int autoband = DEADBAND_AUTO_FACTOR * noise->jitter / 256 + 1;
+  if (autoband > DEADBAND_AUTO_MAX)
+    autoband = DEADBAND_AUTO_MAX;
+  /* a slow sweep is not rest: only average once the axis has settled. */
+  if ((value - noise->anchor > autoband) || (noise->anchor - value > autoband))
+    {
+      noise->anchor = value;
+      noise->still = timestamp;
+    }
+  else if ((delta <= NOISE_SMALL) && (timestamp - noise->still >= NOISE_SETTLE))
+    noise->mean += (value * 256 - noise->mean) / 64;
+
+  int band = (deadband == DEADBAND_AUTO) ? autoband : deadband;
+  int moved = value - noise->shown;
+  if (moved < 0)
+    moved = -moved;
+  /* always show the ends of travel, so a full deflection is never left one step short. */
+  if ((moved > band) || (value == 32767) || (value == -32768))
+    {
+      noise->shown = value;
+      return SDL_TRUE;
+    }
+  noise->quiet++;
+  return SDL_FALSE;
+}
+
+/* Log noise statistics of device's axes. */
+void gamedev_noise_report (const gamedev_t * dev)
+{
+  static const char * kindnames[MAX_NOISE_KINDS] = { "axis", "controller axis" };
+  for (int kind = 0; kind < MAX_NOISE_KINDS; kind++)
+    {
+      for (int axis = 0; axis < NOISE_MAX_AXES; axis++)
+	{
+	  const axisnoise_t * noise = dev->noise[kind] + axis;
+	  if (! noise->events)
+	    continue;
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "noise: #%d %s %d: rest %.1f, jitter %.1f, %ld small changes/s, %ld of %ld changes not logged",
+		      dev->instid, kindnames[kind], axis, noise->mean / 256.0, noise->jitter / 256.0,
+		      noise->smallrate, noise->quiet, noise->events);
+	}
+    }
+}
+
+
+/* Hash slot for instance id; Fibonacci hashing spreads the sequential ids SDL hands out. */
+static
+int devreg_hash (const devreg_t * devreg, SDL_JoystickID instid)
+{
+  return (int)(((Uint32)instid * 2654435769u) >> 16) & (devreg->alloc - 1);
+}
+
+static
+int devreg_grow (devreg_t * devreg)
+{
+  int oldalloc = devreg->alloc;
+  gamedev_t ** oldslots = devreg->slots;
+  int newalloc = oldalloc ? (oldalloc * 2) : DEVREG_INITIAL_SLOTS;
+  gamedev_t ** newslots = SDL_calloc(newalloc, sizeof(gamedev_t*));
+  if (! newslots)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in devreg.grow");
+      abort();
+    }
+  devreg->alloc = newalloc;
+  devreg->slots = newslots;
+  for (int i = 0; i < oldalloc; i++)
+    {
+      gamedev_t * dev = oldslots[i];
+      if (!dev) continue;
+      int h = devreg_hash(devreg, dev->instid);
+      while (newslots[h])
+	h = (h + 1) & (newalloc - 1);
+      newslots[h] = dev;
+    }
+  SDL_free(oldslots);
+  return newalloc;
+}
+
+/* Find device by joystick instance id, or NULL if not registered. */
+gamedev_t * devreg_find (devreg_t * devreg, SDL_JoystickID instid)
+{
+  if (devreg->alloc == 0)
+    return NULL;
+  int h = devreg_hash(devreg, instid);
+  gamedev_t * dev;
+  while ((dev = devreg->slots[h]))
+    {
+      if (dev->instid == instid)
+	return dev;
+      h = (h + 1) & (devreg->alloc - 1);
+    }
+  return NULL;
+}
+
+/* Find device by instance id, registering a blank entry if not yet known. */
+gamedev_t * devreg_attach (devreg_t * devreg, SDL_JoystickID instid)
+{
+  gamedev_t * dev = devreg_find(devreg, instid);
+  if (dev)
+    return dev;
+  /* keep load factor under 3/4. */
+  if ((devreg->len + 1) * 4 > devreg->alloc * 3)
+    devreg_grow(devreg);
+  dev = SDL_calloc(1, sizeof(gamedev_t));
+  if (! dev)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in devreg.attach");
+      abort();
+    }
+  dev->instid = instid;
+  int h = devreg_hash(devreg, instid);
+  while (devreg->slots[h])
+    h = (h + 1) & (devreg->alloc - 1);
+  devreg->slots[h] = dev;
+  devreg->len++;
+  return dev;
+}
+
+/* Unregister and free device entry; caller closes handles beforehand. */
+int devreg_detach (devreg_t * devreg, SDL_JoystickID instid)
+{
+  if (devreg->alloc == 0)
+    return -1;
+  const int mask = devreg->alloc - 1;
+  int h = devreg_hash(devreg, instid);
+  gamedev_t * dev;
+  while ((dev = devreg->slots[h]) && (dev->instid != instid))
+    h = (h + 1) & mask;
+  if (!dev)
+    return -1;
+  gamedev_noise_report(dev);
+  SDL_free(dev->mapping);
+  SDL_free(dev);
+  devreg->slots[h] = NULL;
+  devreg->len--;
+
+  /* backward-shift following entries of the probe run, so lookups need no tombstones. */
+  int hole = h;
+  for (h = (h + 1) & mask; (dev = devreg->slots[h]); h = (h + 1) & mask)
+    {
+      int home = devreg_hash(devreg, dev->instid);
+      /* entry may fill the hole only if its home slot is not cyclically within (hole, h]. */
+      if (((h - home) & mask) >= ((h - hole) & mask))
+	{
+	  devreg->slots[hole] = dev;
+	  devreg->slots[h] = NULL;
+	  hole = h;
+	}
+    }
+  return 0;
+}
+
+/* Close all device handles and release registry. */
+devreg_t * devreg_destroy (devreg_t * devreg)
+{
+  for (int i = 0; i < devreg->alloc; i++)
+    {
+      gamedev_t * dev = devreg->slots[i];
+      if (!dev) continue;
+      if (dev->gc) SDL_GameControllerClose(dev->gc);
+      if (dev->js) SDL_JoystickClose(dev->js);
+      gamedev_noise_report(dev);
+      SDL_free(dev->mapping);
+      SDL_free(dev);
+    }
+  SDL_free(devreg->slots);
+  devreg->slots = NULL;
+  devreg->alloc = 0;
+  devreg->len = 0;
+  return devreg;
+}
+
+/* Fill in device metadata from system device index (before opening). */
+static
+void gamedev_describe (gamedev_t * dev, int devnum)
+{
+  SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(devnum);
+  SDL_JoystickGetGUIDString(guid, dev->guid, sizeof(dev->guid));
+  SDL_snprintf(dev->name, sizeof(dev->name), "%s", SDL_JoystickNameForIndex(devnum));
+  SDL_free(dev->mapping);
+  dev->mapping = SDL_GameControllerMappingForGUID(guid);
+}
+
+
+
+/* Synthetic joystick load generator.
+   Virtual joysticks are attached (and opened) on the main thread; the generator thread only sets their control values, which SDL picks up on the next event pump.
+*/
+#if SDL_VERSION_ATLEAST(2,0,14)
+#define HAVE_VIRTUAL_JOYSTICK 1
+#endif
+
+#ifdef HAVE_VIRTUAL_JOYSTICK
+/* xorshift32; cheap noise for generator thread. */
+static
+Uint32 synth_rand (Uint32 * state)
+{
+  Uint32 x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+/* Triangle wave over full Sint16 range; 'period' steps per cycle. */
+static
+Sint16 synth_triangle (Uint32 step, Uint32 period)
+{
+  Uint32 half = period / 2;
+  if (half == 0) half = 1;
+  Uint32 pos = step % (half * 2);
+  long v = (pos < half) ? (long)pos : (long)(half * 2 - pos);
+  return (Sint16)(-32768 + v * 65535 / half);
+}
+
+/* Advance all virtual joysticks by one generator step. */
+static
+void synth_step (synth_t * synth, Uint32 step, Uint32 * rng)
+{
+  static const Uint8 hatdirs[9] = {
+      SDL_HAT_UP, SDL_HAT_UP|SDL_HAT_RIGHT, SDL_HAT_RIGHT, SDL_HAT_RIGHT|SDL_HAT_DOWN,
+      SDL_HAT_DOWN, SDL_HAT_DOWN|SDL_HAT_LEFT, SDL_HAT_LEFT, SDL_HAT_LEFT|SDL_HAT_UP,
+      SDL_HAT_CENTERED,
+  };
+  const Uint32 rate = synth->rate;
+  for (int i = 0; i < synth->nattached; i++)
+    {
+      SDL_Joystick * js = synth->js[i];
+      if (!js) continue;
+      Uint32 t = step + (Uint32)i * 7;  /* stagger devices. */
+      int a, b;
+      switch (synth->pattern)
+	{
+	case SYNTH_NOISE:
+	  for (a = 0; a < SYNTH_NAXES; a++)
+	    SDL_JoystickSetVirtualAxis(js, a, (Sint16)synth_rand(rng));
+	  for (b = 0; b < SYNTH_NBUTTONS; b++)
+	    {
+	      /* flip about one button in eight. */
+	      if ((synth_rand(rng) & 7) == 0)
+		SDL_JoystickSetVirtualButton(js, b, synth_rand(rng) & 1);
+	    }
+	  SDL_JoystickSetVirtualHat(js, 0, hatdirs[synth_rand(rng) % 9]);
+	  break;
+	case SYNTH_MASH:
+	  for (a = 0; a < SYNTH_NAXES; a++)
+	    SDL_JoystickSetVirtualAxis(js, a, (t & 1) ? 32767 : -32768);
+	  for (b = 0; b < SYNTH_NBUTTONS; b++)
+	    SDL_JoystickSetVirtualButton(js, b, (t & 1) ? SDL_PRESSED : SDL_RELEASED);
+	  SDL_JoystickSetVirtualHat(js, 0, (t & 1) ? SDL_HAT_UP : SDL_HAT_CENTERED);
+	  break;
+	case SYNTH_SWEEP:
+	default:
+	  /* two-second sweeps, phase-shifted per axis. */
+	  for (a = 0; a < SYNTH_NAXES; a++)
+	    SDL_JoystickSetVirtualAxis(js, a, synth_triangle(t + a * rate / 3, rate * 2));
+	  /* one button held at a time, ten per second. */
+	  for (b = 0; b < SYNTH_NBUTTONS; b++)
+	    SDL_JoystickSetVirtualButton(js, b, (b == (int)((t * 10 / rate) % SYNTH_NBUTTONS)));
+	  SDL_JoystickSetVirtualHat(js, 0, hatdirs[(t * 4 / rate) % 8]);
+	  break;
+	}
+    }
+}
+
+/* Generator thread: step at synth->rate, catching up in bulk when woken late. */
+static
+int synth_thread (void * data)
+{
+  synth_t * synth = (synth_t*)data;
+  Uint32 rng = 0x2545F491u;
+  Uint32 step = 0;
+  const Uint64 freq = SDL_GetPerformanceFrequency();
+  const Uint64 t0 = SDL_GetPerformanceCounter();
+
+  while (SDL_AtomicGet(&synth->alive))
+    {
+      Uint64 due = (SDL_GetPerformanceCounter() - t0) * synth->rate / freq;
+      while (step < due)
+	{
+	  synth_step(synth, step, &rng);
+	  step++;
+	}
+      Uint32 wait_ms = 1000 / synth->rate;
+      SDL_Delay(wait_ms ? wait_ms : 1);
+    }
+  return 0;
+}
+
+/* Mapping string presenting virtual joystick as XInput-style controller. */
+static
+int synth_mapping (char * buf, int buflen, const char * guid)
+{
+  return SDL_snprintf(buf, buflen, "%s,%s Synth,"
+		      "a:b0,b:b1,x:b2,y:b3,back:b4,guide:b5,start:b6,"
+		      "leftstick:b7,rightstick:b8,leftshoulder:b9,rightshoulder:b10,"
+		      "dpup:h0.1,dpright:h0.2,dpdown:h0.4,dpleft:h0.8,"
+		      "leftx:a0,lefty:a1,rightx:a2,righty:a3,lefttrigger:a4,righttrigger:a5,",
+		      guid, APP_TITLE);
+}
+
+/* Attach virtual joysticks and start generator thread. */
+int synth_start (synth_t * synth)
+{
+  if (synth->count <= 0)
+    return 0;
+  if (synth->rate <= 0)
+    synth->rate = DEFAULT_SYNTH_RATE;
+  synth->instids = SDL_calloc(synth->count, sizeof(SDL_JoystickID));
+  synth->js = SDL_calloc(synth->count, sizeof(SDL_Joystick*));
+  if (!synth->instids || !synth->js)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in synth.start");
+      abort();
+    }
+
+  SDL_JoystickType jstype = synth->gamepad ? SDL_JOYSTICK_TYPE_GAMECONTROLLER : SDL_JOYSTICK_TYPE_UNKNOWN;
+  for (int i = 0; i < synth->count; i++)
+    {
+      int devnum = SDL_JoystickAttachVirtual(jstype, SYNTH_NAXES, SYNTH_NBUTTONS, SYNTH_NHATS);
+      if (devnum < 0)
+	{
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to attach virtual joystick: %s", SDL_GetError());
+	  break;
+	}
+      if (synth->gamepad)
+	{
+	  char guid[33];
+	  char mapping[512];
+	  SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(devnum), guid, sizeof(guid));
+	  synth_mapping(mapping, sizeof(mapping), guid);
+	  SDL_GameControllerAddMapping(mapping);
+	}
+      synth->js[i] = SDL_JoystickOpen(devnum);
+      synth->instids[i] = SDL_JoystickGetDeviceInstanceID(devnum);
+      synth->nattached++;
+    }
+
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Attached %d virtual joystick(s), %s at %d Hz.", synth->nattached, synth_pattern_names[synth->pattern], synth->rate);
+  if (synth->nattached > 0)
+    {
+      SDL_AtomicSet(&synth->alive, 1);
+      synth->thread = SDL_CreateThread(synth_thread, "synth", synth);
+    }
+  return synth->nattached;
+}
+
+/* Stop generator thread and detach virtual joysticks. */
+int synth_stop (synth_t * synth)
+{
+  if (synth->thread)
+    {
+      SDL_AtomicSet(&synth->alive, 0);
+      SDL_WaitThread(synth->thread, NULL);
+      synth->thread = NULL;
+    }
+  for (int i = 0; i < synth->nattached; i++)
+    {
+      if (synth->js[i])
+	SDL_JoystickClose(synth->js[i]);
+      /* device indices shift as devices come and go; detach by instance id. */
+      for (int devnum = 0; devnum < SDL_NumJoysticks(); devnum++)
+	{
+	  if (SDL_JoystickGetDeviceInstanceID(devnum) == synth->instids[i])
+	    {
+	      SDL_JoystickDetachVirtual(devnum);
+	      break;
+	    }
+	}
+    }
+  SDL_free(synth->js);
+  SDL_free(synth->instids);
+  synth->js = NULL;
+  synth->instids = NULL;
+  synth->nattached = 0;
+  return 0;
+}
+#else
+/* No virtual joystick support in this SDL. */
+int synth_start (synth_t * synth)
+{
+  if (synth->count > 0)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Virtual joysticks require SDL 2.0.14 or later.");
+  return 0;
+}
+
+int synth_stop (synth_t * synth)
+{
+  (void)synth;
+  return 0;
+}
+#endif /* HAVE_VIRTUAL_JOYSTICK */
+
+
+
+typedef char evfeed_record_size_check[(sizeof(evfeed_record_t) == 64) ? 1 : -1];
+typedef char evfeed_header_size_check[(sizeof(evfeed_header_t) == 128) ? 1 : -1];
+
+/* Display category of an event type, as the columns sort them. */
+static
+int event_category (Uint32 type)
+{
+  if ((SDL_KEYDOWN <= type) && (type < SDL_MOUSEMOTION))
+    return CAT_KEYB;
+  if ((SDL_MOUSEMOTION <= type) && (type < SDL_JOYAXISMOTION))
+    return CAT_MOUSE;
+  if ((SDL_JOYAXISMOTION <= type) && (type < SDL_CONTROLLERAXISMOTION))
+    return CAT_JOY;
+  if ((SDL_CONTROLLERAXISMOTION <= type) && (type < SDL_FINGERDOWN))
+    return CAT_CONTROLLER;
+  if ((SDL_FINGERDOWN <= type) && (type <= SDL_FINGERMOTION))
+    return CAT_MOUSE;
+  return CAT_MISC;
+}
+
+/* Short name of event type, or NULL if not one listed here. */
+static
+const char * event_type_name (Uint32 type)
+{
+  switch (type)
+    {
+    case SDL_QUIT: return "QUIT";
+    case SDL_WINDOWEVENT: return "WINDOWEVENT";
+    case SDL_SYSWMEVENT: return "SYSWMEVENT";
+    case SDL_KEYDOWN: return "KEYDOWN";
+    case SDL_KEYUP: return "KEYUP";
+    case SDL_TEXTEDITING: return "TEXTEDITING";
+    case SDL_TEXTINPUT: return "TEXTINPUT";
+    case SDL_MOUSEMOTION: return "MOUSEMOTION";
+    case SDL_MOUSEBUTTONDOWN: return "MOUSEBUTTONDOWN";
+    case SDL_MOUSEBUTTONUP: return "MOUSEBUTTONUP";
+    case SDL_MOUSEWHEEL: return "MOUSEWHEEL";
+    case SDL_JOYAXISMOTION: return "JOYAXISMOTION";
+    case SDL_JOYBALLMOTION: return "JOYBALLMOTION";
+    case SDL_JOYHATMOTION: return "JOYHATMOTION";
+    case SDL_JOYBUTTONDOWN: return "JOYBUTTONDOWN";
+    case SDL_JOYBUTTONUP: return "JOYBUTTONUP";
+    case SDL_JOYDEVICEADDED: return "JOYDEVICEADDED";
+    case SDL_JOYDEVICEREMOVED: return "JOYDEVICEREMOVED";
+    case SDL_CONTROLLERAXISMOTION: return "CONTROLLERAXISMOTION";
+    case SDL_CONTROLLERBUTTONDOWN: return "CONTROLLERBUTTONDOWN";
+    case SDL_CONTROLLERBUTTONUP: return "CONTROLLERBUTTONUP";
+    case SDL_CONTROLLERDEVICEADDED: return "CONTROLLERDEVICEADDED";
+    case SDL_CONTROLLERDEVICEREMOVED: return "CONTROLLERDEVICEREMOVED";
+    case SDL_CONTROLLERDEVICEREMAPPED: return "CONTROLLERDEVICEREMAPPED";
+#ifdef HAVE_CONTROLLER_SENSORS
+    case SDL_CONTROLLERTOUCHPADDOWN: return "CONTROLLERTOUCHPADDOWN";
+    case SDL_CONTROLLERTOUCHPADMOTION: return "CONTROLLERTOUCHPADMOTION";
+    case SDL_CONTROLLERTOUCHPADUP: return "CONTROLLERTOUCHPADUP";
+    case SDL_CONTROLLERSENSORUPDATE: return "CONTROLLERSENSORUPDATE";
+#endif
+    case SDL_FINGERDOWN: return "FINGERDOWN";
+    case SDL_FINGERUP: return "FINGERUP";
+    case SDL_FINGERMOTION: return "FINGERMOTION";
+    case SDL_DROPFILE: return "DROPFILE";
+#ifdef HAVE_SENSORS
+    case SDL_SENSORUPDATE: return "SENSORUPDATE";
+#endif
+    case SDL_USEREVENT: return "USEREVENT";
+    default: return NULL;
+    }
+}
+
+/* Fill record from event; see evfeed.h for fields by type. */
+static
+void feed_record (evfeed_record_t * rec, const SDL_Event * evt)
+{
+  rec->type = evt->type;
+  rec->timestamp = evt->common.timestamp;
+  rec->which = -1;
+  rec->index = rec->value = 0;
+  rec->x = rec->y = rec->xrel = rec->yrel = 0;
+  switch (evt->type)
+    {
+    case SDL_JOYAXISMOTION:
+      rec->which = evt->jaxis.which;
+      rec->index = evt->jaxis.axis;
+      rec->value = evt->jaxis.value;
+      break;
+    case SDL_CONTROLLERAXISMOTION:
+      rec->which = evt->caxis.which;
+      rec->index = evt->caxis.axis;
+      rec->value = evt->caxis.value;
+      break;
+    case SDL_JOYHATMOTION:
+      rec->which = evt->jhat.which;
+      rec->index = evt->jhat.hat;
+      rec->value = evt->jhat.value;
+      break;
+    case SDL_JOYBALLMOTION:
+      rec->which = evt->jball.which;
+      rec->index = evt->jball.ball;
+      rec->xrel = evt->jball.xrel;
+      rec->yrel = evt->jball.yrel;
+      break;
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+      rec->which = evt->jbutton.which;
+      rec->index = evt->jbutton.button;
+      rec->value = evt->jbutton.state;
+      break;
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+      rec->which = evt->cbutton.which;
+      rec->index = evt->cbutton.button;
+      rec->value = evt->cbutton.state;
+      break;
+    case SDL_JOYDEVICEADDED:
+    case SDL_JOYDEVICEREMOVED:
+      rec->which = evt->jdevice.which;
+      break;
+    case SDL_CONTROLLERDEVICEADDED:
+    case SDL_CONTROLLERDEVICEREMOVED:
+    case SDL_CONTROLLERDEVICEREMAPPED:
+      rec->which = evt->cdevice.which;
+      break;
+    case SDL_MOUSEMOTION:
+      rec->which = evt->motion.which;
+      rec->value = evt->motion.state;
+      rec->x = evt->motion.x;
+      rec->y = evt->motion.y;
+      rec->xrel = evt->motion.xrel;
+      rec->yrel = evt->motion.yrel;
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+      rec->which = evt->button.which;
+      rec->index = evt->button.button;
+      rec->value = evt->button.state;
+      rec->x = evt->button.x;
+      rec->y = evt->button.y;
+      break;
+    case SDL_MOUSEWHEEL:
+      rec->which = evt->wheel.which;
+      rec->x = evt->wheel.x;
+      rec->y = evt->wheel.y;
+      break;
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+      rec->which = evt->key.windowID;
+      rec->index = evt->key.keysym.scancode;
+      rec->value = evt->key.keysym.sym;
+      rec->x = evt->key.keysym.mod;
+      rec->y = evt->key.repeat;
+      break;
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+      rec->which = (Sint32)evt->tfinger.touchId;
+      rec->index = (Sint32)evt->tfinger.fingerId;
+      rec->value = evt->tfinger.pressure * 65535;
+      rec->x = evt->tfinger.x * 65535;
+      rec->y = evt->tfinger.y * 65535;
+      rec->xrel = evt->tfinger.dx * 65535;
+      rec->yrel = evt->tfinger.dy * 65535;
+      break;
+#ifdef HAVE_CONTROLLER_SENSORS
+    case SDL_CONTROLLERTOUCHPADDOWN:
+    case SDL_CONTROLLERTOUCHPADMOTION:
+    case SDL_CONTROLLERTOUCHPADUP:
+      rec->which = evt->ctouchpad.which;
+      rec->index = evt->ctouchpad.touchpad;
+      rec->value = evt->ctouchpad.finger;
+      rec->x = evt->ctouchpad.x * 65535;
+      rec->y = evt->ctouchpad.y * 65535;
+      rec->xrel = evt->ctouchpad.pressure * 65535;
+      break;
+    case SDL_CONTROLLERSENSORUPDATE:
+      rec->which = evt->csensor.which;
+      rec->index = evt->csensor.sensor;
+      rec->x = evt->csensor.data[0] * 1000;
+      rec->y = evt->csensor.data[1] * 1000;
+      rec->value = evt->csensor.data[2] * 1000;
+      break;
+#endif
+#ifdef HAVE_SENSORS
+    case SDL_SENSORUPDATE:
+      rec->which = evt->sensor.which;
+      rec->x = evt->sensor.data[0] * 1000;
+      rec->y = evt->sensor.data[1] * 1000;
+      rec->value = evt->sensor.data[2] * 1000;
+      break;
+#endif
+    default:
+      break;
+    }
+}
+
+#ifdef HAVE_SHM_FEED
+/* Create (or take over) shared-memory object and publish an empty ring. */
+int feed_open (feed_t * feed)
+{
+  if (! feed->name)
+    return 0;
+  feed->size = sizeof(evfeed_header_t) + FEED_RECORDS * sizeof(evfeed_record_t);
+  feed->fd = shm_open(feed->name, O_CREAT | O_RDWR, 0644);
+  if ((feed->fd < 0) || (ftruncate(feed->fd, feed->size) < 0))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to create event feed '%s'.", feed->name);
+      if (feed->fd >= 0)
+	close(feed->fd);
+      feed->fd = -1;
+      feed->name = NULL;
+      return -1;
+    }
+  void * base = mmap(NULL, feed->size, PROT_READ | PROT_WRITE, MAP_SHARED, feed->fd, 0);
+  if (base == MAP_FAILED)
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to map event feed '%s'.", feed->name);
+      close(feed->fd);
+      shm_unlink(feed->name);
+      feed->fd = -1;
+      feed->name = NULL;
+      return -1;
+    }
+  feed->hdr = base;
+  feed->recs = (evfeed_record_t*)(feed->hdr + 1);
+  feed->seq = 0;
+  feed->frequency = SDL_GetPerformanceFrequency();
+
+  /* left over by an earlier run: clear, then validate header last. */
+  feed->hdr->magic = 0;
+  SDL_MemoryBarrierRelease();
+  SDL_memset(base, 0, feed->size);
+  feed->hdr->version = EVFEED_VERSION;
+  feed->hdr->recsize = sizeof(evfeed_record_t);
+  feed->hdr->nrecords = FEED_RECORDS;
+  feed->hdr->pid = getpid();
+  feed->hdr->frequency = feed->frequency;
+  SDL_MemoryBarrierRelease();
+  feed->hdr->magic = EVFEED_MAGIC;
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Publishing events to shared memory '%s'.", feed->name);
+  return 0;
+}
+
+/* Append batch of events to ring; readers see the new head once, after the whole batch. */
+int feed_publish (feed_t * feed, const SDL_Event * evts, int n)
+{
+  if (! feed->hdr)
+    return 0;
+  Uint64 counter = SDL_GetPerformanceCounter();
+  for (int i = 0; i < n; i++)
+    {
+      Uint64 seq = ++feed->seq;
+      evfeed_record_t * rec = feed->recs + ((seq - 1) & (FEED_RECORDS - 1));
+      rec->seq = 0;
+      SDL_MemoryBarrierRelease();
+      rec->counter = counter;
+      feed_record(rec, evts + i);
+      SDL_MemoryBarrierRelease();
+      rec->seq = seq;
+    }
+  SDL_MemoryBarrierRelease();
+  feed->hdr->head = feed->seq;
+  return n;
+}
+
+/* Unmap and remove shared-memory object; readers keep their mappings until they unmap. */
+int feed_close (feed_t * feed)
+{
+  if (! feed->hdr)
+    return 0;
+  munmap(feed->hdr, feed->size);
+  close(feed->fd);
+  shm_unlink(feed->name);
+  feed->hdr = NULL;
+  feed->recs = NULL;
+  feed->fd = -1;
+  return 0;
+}
+#else
+/* No POSIX shared memory here. */
+int feed_open (feed_t * feed)
+{
+  if (feed->name)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Event feed requires POSIX shared memory.");
+  feed->name = NULL;
+  return 0;
+}
+
+int feed_publish (feed_t * feed, const SDL_Event * evts, int n)
+{
+  (void)feed;
+  (void)evts;
+  return n;
+}
+
+int feed_close (feed_t * feed)
+{
+  (void)feed;
+  return 0;
+}
+#endif /* HAVE_SHM_FEED */
+
+
+
+#ifdef HAVE_EVSERVER
+/* epoll data for the two non-subscriber descriptors; subscribers use their slot index. */
+#define SERVE_TAG_LISTEN SERVE_MAX_CLIENTS
+#define SERVE_TAG_WAKE (SERVE_MAX_CLIENTS + 1)
+
+/* Category by label, with or without the "SDL_" prefix, any case. */
+static
+int server_category_named (const char * name)
+{
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    {
+      const char * label = catlabel[catnum];
+      if (SDL_strcasecmp(name, label) == 0)
+	return catnum;
+      if ((SDL_strncmp(label, "SDL_", 4) == 0) && (SDL_strcasecmp(name, label + 4) == 0))
+	return catnum;
+    }
+  return -1;
+}
+
+/* Close subscriber connection and free its slot. */
+static
+void server_drop_client (server_t * server, subscriber_t * client)
+{
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "serve: subscriber %d left; %ld events sent, %ld lost.",
+	      (int)(client - server->clients), client->sent, client->lost);
+  epoll_ctl(server->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+  close(client->fd);
+  SDL_free(client->out);
+  SDL_memset(client, 0, sizeof(*client));
+  client->fd = -1;
+}
+
+/* Parse subscription request line; returns NULL if valid, else the offending token.
+   Tokens: json | binary, cat=LABEL[,...], which=ID[,...], type=N[,...], policy=drop|close.
+*/
+static
+const char * server_parse_request (subscriber_t * client, char * line)
+{
+  char * save = NULL;
+  for (char * tok = strtok_r(line, " \t\r", &save); tok; tok = strtok_r(NULL, " \t\r", &save))
+    {
+      char * val = SDL_strchr(tok, '=');
+      char * save2 = NULL;
+      if (SDL_strcmp(tok, "json") == 0)
+	client->binary = SDL_FALSE;
+      else if (SDL_strcmp(tok, "binary") == 0)
+	client->binary = SDL_TRUE;
+      else if (! val)
+	return tok;
+      else if (SDL_strncmp(tok, "policy=", 7) == 0)
+	{
+	  if (SDL_strcmp(val + 1, "drop") == 0)
+	    client->close_on_lag = SDL_FALSE;
+	  else if (SDL_strcmp(val + 1, "close") == 0)
+	    client->close_on_lag = SDL_TRUE;
+	  else
+	    return tok;
+	}
+      else if (SDL_strncmp(tok, "cat=", 4) == 0)
+	{
+	  for (char * item = strtok_r(val + 1, ",", &save2); item; item = strtok_r(NULL, ",", &save2))
+	    {
+	      int catnum = server_category_named(item);
+	      if (catnum < 0)
+		return tok;
+	      client->cats |= 1u << catnum;
+	    }
+	}
+      else if (SDL_strncmp(tok, "which=", 6) == 0)
+	{
+	  for (char * item = strtok_r(val + 1, ",", &save2); item; item = strtok_r(NULL, ",", &save2))
+	    {
+	      if (client->nwhich >= SERVE_MAX_FILTER)
+		return tok;
+	      client->which[client->nwhich++] = SDL_strtol(item, NULL, 0);
+	    }
+	}
+      else if (SDL_strncmp(tok, "type=", 5) == 0)
+	{
+	  for (char * item = strtok_r(val + 1, ",", &save2); item; item = strtok_r(NULL, ",", &save2))
+	    {
+	      if (client->ntypes >= SERVE_MAX_FILTER)
+		return tok;
+	      client->types[client->ntypes++] = SDL_strtoul(item, NULL, 0);
+	    }
+	}
+      else
+	return tok;
+    }
+  return NULL;
+}
+
+/* Whether record passes subscriber's filter. */
+static
+SDL_bool server_match (const subscriber_t * client, const evfeed_record_t * rec)
+{
+  int i;
+  if (client->cats && !(client->cats & (1u << event_category(rec->type))))
+    return SDL_FALSE;
+  if (client->nwhich)
+    {
+      for (i = 0; (i < client->nwhich) && (client->which[i] != rec->which); i++)
+	;
+      if (i == client->nwhich)
+	return SDL_FALSE;
+    }
+  if (client->ntypes)
+    {
+      for (i = 0; (i < client->ntypes) && (client->types[i] != rec->type); i++)
+	;
+      if (i == client->ntypes)
+	return SDL_FALSE;
+    }
+  return SDL_TRUE;
+}
+
+/* Set epoll interest of subscriber: input until it half-closes, output while some is pending. */
+static
+void server_arm (server_t * server, subscriber_t * client)
+{
+  struct epoll_event ev = { 0, };
+  ev.events = (client->eof ? 0 : EPOLLIN) | (client->waiting ? EPOLLOUT : 0);
+  ev.data.u32 = client - server->clients;
+  epoll_ctl(server->epfd, EPOLL_CTL_MOD, client->fd, &ev);
+}
+
+/* Write out as much pending output as the socket takes; arms EPOLLOUT for the rest.
+   Returns -1 if the connection is gone.
+*/
+static
+int server_flush (server_t * server, subscriber_t * client)
+{
+  while (client->outpos < client->outlen)
+    {
+      ssize_t n = send(client->fd, client->out + client->outpos, client->outlen - client->outpos, MSG_NOSIGNAL);
+      if (n > 0)
+	{
+	  client->outpos += n;
+	  continue;
+	}
+      if ((n < 0) && (errno == EINTR))
+	continue;
+      if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+	break;
+      return -1;
+    }
+  if (client->outpos == client->outlen)
+    client->outpos = client->outlen = 0;
+
+  SDL_bool waiting = (client->outlen > 0);
+  if (waiting != client->waiting)
+    {
+      client->waiting = waiting;
+      server_arm(server, client);
+    }
+  return 0;
+}
+
+/* Queue bytes for subscriber; SDL_FALSE if its buffer has no room. */
+static
+SDL_bool server_put (subscriber_t * client, const void * data, int len)
+{
+  if (client->outlen + len > SERVE_CLIENT_BUFFER)
+    {
+      if (client->outlen - client->outpos + len > SERVE_CLIENT_BUFFER)
+	return SDL_FALSE;
+      SDL_memmove(client->out, client->out + client->outpos, client->outlen - client->outpos);
+      client->outlen -= client->outpos;
+      client->outpos = 0;
+    }
+  SDL_memcpy(client->out + client->outlen, data, len);
+  client->outlen += len;
+  return SDL_TRUE;
+}
+
+/* Encode lag notice (type 0, value = events lost) in subscriber's format. */
+static
+int server_encode_lag (const subscriber_t * client, char * buf, int buflen)
+{
+  if (client->binary)
+    {
+      evfeed_record_t rec;
+      SDL_memset(&rec, 0, sizeof(rec));
+      rec.which = -1;
+      rec.value = (client->lagged > SDL_MAX_SINT32) ? SDL_MAX_SINT32 : (Sint32)client->lagged;
+      SDL_memcpy(buf, &rec, sizeof(rec));
+      return sizeof(rec);
+    }
+  return SDL_snprintf(buf, buflen, "{\"lag\":%ld}\n", client->lagged);
+}
+
+/* Encode event record in subscriber's format. */
+static
+int server_encode (const subscriber_t * client, const evfeed_record_t * rec, char * buf, int buflen)
+{
+  if (client->binary)
+    {
+      SDL_memcpy(buf, rec, sizeof(*rec));
+      return sizeof(*rec);
+    }
+  return SDL_snprintf(buf, buflen,
+		      "{\"seq\":%llu,\"t\":%u,\"type\":%u,\"cat\":\"%s\",\"which\":%d,\"index\":%d,\"value\":%d,"
+		      "\"x\":%d,\"y\":%d,\"xrel\":%d,\"yrel\":%d}\n",
+		      (unsigned long long)rec->seq, rec->timestamp, rec->type, catlabel[event_category(rec->type)],
+		      rec->which, rec->index, rec->value, rec->x, rec->y, rec->xrel, rec->yrel);
+}
+
+/* Offer event to subscriber.  When its buffer is full the event is dropped (and later reported as lag),
+   or with policy=close the subscriber is disconnected.  Returns -1 if disconnected.
+*/
+static
+int server_offer (server_t * server, subscriber_t * client, const evfeed_record_t * rec)
+{
+  char buf[256];
+  if (client->lagged)
+    {
+      int n = server_encode_lag(client, buf, sizeof(buf));
+      if (server_put(client, buf, n))
+	client->lagged = 0;
+    }
+  if (! client->lagged)
+    {
+      int n = server_encode(client, rec, buf, sizeof(buf));
+      if (server_put(client, buf, n))
+	{
+	  client->sent++;
+	  return 0;
+	}
+    }
+  client->lagged++;
+  client->lost++;
+  if (client->close_on_lag)
+    {
+      server_drop_client(server, client);
+      return -1;
+    }
+  return 0;
+}
+
+/* Take queued records from main thread and hand them to matching subscribers. */
+static
+void server_drain (server_t * server)
+{
+  Uint32 tail = SDL_AtomicGet(&server->tail);
+  Uint32 head = SDL_AtomicGet(&server->head);
+  SDL_MemoryBarrierAcquire();  /* records up to head are complete. */
+  int dropped = SDL_AtomicGet(&server->dropped);
+  subscriber_t * client;
+  int i;
+
+  /* records the main thread could not queue are lost to everyone listening. */
+  if (dropped != server->dropseen)
+    {
+      for (i = 0, client = server->clients; i < SERVE_MAX_CLIENTS; i++, client++)
+	{
+	  if ((client->fd >= 0) && client->subscribed)
+	    {
+	      client->lagged += (Uint32)(dropped - server->dropseen);
+	      client->lost += (Uint32)(dropped - server->dropseen);
+	    }
+	}
+      server->dropseen = dropped;
+    }
+
+  for (; tail != head; tail++)
+    {
+      const evfeed_record_t * rec = server->queue + (tail & (SERVE_QUEUE - 1));
+      for (i = 0, client = server->clients; i < SERVE_MAX_CLIENTS; i++, client++)
+	{
+	  if ((client->fd >= 0) && client->subscribed && server_match(client, rec))
+	    server_offer(server, client, rec);
+	}
+    }
+  SDL_MemoryBarrierRelease();  /* done reading records before main thread may reuse them. */
+  SDL_AtomicSet(&server->tail, tail);
+
+  for (i = 0, client = server->clients; i < SERVE_MAX_CLIENTS; i++, client++)
+    {
+      if ((client->fd >= 0) && (client->outlen > client->outpos) && (server_flush(server, client) < 0))
+	server_drop_client(server, client);
+    }
+}
+
+/* Accept pending connections into free slots. */
+static
+void server_accept (server_t * server)
+{
+  int fd;
+  while ((fd = accept(server->listenfd, NULL, NULL)) >= 0)
+    {
+      int i;
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      for (i = 0; (i < SERVE_MAX_CLIENTS) && (server->clients[i].fd >= 0); i++)
+	;
+      if (i == SERVE_MAX_CLIENTS)
+	{
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "serve: %d subscribers already; refused one.", SERVE_MAX_CLIENTS);
+	  close(fd);
+	  continue;
+	}
+      subscriber_t * client = server->clients + i;
+      client->out = SDL_malloc(SERVE_CLIENT_BUFFER);
+      if (! client->out)
+	{
+	  SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in server.accept");
+	  abort();
+	}
+      client->fd = fd;
+      struct epoll_event ev = { 0, };
+      ev.events = EPOLLIN;
+      ev.data.u32 = i;
+      epoll_ctl(server->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+/* Read from subscriber: the request line first, then nothing but end-of-stream is expected.
+   End of stream after subscribing is a half-close (e.g. "printf ... | socat"): events keep flowing until hangup or a send error. */
+static
+void server_read (server_t * server, subscriber_t * client)
+{
+  char scratch[256];
+  for (;;)
+    {
+      char * dst = client->subscribed ? scratch : client->req + client->reqlen;
+      int room = client->subscribed ? (int)sizeof(scratch) : (int)sizeof(client->req) - 1 - client->reqlen;
+      if (room <= 0)
+	{
+	  static const char toolong[] = "ERR request too long\n";
+	  send(client->fd, toolong, sizeof(toolong) - 1, MSG_NOSIGNAL);
+	  server_drop_client(server, client);
+	  return;
+	}
+      ssize_t n = recv(client->fd, dst, room, 0);
+      if ((n < 0) && (errno == EINTR))
+	continue;
+      if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+	return;
+      if ((n == 0) && client->subscribed)
+	{
+	  client->eof = SDL_TRUE;
+	  server_arm(server, client);
+	  return;
+	}
+      if (n <= 0)
+	{
+	  server_drop_client(server, client);
+	  return;
+	}
+      if (client->subscribed)
+	continue;
+
+      client->reqlen += n;
+      client->req[client->reqlen] = 0;
+      char * eol = SDL_strchr(client->req, '\n');
+      if (! eol)
+	continue;
+      *eol = 0;
+      const char * bad = server_parse_request(client, client->req);
+      char reply[sizeof(client->req) + 8];
+      int len = bad ? SDL_snprintf(reply, sizeof(reply), "ERR %s\n", bad)
+		    : SDL_snprintf(reply, sizeof(reply), "OK %s\n", client->binary ? "binary" : "json");
+      server_put(client, reply, len);
+      if (bad)
+	{
+	  server_flush(server, client);
+	  server_drop_client(server, client);
+	  return;
+	}
+      client->subscribed = SDL_TRUE;
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "serve: subscriber %d joined (%s).",
+		  (int)(client - server->clients), client->binary ? "binary" : "json");
+    }
+}
+
+/* Server thread: all socket I/O, woken by connections, subscribers and the main thread's eventfd. */
+static
+int server_thread (void * data)
+{
+  server_t * server = (server_t*)data;
+  struct epoll_event evs[SERVE_MAX_CLIENTS + 2];
+
+  while (SDL_AtomicGet(&server->alive))
+    {
+      int n = epoll_wait(server->epfd, evs, SDL_arraysize(evs), 250);
+      for (int i = 0; i < n; i++)
+	{
+	  Uint32 tag = evs[i].data.u32;
+	  if (tag == SERVE_TAG_LISTEN)
+	    server_accept(server);
+	  else if (tag == SERVE_TAG_WAKE)
+	    {
+	      Uint64 count;
+	      if (read(server->wakefd, &count, sizeof(count)) < 0)
+		continue;
+	    }
+	  else if (server->clients[tag].fd >= 0)
+	    {
+	      subscriber_t * client = server->clients + tag;
+	      if (evs[i].events & EPOLLIN)
+		server_read(server, client);
+	      if ((client->fd >= 0) && (evs[i].events & (EPOLLERR | EPOLLHUP)))
+		server_drop_client(server, client);
+	      else if ((client->fd >= 0) && (evs[i].events & EPOLLOUT) && (server_flush(server, client) < 0))
+		server_drop_client(server, client);
+	    }
+	}
+      server_drain(server);
+    }
+  return 0;
+}
+
+/* Listen on Unix-domain socket and start server thread. */
+int server_start (server_t * server)
+{
+  struct sockaddr_un addr = { 0, };
+  struct stat st;
+  struct epoll_event ev = { 0, };
+
+  if (! server->path)
+    return 0;
+  server->listenfd = server->epfd = server->wakefd = -1;
+  for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+    server->clients[i].fd = -1;
+  if (SDL_strlen(server->path) >= sizeof(addr.sun_path))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Socket path too long: %s", server->path);
+      server->path = NULL;
+      return -1;
+    }
+  addr.sun_family = AF_UNIX;
+  SDL_strlcpy(addr.sun_path, server->path, sizeof(addr.sun_path));
+  /* replace socket left over by an earlier run, but nothing else. */
+  if ((lstat(server->path, &st) == 0) && S_ISSOCK(st.st_mode))
+    unlink(server->path);
+
+  server->listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if ((server->listenfd < 0)
+      || (bind(server->listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+      || (listen(server->listenfd, SERVE_MAX_CLIENTS) < 0))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to listen on %s: %s", server->path, strerror(errno));
+      if (server->listenfd >= 0)
+	close(server->listenfd);
+      server->listenfd = -1;
+      server->path = NULL;
+      return -1;
+    }
+  server->epfd = epoll_create1(EPOLL_CLOEXEC);
+  server->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if ((server->epfd < 0) || (server->wakefd < 0))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to poll on %s: %s", server->path, strerror(errno));
+      if (server->epfd >= 0)
+	close(server->epfd);
+      if (server->wakefd >= 0)
+	close(server->wakefd);
+      close(server->listenfd);
+      unlink(server->path);
+      server->listenfd = server->epfd = server->wakefd = -1;
+      server->path = NULL;
+      return -1;
+    }
+  server->queue = SDL_calloc(SERVE_QUEUE, sizeof(evfeed_record_t));
+  if (! server->queue)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in server.start");
+      abort();
+    }
+  ev.events = EPOLLIN;
+  ev.data.u32 = SERVE_TAG_LISTEN;
+  epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->listenfd, &ev);
+  ev.data.u32 = SERVE_TAG_WAKE;
+  epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->wakefd, &ev);
+
+  SDL_AtomicSet(&server->alive, 1);
+  server->thread = SDL_CreateThread(server_thread, "serve", server);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Serving events on %s.", server->path);
+  return 1;
+}
+
+/* Queue batch of events for subscribers; never blocks.  Events that find the queue full are counted as dropped. */
+int server_publish (server_t * server, const SDL_Event * evts, int n)
+{
+  if (! server->thread)
+    return 0;
+  Uint32 head = SDL_AtomicGet(&server->head);
+  Uint32 room = SERVE_QUEUE - (head - (Uint32)SDL_AtomicGet(&server->tail));
+  Uint64 counter = SDL_GetPerformanceCounter();
+  int i;
+  for (i = 0; (i < n) && ((Uint32)i < room); i++)
+    {
+      evfeed_record_t * rec = server->queue + ((head + i) & (SERVE_QUEUE - 1));
+      rec->seq = ++server->seq;
+      rec->counter = counter;
+      feed_record(rec, evts + i);
+    }
+  if (i < n)
+    {
+      SDL_AtomicAdd(&server->dropped, n - i);
+      server->seq += n - i;
+    }
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&server->head, head + i);
+  Uint64 one = 1;
+  if (write(server->wakefd, &one, sizeof(one)) < 0)
+    return i;
+  return i;
+}
+
+/* Stop server thread, disconnect subscribers and remove socket. */
+int server_stop (server_t * server)
+{
+  if (! server->thread)
+    return 0;
+  SDL_AtomicSet(&server->alive, 0);
+  Uint64 one = 1;
+  if (write(server->wakefd, &one, sizeof(one)) < 0)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "serve: unable to wake server thread.");
+  SDL_WaitThread(server->thread, NULL);
+  server->thread = NULL;
+  for (int i = 0; i < SERVE_MAX_CLIENTS; i++)
+    {
+      if (server->clients[i].fd >= 0)
+	{
+	  server_flush(server, server->clients + i);
+	  server_drop_client(server, server->clients + i);
+	}
+    }
+  if (SDL_AtomicGet(&server->dropped))
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "serve: %d events dropped at a full queue.", SDL_AtomicGet(&server->dropped));
+  close(server->listenfd);
+  close(server->wakefd);
+  close(server->epfd);
+  unlink(server->path);
+  SDL_free(server->queue);
+  server->queue = NULL;
+  return 0;
+}
+#else
+/* No epoll or Unix-domain sockets here. */
+int server_start (server_t * server)
+{
+  if (server->path)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--serve requires Linux (epoll).");
+  server->path = NULL;
+  return 0;
+}
+
+int server_publish (server_t * server, const SDL_Event * evts, int n)
+{
+  (void)server;
+  (void)evts;
+  return n;
+}
+
+int server_stop (server_t * server)
+{
+  (void)server;
+  return 0;
+}
+#endif /* HAVE_EVSERVER */
+
+
+
+/* Capture files (--record); format in evfeed.h. */
+
+/* File name of segment; segment 0 is the unsegmented capture. */
+static
+void capture_segment_path (const capture_t * capture, unsigned seg, char * buf, size_t len)
+{
+  if (seg)
+    SDL_snprintf(buf, len, "%s.%06u", capture->path, seg);
+  else
+    SDL_strlcpy(buf, capture->path, len);
+}
+
+#ifdef HAVE_CAPTURE_FD
+static
+int capture_create (capture_t * capture, const char * name)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  capture->fd = open(name, flags | (capture->direct ? O_DIRECT : 0), 0666);
+  capture->reserved = 0;
+  return (capture->fd < 0) ? -1 : 0;
+}
+
+/* Close file being written, without padding and space reserved past the end. */
+static
+int capture_finish (capture_t * capture)
+{
+  int res = 0;
+  if (capture->fd < 0)
+    return 0;
+  if (ftruncate(capture->fd, capture->length) < 0)
+    res = -1;
+  if (close(capture->fd) < 0)
+    res = -1;
+  capture->fd = -1;
+  return res;
+}
+
+/* Write n queued buffers from head in one call; returns 0 on success. */
+static
+int capture_flush (capture_t * capture, int head, int n, size_t total)
+{
+  struct iovec iov[CAPTURE_BUFFERS], * v = iov;
+  for (int k = 0; k < n; k++)
+    {
+      int idx = (head + k) % CAPTURE_BUFFERS;
+      iov[k].iov_base = capture->bufs[idx];
+      iov[k].iov_len = capture->lens[idx];
+    }
+  /* reserve space ahead, so the file system does not allocate a little per write. */
+  if (capture->offset + total > capture->reserved)
+    {
+      Uint64 want = capture->offset + total + CAPTURE_PREALLOC - capture->reserved;
+      if (fallocate(capture->fd, FALLOC_FL_KEEP_SIZE, capture->reserved, want) == 0)
+	capture->reserved += want;
+      else
+	capture->reserved = ~(Uint64)0;  /* not supported; grow as written. */
+    }
+  while (n > 0)
+    {
+      ssize_t w = writev(capture->fd, v, n);
+      if (w < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return -1;
+	}
+      capture->offset += w;
+      while ((n > 0) && ((size_t)w >= v->iov_len))
+	{
+	  w -= v->iov_len;
+	  v++;
+	  n--;
+	}
+      if (n > 0)
+	{
+	  v->iov_base = (Uint8*)v->iov_base + w;
+	  v->iov_len -= w;
+	}
+    }
+  return 0;
+}
+#else
+static
+int capture_create (capture_t * capture, const char * name)
+{
+  capture->io = SDL_RWFromFile(name, "wb");
+  return capture->io ? 0 : -1;
+}
+
+static
+int capture_finish (capture_t * capture)
+{
+  int res = 0;
+  if (capture->io && (SDL_RWclose(capture->io) < 0))
+    res = -1;
+  capture->io = NULL;
+  return res;
+}
+
+static
+int capture_flush (capture_t * capture, int head, int n, size_t total)
+{
+  for (int k = 0; k < n; k++)
+    {
+      int idx = (head + k) % CAPTURE_BUFFERS;
+      if (SDL_RWwrite(capture->io, capture->bufs[idx], capture->lens[idx], 1) != 1)
+	return -1;
+    }
+  capture->offset += total;
+  return 0;
+}
+#endif /* HAVE_CAPTURE_FD */
+
+/* Writer thread: close current segment file and start seg; drop the one that left the ring. */
+static
+int capture_switch (capture_t * capture, unsigned seg)
+{
+  char name[CAPTURE_PATH_MAX];
+  int res = capture_finish(capture);
+  capture_segment_path(capture, seg, name, sizeof(name));
+  if (capture_create(capture, name) < 0)
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open capture file '%s'.", name);
+      res = -1;
+    }
+  capture->fileseg = seg;
+  capture->offset = 0;
+  capture->length = 0;
+  if (capture->keep && (seg > (unsigned)capture->keep))
+    {
+      unsigned old = seg - capture->keep;
+      SDL_LockMutex(capture->lock);
+      SDL_bool kept = capture->kept[old % CAPTURE_SEGMENT_RING];
+      SDL_UnlockMutex(capture->lock);
+      capture_segment_path(capture, old, name, sizeof(name));
+      if (!kept)
+	remove(name);
+    }
+  return res;
+}
+
+/* Writer thread: write everything queued, as one batch per file, until closed. */
+static
+int capture_thread (void * data)
+{
+  capture_t * capture = data;
+  Uint64 freq = SDL_GetPerformanceFrequency();
+  SDL_LockMutex(capture->lock);
+  for (;;)
+    {
+      while (capture->alive && !capture->queued)
+	SDL_CondWait(capture->cond, capture->lock);
+      if (!capture->queued)
+	break;
+      int head = capture->qhead;
+      int n = capture->queued;
+      SDL_bool failed = capture->failed;
+      SDL_UnlockMutex(capture->lock);
+
+      size_t total = 0;
+      int k0 = 0;
+      Uint64 t0 = SDL_GetPerformanceCounter();
+      /* after an error, keep taking buffers so main thread is not held up. */
+      for (int k = 0; !failed && (k < n); k++)
+	{
+	  int idx = (head + k) % CAPTURE_BUFFERS;
+	  if (capture->segs[idx] != capture->fileseg)
+	    {
+	      /* write what belongs to the open file, then start the next. */
+	      if ((k > k0) && capture_flush(capture, (head + k0) % CAPTURE_BUFFERS, k - k0, total))
+		failed = SDL_TRUE;
+	      else if (capture_switch(capture, capture->segs[idx]))
+		failed = SDL_TRUE;
+	      capture->written += total;
+	      total = 0;
+	      k0 = k;
+	    }
+	  capture->length += capture->lens[idx] - capture->pads[idx];
+	  total += capture->lens[idx];
+	}
+      if (!failed && (n > k0) && capture_flush(capture, (head + k0) % CAPTURE_BUFFERS, n - k0, total))
+	failed = SDL_TRUE;
+      capture->written += total;
+      Uint32 us = (SDL_GetPerformanceCounter() - t0) * 1000000 / freq;
+
+      SDL_LockMutex(capture->lock);
+      capture->qhead = (head + n) % CAPTURE_BUFFERS;
+      capture->queued -= n;
+      capture->failed = failed;
+      capture->flushes++;
+      capture->flush_us += us;
+      capture->flush_last_us = us;
+      if (us > capture->flush_max_us)
+	capture->flush_max_us = us;
+    }
+  SDL_UnlockMutex(capture->lock);
+  return 0;
+}
+
+/* Queue buffer being filled, if any, and take the next free one. */
+static
+void capture_handoff (capture_t * capture)
+{
+  SDL_LockMutex(capture->lock);
+  if ((capture->fill >= 0) && (capture->filled > 0))
+    {
+      capture->lens[capture->fill] = capture->filled;
+      capture->pads[capture->fill] = capture->padding;
+      capture->segs[capture->fill] = capture->segment;
+      capture->queued++;
+      if (capture->queued > capture->peak)
+	capture->peak = capture->queued;
+      SDL_CondSignal(capture->cond);
+    }
+  int fill = (capture->queued < CAPTURE_BUFFERS) ? (capture->qhead + capture->queued) % CAPTURE_BUFFERS : -1;
+  SDL_UnlockMutex(capture->lock);
+  if ((fill < 0) && (capture->fill >= 0))
+    capture->stalls++;
+  capture->fill = fill;
+  capture->filled = 0;
+  capture->padding = 0;
+}
+
+/* Pad buffer being filled to whole blocks, as O_DIRECT writes require, before the end of a file. */
+static
+void capture_pad (capture_t * capture)
+{
+  if (!capture->direct || (capture->fill < 0))
+    return;
+  size_t padded = (capture->filled + CAPTURE_ALIGN - 1) & ~(size_t)(CAPTURE_ALIGN - 1);
+  SDL_memset(capture->bufs[capture->fill] + capture->filled, 0, padded - capture->filled);
+  capture->padding = padded - capture->filled;
+  capture->filled = padded;
+}
+
+/* Header and device list at the front of a new file; needs an empty buffer.
+   Devices are taken from SDL rather than the device registry, which only learns of them once their added events are handled. */
+static
+void capture_begin (capture_t * capture)
+{
+  evcapture_header_t hdr;
+  Uint8 * out = capture->bufs[capture->fill];
+  char * meta = (char*)out + sizeof(hdr);
+  size_t metasize = 0;
+  int ndevices = SDL_NumJoysticks();
+  for (int i = 0; i < ndevices; i++)
+    {
+      SDL_JoystickID instid = SDL_JoystickGetDeviceInstanceID(i);
+      if (instid < 0)
+	continue;
+      char guid[33];
+      SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(i), guid, sizeof(guid));
+      const char * name = SDL_JoystickNameForIndex(i);
+      int n = SDL_snprintf(meta + metasize, CAPTURE_META_MAX - metasize, "%d %s %s %s\n",
+			   instid, SDL_IsGameController(i) ? "controller" : "joystick", guid, name ? name : "");
+      if ((n < 0) || (metasize + n >= CAPTURE_META_MAX))
+	break;
+      metasize += n;
+    }
+  size_t padded = (metasize + sizeof(evfeed_record_t) - 1) / sizeof(evfeed_record_t) * sizeof(evfeed_record_t);
+  SDL_memset(meta + metasize, 0, padded - metasize);
+
+  SDL_memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = EVCAPTURE_MAGIC;
+  hdr.version = EVCAPTURE_VERSION;
+  hdr.recsize = sizeof(evfeed_record_t);
+  hdr.frequency = SDL_GetPerformanceFrequency();
+  hdr.t0 = SDL_GetPerformanceCounter();
+  hdr.metasize = padded;
+  SDL_memcpy(out, &hdr, sizeof(hdr));
+  capture->filled = sizeof(hdr) + padded;
+  capture->size += capture->filled;
+  capture->segsize = capture->filled;
+  capture->started = SDL_GetTicks();
+  capture->needhead = SDL_FALSE;
+}
+
+/* Main thread: end segment and start the next one. */
+static
+void capture_rotate (capture_t * capture, Uint32 t)
+{
+  capture_pad(capture);
+  capture_handoff(capture);
+  capture->segment++;
+  capture->segstarts[capture->segment % CAPTURE_SEGMENT_RING] = t;
+  SDL_LockMutex(capture->lock);
+  capture->kept[capture->segment % CAPTURE_SEGMENT_RING] = (Sint32)(t - capture->keep_until) < 0;
+  SDL_UnlockMutex(capture->lock);
+  capture->segsize = 0;
+  capture->needhead = SDL_TRUE;
+  if (capture->fill >= 0)
+    capture_begin(capture);
+}
+
+/* Whether current segment is due to end. */
+static
+SDL_bool capture_segment_due (const capture_t * capture, Uint32 t)
+{
+  if (! capture->segment)
+    return SDL_FALSE;
+  if (capture->segment_bytes && (capture->segsize >= capture->segment_bytes))
+    return SDL_TRUE;
+  if (capture->segment_s && (t - capture->segstarts[capture->segment % CAPTURE_SEGMENT_RING] >= capture->segment_s * 1000u))
+    return SDL_TRUE;
+  return SDL_FALSE;
+}
+
+int capture_close (capture_t *);
+
+int capture_open (capture_t * capture)
+{
+  char name[CAPTURE_PATH_MAX];
+  if (! capture->path)
+    return 0;
+  if (capture->segment_bytes || capture->segment_s)
+    capture->segment = 1;
+  capture_segment_path(capture, capture->segment, name, sizeof(name));
+#ifdef HAVE_CAPTURE_FD
+  if ((capture_create(capture, name) < 0) && capture->direct && (errno == EINVAL))
+    {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "'%s' does not support O_DIRECT; recording through the page cache.", name);
+      capture->direct = SDL_FALSE;
+      capture_create(capture, name);
+    }
+  if (capture->fd < 0)
+#else
+  if (capture->direct)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--record-direct requires Linux.");
+  capture->direct = SDL_FALSE;
+  if (capture_create(capture, name) < 0)
+#endif
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open capture file '%s'.", name);
+      capture->path = NULL;
+      return -1;
+    }
+  capture->fileseg = capture->segment;
+
+  capture->mem = SDL_malloc(CAPTURE_BUFFERS * CAPTURE_BUFFER + CAPTURE_ALIGN);
+  if (! capture->mem)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in capture.open");
+      abort();
+    }
+  Uint8 * base = (Uint8*)(((uintptr_t)capture->mem + CAPTURE_ALIGN - 1) & ~(uintptr_t)(CAPTURE_ALIGN - 1));
+  for (int i = 0; i < CAPTURE_BUFFERS; i++)
+    capture->bufs[i] = base + i * CAPTURE_BUFFER;
+  capture->fill = 0;
+  capture->segstarts[capture->segment % CAPTURE_SEGMENT_RING] = SDL_GetTicks();
+  capture_begin(capture);
+
+  capture->alive = SDL_TRUE;
+  capture->lock = SDL_CreateMutex();
+  capture->cond = SDL_CreateCond();
+  if (capture->lock && capture->cond)
+    capture->thread = SDL_CreateThread(capture_thread, "capture", capture);
+  if (! capture->thread)
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to start capture writer: %s", SDL_GetError());
+      capture->alive = SDL_FALSE;
+      capture_close(capture);
+      capture->path = NULL;
+      return -1;
+    }
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recording events to '%s'%s.", name, capture->direct ? " (O_DIRECT)" : "");
+  return 0;
+}
+
+/* Append one record; returns 0 if no buffer was free. */
+static
+int capture_put (capture_t * capture, const void * rec, Uint32 t)
+{
+  if ((capture->fill < 0) || (capture->filled == CAPTURE_BUFFER))
+    capture_handoff(capture);
+  if ((capture->fill >= 0) && capture->needhead)
+    capture_begin(capture);
+  if (capture->fill < 0)
+    return 0;
+  if (capture->filled == 0)
+    capture->started = t;
+  SDL_memcpy(capture->bufs[capture->fill] + capture->filled, rec, sizeof(evfeed_record_t));
+  capture->filled += sizeof(evfeed_record_t);
+  capture->size += sizeof(evfeed_record_t);
+  capture->segsize += sizeof(evfeed_record_t);
+  return 1;
+}
+
+/* Device record to follow device-added record rec, for device index devnum; returns 0 if the device is already gone. */
+static
+int capture_device (evcapture_device_t * devrec, const evfeed_record_t * rec, int devnum)
+{
+  SDL_JoystickID instid = SDL_JoystickGetDeviceInstanceID(devnum);
+  if (instid < 0)
+    return 0;
+  SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(devnum);
+  const char * name = SDL_JoystickNameForIndex(devnum);
+  SDL_memset(devrec, 0, sizeof(*devrec));
+  devrec->seq = rec->seq;
+  devrec->counter = rec->counter;
+  devrec->type = EVCAPTURE_DEVICE;
+  devrec->timestamp = rec->timestamp;
+  devrec->which = instid;
+  devrec->index = devnum;
+  devrec->controller = SDL_IsGameController(devnum) ? 1 : 0;
+  SDL_memcpy(devrec->guid, guid.data, sizeof(devrec->guid));
+  if (name)
+    SDL_memcpy(devrec->name, name, SDL_min(SDL_strlen(name), sizeof(devrec->name)));
+  return 1;
+}
+
+/* Append batch of events to capture; events find no room only if the writer is CAPTURE_BUFFERS behind. */
+int capture_write (capture_t * capture, const SDL_Event * evts, int n)
+{
+  evfeed_record_t rec;
+  evcapture_device_t devrec;
+  if (! capture->mem)
+    return 0;
+  SDL_memset(&rec, 0, sizeof(rec));
+  rec.counter = SDL_GetPerformanceCounter();
+  Uint32 t = SDL_GetTicks();
+  if (capture_segment_due(capture, t))
+    capture_rotate(capture, t);
+  for (int i = 0; i < n; i++)
+    {
+      rec.seq = capture->seq + 1;
+      feed_record(&rec, evts + i);
+      if (! capture_put(capture, &rec, t))
+	{
+	  /* sequence numbers skip the lost events. */
+	  capture->seq += n - i;
+	  capture->dropped += n - i;
+	  return i;
+	}
+      capture->seq++;
+      /* added records carry a device index; name the device by the instance id later records use. */
+      if (((rec.type == SDL_JOYDEVICEADDED) || (rec.type == SDL_CONTROLLERDEVICEADDED))
+	  && capture_device(&devrec, &rec, rec.which))
+	capture_put(capture, &devrec, t);
+    }
+  return n;
+}
+
+/* Once per frame: rotate a segment that is due, hand off a buffer that has waited long enough, or retry after a stall. */
+int capture_poll (capture_t * capture, long t)
+{
+  if (! capture->mem)
+    return 0;
+  if (capture_segment_due(capture, t))
+    capture_rotate(capture, t);
+  else if (capture->fill < 0)
+    capture_handoff(capture);
+  else if (!capture->direct && (capture->filled > 0) && (t - (long)capture->started >= CAPTURE_FLUSH_MS))
+    capture_handoff(capture);
+  if ((capture->fill >= 0) && capture->needhead)
+    capture_begin(capture);
+  return 0;
+}
+
+/* Keep segments from window_s before t until window_s after it, past the ring. */
+int capture_trigger (capture_t * capture, long t)
+{
+  if (!capture->mem || !capture->segment || !capture->keep)
+    return 0;
+  Uint32 from = t - capture->window_s * 1000L;
+  unsigned first = capture->segment;
+  SDL_LockMutex(capture->lock);
+  /* segment s ran until the next one started. */
+  for (unsigned s = capture->segment; (s >= 1) && (s + capture->keep > capture->segment); s--)
+    {
+      if ((s < capture->segment) && ((Sint32)(capture->segstarts[(s + 1) % CAPTURE_SEGMENT_RING] - from) < 0))
+	break;
+      capture->kept[s % CAPTURE_SEGMENT_RING] = SDL_TRUE;
+      first = s;
+    }
+  capture->keep_until = t + capture->window_s * 1000L;
+  capture->triggers++;
+  SDL_UnlockMutex(capture->lock);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Trigger: keeping capture segments from %u, and those started in the next %d s.", first, capture->window_s);
+  return 1;
+}
+
+int capture_close (capture_t * capture)
+{
+  char name[CAPTURE_PATH_MAX];
+  if (! capture->mem)
+    return 0;
+  if (capture->thread)
+    {
+      capture_pad(capture);
+      capture_handoff(capture);
+      SDL_LockMutex(capture->lock);
+      capture->alive = SDL_FALSE;
+      SDL_CondSignal(capture->cond);
+      SDL_UnlockMutex(capture->lock);
+      SDL_WaitThread(capture->thread, NULL);
+      capture->thread = NULL;
+    }
+  else
+    capture->failed = SDL_TRUE;
+  if (capture_finish(capture) < 0)
+    capture->failed = SDL_TRUE;
+
+  capture_segment_path(capture, capture->fileseg, name, sizeof(name));
+  if (capture->failed)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Capture file '%s' incomplete.", name);
+  else if (capture->segment)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recorded %llu events to '%s.*' in %u segments; last is '%s'.",
+		(unsigned long long)capture->seq, capture->path, capture->segment, name);
+  else
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Recorded %llu events to '%s'.", (unsigned long long)capture->seq, name);
+  if (capture->flushes)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "capture: %d writes, %.2f ms mean, %.2f ms longest; %d of %d buffers queued at most; %d stalls, %llu events dropped.",
+		capture->flushes, capture->flush_us / 1000.0 / capture->flushes, capture->flush_max_us / 1000.0,
+		capture->peak, CAPTURE_BUFFERS, capture->stalls, (unsigned long long)capture->dropped);
+  if (capture->cond)
+    SDL_DestroyCond(capture->cond);
+  if (capture->lock)
+    SDL_DestroyMutex(capture->lock);
+  capture->cond = NULL;
+  capture->lock = NULL;
+  SDL_free(capture->mem);
+  capture->mem = NULL;
+  return 0;
+}
+
+
+
+/* Metrics export (--metrics-file, --metrics-port); see metrics_t. */
+
+/* Upper bounds of histogram buckets, seconds: around 60, 30 and 20 frames per second, and stalls. */
+static const double metrics_bounds[METRICS_BUCKETS] = {
+    0.001, 0.002, 0.004, 0.008, 0.0125, 0.0167, 0.025, 0.0333, 0.05, 0.1, 0.25, 1.0,
+};
+
+/* Append to exposition being rendered; what does not fit is cut off. */
+static
+void metrics_printf (metrics_t * metrics, const char * fmt, ...)
+{
+  va_list ap;
+  int room = METRICS_TEXT_MAX - metrics->len;
+  va_start(ap, fmt);
+  int n = SDL_vsnprintf(metrics->text + metrics->len, room, fmt, ap);
+  va_end(ap);
+  if ((n < 0) || (n >= room))
+    {
+      metrics->truncated = SDL_TRUE;
+      return;
+    }
+  metrics->len += n;
+}
+
+/* Label value with backslash, quote and newline escaped. */
+static
+void metrics_escape (char * out, size_t len, const char * s)
+{
+  size_t n = 0;
+  for (; *s && (n + 2 < len); s++)
+    {
+      if ((*s == '\\') || (*s == '"') || (*s == '\n'))
+	{
+	  out[n++] = '\\';
+	  out[n++] = (*s == '\n') ? 'n' : *s;
+	}
+      else
+	out[n++] = *s;
+    }
+  out[n] = 0;
+}
+
+/* Histogram family, buckets cumulative as the format requires. */
+static
+void metrics_histogram (metrics_t * metrics, const char * name, const char * help, const histogram_t * h)
+{
+  Uint64 total = 0;
+  metrics_printf(metrics, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+  for (int i = 0; i < METRICS_BUCKETS; i++)
+    {
+      total += h->buckets[i];
+      metrics_printf(metrics, "%s_bucket{le=\"%g\"} %llu\n", name, metrics_bounds[i], (unsigned long long)total);
+    }
+  metrics_printf(metrics, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+		 name, (unsigned long long)h->count, name, h->sum, name, (unsigned long long)h->count);
+}
+
+/* Record duration in counter ticks. */
+void metrics_observe (metrics_t * metrics, histogram_t * h, Uint64 ticks)
+{
+  if (! metrics->text)
+    return;
+  double s = ticks * metrics->s_per_tick;
+  int i = 0;
+  while ((i < METRICS_BUCKETS) && (s > metrics_bounds[i]))
+    i++;
+  h->buckets[i]++;
+  h->count++;
+  h->sum += s;
+}
+
+/* Count event by column and type. */
+void metrics_count (metrics_t * metrics, const SDL_Event * evt)
+{
+  metrics->events[event_category(evt->type)]++;
+  for (int i = 0; i < metrics->ntypes; i++)
+    {
+      if (metrics->types[i] == evt->type)
+	{
+	  metrics->typecounts[i]++;
+	  return;
+	}
+    }
+  if (metrics->ntypes < METRICS_MAX_TYPES)
+    {
+      metrics->types[metrics->ntypes] = evt->type;
+      metrics->typecounts[metrics->ntypes++] = 1;
+    }
+  else
+    metrics->othertypes++;
+}
+
+/* Hand rendered exposition to metrics thread. */
+void metrics_publish (metrics_t * metrics)
+{
+  SDL_LockMutex(metrics->lock);
+  SDL_memcpy(metrics->snapshot, metrics->text, metrics->len);
+  metrics->snaplen = metrics->len;
+  SDL_UnlockMutex(metrics->lock);
+}
+
+/* Metrics thread: copy of latest snapshot; returns its length. */
+static
+int metrics_take (metrics_t * metrics, char * buf)
+{
+  SDL_LockMutex(metrics->lock);
+  int len = metrics->snaplen;
+  SDL_memcpy(buf, metrics->snapshot, len);
+  SDL_UnlockMutex(metrics->lock);
+  return len;
+}
+
+/* Replace textfile atomically, so a scrape never sees it half written. */
+static
+int metrics_write_file (metrics_t * metrics, const char * text, int len)
+{
+  char tmp[CAPTURE_PATH_MAX];
+  SDL_snprintf(tmp, sizeof(tmp), "%s.tmp", metrics->path);
+  FILE * fp = fopen(tmp, "w");
+  if (! fp)
+    return -1;
+  int bad = (fwrite(text, 1, len, fp) != (size_t)len);
+  bad |= fclose(fp);
+  if (bad || (rename(tmp, metrics->path) != 0))
+    {
+      remove(tmp);
+      return -1;
+    }
+  return 0;
+}
+
+#ifdef HAVE_METRICS_HTTP
+/* Answer one scrape: GET /metrics (or /) gets the latest snapshot. */
+static
+void metrics_serve (metrics_t * metrics, char * buf)
+{
+  char req[1024], head[160];
+  int fd = accept(metrics->listenfd, NULL, NULL);
+  if (fd < 0)
+    return;
+  /* the listening socket is non-blocking; this one must not be, with a limit on slow clients. */
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  struct timeval tv = { 1, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  int n = 0;
+  while (n < (int)sizeof(req) - 1)
+    {
+      ssize_t got = recv(fd, req + n, sizeof(req) - 1 - n, 0);
+      if (got <= 0)
+	break;
+      n += got;
+      req[n] = 0;
+      if (SDL_strstr(req, "\r\n\r\n"))
+	break;
+    }
+  req[n] = 0;
+
+  int len;
+  const char * status = "200 OK";
+  if ((SDL_strncmp(req, "GET /metrics ", 13) == 0) || (SDL_strncmp(req, "GET / ", 6) == 0))
+    len = metrics_take(metrics, buf);
+  else
+    {
+      status = "404 Not Found";
+      len = SDL_snprintf(buf, METRICS_TEXT_MAX, "Metrics are at /metrics.\n");
+    }
+  int hlen = SDL_snprintf(head, sizeof(head),
+			  "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+			  status, len);
+  if (send(fd, head, hlen, MSG_NOSIGNAL) == hlen)
+    {
+      for (int sent = 0; sent < len; )
+	{
+	  ssize_t w = send(fd, buf + sent, len - sent, MSG_NOSIGNAL);
+	  if (w <= 0)
+	    break;
+	  sent += w;
+	}
+    }
+  close(fd);
+}
+#endif /* HAVE_METRICS_HTTP */
+
+/* Metrics thread: serve scrapes, write textfile every interval and once more at the end. */
+static
+int metrics_thread (void * data)
+{
+  metrics_t * metrics = data;
+  char * buf = SDL_malloc(METRICS_TEXT_MAX);
+  if (! buf)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in metrics.thread");
+      abort();
+    }
+  Uint32 written = SDL_GetTicks();
+  SDL_bool warned = SDL_FALSE;
+  SDL_bool alive = SDL_TRUE;
+  while (alive)
+    {
+#ifdef HAVE_METRICS_HTTP
+      if (metrics->listenfd >= 0)
+	{
+	  struct pollfd pfd = { metrics->listenfd, POLLIN, 0 };
+	  if (poll(&pfd, 1, METRICS_POLL_MS) > 0)
+	    metrics_serve(metrics, buf);
+	}
+      else
+#endif /* HAVE_METRICS_HTTP */
+	SDL_Delay(METRICS_POLL_MS);
+
+      SDL_LockMutex(metrics->lock);
+      alive = metrics->alive;
+      SDL_UnlockMutex(metrics->lock);
+      Uint32 now = SDL_GetTicks();
+      if (!metrics->path || (alive && (now - written < metrics->interval_s * 1000u)))
+	continue;
+      written = now;
+      if ((metrics_write_file(metrics, buf, metrics_take(metrics, buf)) < 0) && !warned)
+	{
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to write metrics to '%s'.", metrics->path);
+	  warned = SDL_TRUE;
+	}
+    }
+  SDL_free(buf);
+  return 0;
+}
+
+int metrics_start (metrics_t * metrics)
+{
+  if (!metrics->path && !metrics->port)
+    return 0;
+#ifdef HAVE_METRICS_HTTP
+  metrics->listenfd = -1;
+  if (metrics->port)
+    {
+      struct sockaddr_in addr = { 0, };
+      int one = 1;
+      addr.sin_family = AF_INET;
+      addr.sin_port = htons(metrics->port);
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      metrics->listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if (metrics->listenfd >= 0)
+	setsockopt(metrics->listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if ((metrics->listenfd < 0)
+	  || (bind(metrics->listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	  || (listen(metrics->listenfd, 4) < 0))
+	{
+	  SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to listen on 127.0.0.1:%d: %s", metrics->port, strerror(errno));
+	  if (metrics->listenfd >= 0)
+	    close(metrics->listenfd);
+	  metrics->listenfd = -1;
+	  metrics->port = 0;
+	}
+    }
+#else
+  if (metrics->port)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "--metrics-port requires Linux.");
+  metrics->port = 0;
+#endif /* HAVE_METRICS_HTTP */
+  if (!metrics->path && !metrics->port)
+    return -1;
+
+  metrics->text = SDL_malloc(METRICS_TEXT_MAX);
+  metrics->snapshot = SDL_malloc(METRICS_TEXT_MAX);
+  if (!metrics->text || !metrics->snapshot)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in metrics.start");
+      abort();
+    }
+  metrics->s_per_tick = 1.0 / SDL_GetPerformanceFrequency();
+  metrics->alive = SDL_TRUE;
+  metrics->lock = SDL_CreateMutex();
+  if (metrics->lock)
+    metrics->thread = SDL_CreateThread(metrics_thread, "metrics", metrics);
+  if (! metrics->thread)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to start metrics thread: %s", SDL_GetError());
+  if (metrics->port)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Serving metrics at http://127.0.0.1:%d/metrics", metrics->port);
+  if (metrics->path)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Writing metrics to '%s' every %d s.", metrics->path, metrics->interval_s);
+  return 0;
+}
+
+/* Stop thread after it writes the last snapshot published. */
+int metrics_stop (metrics_t * metrics)
+{
+  if (! metrics->text)
+    return 0;
+  if (metrics->thread)
+    {
+      SDL_LockMutex(metrics->lock);
+      metrics->alive = SDL_FALSE;
+      SDL_UnlockMutex(metrics->lock);
+      SDL_WaitThread(metrics->thread, NULL);
+      metrics->thread = NULL;
+    }
+#ifdef HAVE_METRICS_HTTP
+  if (metrics->listenfd >= 0)
+    close(metrics->listenfd);
+  metrics->listenfd = -1;
+#endif /* HAVE_METRICS_HTTP */
+  if (metrics->lock)
+    SDL_DestroyMutex(metrics->lock);
+  metrics->lock = NULL;
+  SDL_free(metrics->text);
+  SDL_free(metrics->snapshot);
+  metrics->text = metrics->snapshot = NULL;
+  return 0;
+}
+
+
+
+/* Capture diff (--diff A B).
+   Both files are read forward once, merged by time since each one's first event.  Events wait in a pending
+   ring per file, chained per key (device and control), and are settled oldest first once the reader is
+   DIFF_WINDOW_MS past them: paired with an event of the same key from the other file, or reported as only
+   in their own.  Memory stays bounded by the pending rings and the key table, whatever the file sizes.
+*/
+
+/* Unmatched event of one side. */
+typedef struct cappend_s {
+    evfeed_record_t rec;
+    Sint64 t;  /* microseconds since side's first event. */
+    int key;
+    int next;  /* next unsettled event with the same key, or -1. */
+    SDL_bool done;  /* paired or reported. */
+} cappend_t;
+
+/* One input file of a diff. */
+typedef struct capside_s {
+    const char * path;
+    FILE * fp;
+    double us_per_tick;
+    Uint64 first;  /* counter of first event. */
+    evfeed_record_t * buf;
+    int nbuf, pos;
+    long nread;
+    cappend_t * pend;  /* ring of DIFF_PENDING. */
+    int head, count;
+    long only;  /* events never matched. */
+} capside_t;
+
+/* Device and control; pending events of each side chain from first to last. */
+typedef struct capkey_s {
+    Uint32 type;  /* 0 for free slot. */
+    Sint32 which;
+    Sint32 index;
+    int first[2], last[2];
+} capkey_t;
+
+typedef struct capdiffrun_s {
+    const capdiff_t * opts;
+    capside_t side[2];
+    capkey_t * keys;
+    SDL_bool keys_full;
+    long matched, changed, drifted;
+    double drift_sum, drift_sumsq;
+    Sint64 drift_max;
+    long drift_hist[DIFF_DRIFT_BUCKETS];
+} capdiffrun_t;
+
+/* Open capture and check its header. */
+static
+int capdiff_open (capside_t * side, const char * path)
+{
+  evcapture_header_t hdr;
+  side->path = path;
+  side->fp = fopen(path, "rb");
+  if (! side->fp)
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open capture file '%s'.", path);
+      return -1;
+    }
+  if ((fread(&hdr, sizeof(hdr), 1, side->fp) != 1)
+      || (hdr.magic != EVCAPTURE_MAGIC) || (hdr.version < 1) || (hdr.version > EVCAPTURE_VERSION)
+      || (hdr.recsize != sizeof(evfeed_record_t)) || (hdr.frequency == 0)
+      || (fseek(side->fp, hdr.metasize, SEEK_CUR) < 0))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "'%s' is not a capture file of this version.", path);
+      return -1;
+    }
+  side->us_per_tick = 1000000.0 / hdr.frequency;
+  side->buf = SDL_malloc(DIFF_READ_RECORDS * sizeof(evfeed_record_t));
+  side->pend = SDL_malloc(DIFF_PENDING * sizeof(cappend_t));
+  if (!side->buf || !side->pend)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in capdiff.open");
+      abort();
+    }
+  return 0;
+}
+
+/* Next event of side, without taking it; NULL at end of file.  Device records are passed over. */
+static
+const evfeed_record_t * capdiff_peek (capside_t * side)
+{
+  for (;;)
+    {
+      if (side->pos == side->nbuf)
+	{
+	  side->nbuf = side->fp ? fread(side->buf, sizeof(evfeed_record_t), DIFF_READ_RECORDS, side->fp) : 0;
+	  side->pos = 0;
+	  if (! side->nbuf)
+	    return NULL;
+	  if (! side->nread)
+	    side->first = side->buf[0].counter;
+	}
+      if (side->buf[side->pos].type != EVCAPTURE_DEVICE)
+	return side->buf + side->pos;
+      side->pos++;
+    }
+}
+
+/* Time of event in microseconds since side's first event. */
+static
+Sint64 capdiff_time (const capside_t * side, const evfeed_record_t * rec)
+{
+  return (Sint64)((rec->counter - side->first) * side->us_per_tick);
+}
+
+/* Button releases pair with presses on the same key, so a changed state shows as a value difference. */
+static
+Uint32 capdiff_keytype (Uint32 type)
+{
+  switch (type)
+    {
+    case SDL_KEYUP: return SDL_KEYDOWN;
+    case SDL_MOUSEBUTTONUP: return SDL_MOUSEBUTTONDOWN;
+    case SDL_JOYBUTTONUP: return SDL_JOYBUTTONDOWN;
+    case SDL_CONTROLLERBUTTONUP: return SDL_CONTROLLERBUTTONDOWN;
+    default: return type;
+    }
+}
+
+/* Key slot for event, added if new; -1 if key table is full. */
+static
+int capdiff_key (capdiffrun_t * run, const evfeed_record_t * rec)
+{
+  Uint32 type = capdiff_keytype(rec->type);
+  Uint32 h = ((type * 31u + (Uint32)rec->which) * 31u + (Uint32)rec->index) * 2654435769u;
+  int k = (h >> 16) & (DIFF_MAX_KEYS - 1);
+  for (int probe = 0; probe < DIFF_MAX_KEYS; probe++, k = (k + 1) & (DIFF_MAX_KEYS - 1))
+    {
+      capkey_t * key = run->keys + k;
+      if ((key->type == type) && (key->which == rec->which) && (key->index == rec->index))
+	return k;
+      if (key->type == 0)
+	{
+	  key->type = type;
+	  key->which = rec->which;
+	  key->index = rec->index;
+	  key->first[0] = key->first[1] = key->last[0] = key->last[1] = -1;
+	  return k;
+	}
+    }
+  if (! run->keys_full)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "diff: more than %d distinct controls; the rest are not aligned.", DIFF_MAX_KEYS);
+  run->keys_full = SDL_TRUE;
+  return -1;
+}
+
+/* One-line description of event: category, type, device, control and values. */
+static
+int capdiff_describe (char * buf, int buflen, const evfeed_record_t * rec)
+{
+  return SDL_snprintf(buf, buflen, "%s 0x%x which=%d index=%d value=%d x=%d y=%d xrel=%d yrel=%d",
+		      catlabel[event_category(rec->type)], rec->type, rec->which, rec->index,
+		      rec->value, rec->x, rec->y, rec->xrel, rec->yrel);
+}
+
+/* Report event found in only one file. */
+static
+void capdiff_only (capdiffrun_t * run, int s, const cappend_t * p)
+{
+  char desc[160];
+  capdiff_describe(desc, sizeof(desc), &p->rec);
+  printf("%c %12.6f %s\n", s ? '+' : '-', p->t / 1e6, desc);
+  run->side[s].only++;
+}
+
+/* Whether values differ beyond tolerance; analog controls get the tolerance, others must match. */
+static
+SDL_bool capdiff_changed (const capdiffrun_t * run, const evfeed_record_t * a, const evfeed_record_t * b)
+{
+  int tol = 0;
+  switch (a->type)
+    {
+    case SDL_JOYAXISMOTION:
+    case SDL_CONTROLLERAXISMOTION:
+    case SDL_JOYBALLMOTION:
+    case SDL_MOUSEMOTION:
+      tol = run->opts->tolerance;
+      break;
+    default:
+      break;
+    }
+  return (a->type != b->type)
+      || (SDL_abs(a->value - b->value) > tol) || (SDL_abs(a->x - b->x) > tol) || (SDL_abs(a->y - b->y) > tol)
+      || (SDL_abs(a->xrel - b->xrel) > tol) || (SDL_abs(a->yrel - b->yrel) > tol);
+}
+
+/* Compare aligned pair: values, and timing of B relative to A. */
+static
+void capdiff_compare (capdiffrun_t * run, const cappend_t * a, const cappend_t * b)
+{
+  char desc[160];
+  Sint64 drift = b->t - a->t;
+  Sint64 mag = (drift < 0) ? -drift : drift;
+  int bucket = 0;
+
+  run->matched++;
+  run->drift_sum += drift;
+  run->drift_sumsq += (double)drift * drift;
+  if (mag > run->drift_max)
+    run->drift_max = mag;
+  while ((bucket < DIFF_DRIFT_BUCKETS - 1) && (((Sint64)1 << bucket) <= mag))
+    bucket++;
+  run->drift_hist[bucket]++;
+
+  if (capdiff_changed(run, &a->rec, &b->rec))
+    {
+      capdiff_describe(desc, sizeof(desc), &a->rec);
+      printf("! %12.6f %s\n", a->t / 1e6, desc);
+      capdiff_describe(desc, sizeof(desc), &b->rec);
+      printf("  %12.6f %s\n", b->t / 1e6, desc);
+      run->changed++;
+    }
+  if (mag > (Sint64)run->opts->drift_ms * 1000)
+    {
+      capdiff_describe(desc, sizeof(desc), &a->rec);
+      printf("@ %12.6f %s: B %+.3f ms\n", a->t / 1e6, desc, drift / 1e3);
+      run->drifted++;
+    }
+}
+
+/* Unlink pending entry from its key's chain on side s, given the entry before it (or -1). */
+static
+void capdiff_unlink (capdiffrun_t * run, int s, int key, int prev, int slot)
+{
+  cappend_t * pend = run->side[s].pend;
+  capkey_t * k = run->keys + key;
+  if (prev < 0)
+    k->first[s] = pend[slot].next;
+  else
+    pend[prev].next = pend[slot].next;
+  if (k->last[s] == slot)
+    k->last[s] = prev;
+  pend[slot].done = SDL_TRUE;
+}
+
+/* Settle oldest unsettled event x of side s.  Its partner is the first event of the same control on the other
+   side with equal values within the drift limit; failing that, the other side's oldest event of that control
+   (a changed value), unless that one equals x's own successor, in which case x has no partner.
+*/
+static
+void capdiff_resolve (capdiffrun_t * run, int s)
+{
+  int o = !s;
+  int xslot = run->side[s].head;
+  cappend_t * spend = run->side[s].pend;
+  cappend_t * opend = run->side[o].pend;
+  cappend_t * x = spend + xslot;
+  Sint64 drift_us = (Sint64)run->opts->drift_ms * 1000;
+  int prev, i, n;
+
+  if (x->key < 0)
+    {
+      capdiff_only(run, s, x);
+      x->done = SDL_TRUE;
+      return;
+    }
+  capkey_t * key = run->keys + x->key;
+  /* oldest first, so also first of its control. */
+  capdiff_unlink(run, s, x->key, -1, xslot);
+
+  for (prev = -1, i = key->first[o], n = 0; (i >= 0) && (n < DIFF_LOOKAHEAD); prev = i, i = opend[i].next, n++)
+    {
+      if (opend[i].t - x->t > drift_us)
+	break;
+      if (! capdiff_changed(run, &x->rec, &opend[i].rec))
+	break;
+    }
+  if ((i < 0) || (n == DIFF_LOOKAHEAD) || (opend[i].t - x->t > drift_us))
+    {
+      prev = -1;
+      i = key->first[o];
+      if ((i >= 0) && (opend[i].t - x->t > DIFF_WINDOW_MS * 1000))
+	i = -1;
+      if ((i >= 0) && (key->first[s] >= 0) && !capdiff_changed(run, &spend[key->first[s]].rec, &opend[i].rec))
+	i = -1;
+    }
+  if (i < 0)
+    {
+      capdiff_only(run, s, x);
+      return;
+    }
+  capdiff_unlink(run, o, x->key, prev, i);
+  if (s)
+    capdiff_compare(run, opend + i, x);
+  else
+    capdiff_compare(run, x, opend + i);
+}
+
+/* Settle unsettled events older than horizon, oldest first across both sides. */
+static
+void capdiff_settle (capdiffrun_t * run, Sint64 horizon)
+{
+  for (;;)
+    {
+      int s = -1;
+      for (int i = 0; i < 2; i++)
+	{
+	  capside_t * side = run->side + i;
+	  while (side->count && side->pend[side->head].done)
+	    {
+	      side->head = (side->head + 1) & (DIFF_PENDING - 1);
+	      side->count--;
+	    }
+	  if (side->count && (side->pend[side->head].t < horizon)
+	      && ((s < 0) || (side->pend[side->head].t < run->side[s].pend[run->side[s].head].t)))
+	    s = i;
+	}
+      if (s < 0)
+	return;
+      capdiff_resolve(run, s);
+    }
+}
+
+/* Take next event of side s into its pending ring. */
+static
+void capdiff_take (capdiffrun_t * run, int s, Sint64 t)
+{
+  capside_t * side = run->side + s;
+  cappend_t in;
+
+  in.rec = side->buf[side->pos++];
+  in.t = t;
+  in.key = capdiff_key(run, &in.rec);
+  in.next = -1;
+  in.done = SDL_FALSE;
+  side->nread++;
+
+  /* ring full: settle early, losing some lookahead. */
+  while (side->count == DIFF_PENDING)
+    capdiff_settle(run, side->pend[side->head].t + 1);
+
+  int slot = (side->head + side->count) & (DIFF_PENDING - 1);
+  side->pend[slot] = in;
+  side->count++;
+  if (in.key >= 0)
+    {
+      capkey_t * key = run->keys + in.key;
+      if (key->last[s] >= 0)
+	side->pend[key->last[s]].next = slot;
+      else
+	key->first[s] = slot;
+      key->last[s] = slot;
+    }
+}
+
+/* Compare two captures and print differences; returns 0 if equivalent, 1 if different, 2 on trouble. */
+int capdiff_run (const capdiff_t * opts)
+{
+  capdiffrun_t run;
+  int status = 2;
+  SDL_memset(&run, 0, sizeof(run));
+  run.opts = opts;
+  run.keys = SDL_calloc(DIFF_MAX_KEYS, sizeof(capkey_t));
+  if (! run.keys)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in capdiff.run");
+      abort();
+    }
+  if ((capdiff_open(run.side + 0, opts->patha) < 0) || (capdiff_open(run.side + 1, opts->pathb) < 0))
+    goto done;
+
+  printf("--- %s\n+++ %s\n", opts->patha, opts->pathb);
+  for (;;)
+    {
+      const evfeed_record_t * ra = capdiff_peek(run.side + 0);
+      const evfeed_record_t * rb = capdiff_peek(run.side + 1);
+      if (!ra && !rb)
+	break;
+      Sint64 ta = ra ? capdiff_time(run.side + 0, ra) : 0;
+      Sint64 tb = rb ? capdiff_time(run.side + 1, rb) : 0;
+      int s = (ra && (!rb || (ta <= tb))) ? 0 : 1;
+      Sint64 t = s ? tb : ta;
+      /* both sides are read a window ahead of the events being settled. */
+      capdiff_settle(&run, t - DIFF_WINDOW_MS * 1000);
+      capdiff_take(&run, s, t);
+    }
+  capdiff_settle(&run, SDL_MAX_SINT64);
+  if (ferror(run.side[0].fp) || ferror(run.side[1].fp))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "diff: read error.");
+      goto done;
+    }
+
+  printf("\n%ld events in A, %ld in B: %ld aligned, %ld only in A, %ld only in B, %ld with different values.\n",
+	 run.side[0].nread, run.side[1].nread, run.matched, run.side[0].only, run.side[1].only, run.changed);
+  if (run.matched)
+    {
+      double mean = run.drift_sum / run.matched;
+      double var = run.drift_sumsq / run.matched - mean * mean;
+      printf("Timing drift of B against A: mean %+.3f ms, sd %.3f ms, max %.3f ms, %ld beyond %d ms.\n",
+	     mean / 1e3, SDL_sqrt(var > 0 ? var : 0) / 1e3, run.drift_max / 1e3, run.drifted, opts->drift_ms);
+      for (int i = 0; i < DIFF_DRIFT_BUCKETS; i++)
+	{
+	  if (! run.drift_hist[i])
+	    continue;
+	  long lo = i ? (1L << (i - 1)) : 0;
+	  printf("  |drift| %8ld us and up: %ld (%.1f%%)\n", lo, run.drift_hist[i], 100.0 * run.drift_hist[i] / run.matched);
+	}
+    }
+  status = (run.side[0].only || run.side[1].only || run.changed || run.drifted) ? 1 : 0;
+
+ done:
+  for (int i = 0; i < 2; i++)
+    {
+      if (run.side[i].fp)
+	fclose(run.side[i].fp);
+      SDL_free(run.side[i].buf);
+      SDL_free(run.side[i].pend);
+    }
+  SDL_free(run.keys);
+  return status;
+}
+
+
+
+/* Capture analysis (--analyze FILE).
+   The capture is cut into one run of records per thread.  Each thread reads its run with its own file handle
+   and keeps partial results: per-device counts and histograms, plus the state at both ends of the run
+   (first and last report, first release and last press of each button).  The main thread then merges the
+   runs in order, stitching intervals, presses and bursts across run boundaries.  Notes are capped once,
+   to the earliest ANALYZE_MAX_NOTES, so the report does not depend on the number of threads.
+*/
+
+/* Per-button partial results. */
+typedef struct anabutton_s {
+    Uint64 down;     /* counter at press, 0 while released. */
+    Uint64 firstup;  /* release before any press in this run (pressed in an earlier run); 0 if none. */
+    SDL_bool seen;
+    long presses;
+    long hist[ANALYZE_DUR_BUCKETS];  /* press durations, powers of two ms. */
+    Uint64 maxdur;
+} anabutton_t;
+
+/* Per-device partial results; a device is a category and instance id. */
+typedef struct anadev_s {
+    int cat;
+    Sint32 which;
+    long events, reports;  /* a report is the device's events sharing one ingest time. */
+    Uint64 first, last;    /* counters of first and last report. */
+    Uint64 firstgap;       /* first interval; judged for a gap at merge, knowing the one before. */
+    Uint64 lastgap;
+    long iat[ANALYZE_IAT_BUCKETS];
+    Uint64 iatmax;
+    Uint64 recent[ANALYZE_BURST_REPORTS];  /* ring of latest report counters. */
+    Uint64 early[ANALYZE_BURST_REPORTS + 1];  /* first report counters; bursts ending there are judged at merge. */
+    SDL_bool inburst;
+    long axis[ANALYZE_MAX_AXES][ANALYZE_AXIS_BUCKETS];
+    Sint32 axismin[ANALYZE_MAX_AXES], axismax[ANALYZE_MAX_AXES];
+    anabutton_t buttons[ANALYZE_MAX_BUTTONS];
+} anadev_t;
+
+enum ananote_e {
+    ANANOTE_ADDED,
+    ANANOTE_REMOVED,
+    ANANOTE_GAP,
+    ANANOTE_BURST,
+    ANANOTE_STUCK,
+};
+
+/* Timeline entry: hotplug or anomaly. */
+typedef struct ananote_s {
+    Uint64 counter;
+    enum ananote_e kind;
+    int cat;
+    Sint32 which;
+    Sint32 index;
+    Uint64 span;  /* gap, burst or press length in ticks. */
+} ananote_t;
+
+/* One thread's run of records and its partial results. */
+typedef struct anachunk_s {
+    const char * path;
+    Sint64 offset;        /* of first record in file. */
+    Sint64 start, count;  /* record indices. */
+    Uint64 gap_ticks, burst_ticks, stuck_ticks;
+    double us_per_tick;
+    anadev_t * devs;
+    int ndevs;
+    SDL_bool devs_full;
+    ananote_t * notes;  /* room for 2 * ANALYZE_MAX_NOTES; trimmed to the earliest when full. */
+    int nnotes;
+    long lostnotes;
+    SDL_Thread * thread;
+    int failed;
+} anachunk_t;
+
+/* Log-linear bucket of interval in microseconds: exact below 32, then 16 per power of two (within 6%). */
+static
+int analyze_iat_bucket (Uint64 us)
+{
+  int e = 0;
+  if (us < 32)
+    return (int)us;
+  while ((us >> e) > 1)
+    e++;
+  int b = 32 + (e - 5) * 16 + (int)((us >> (e - 4)) & 15);
+  return (b < ANALYZE_IAT_BUCKETS) ? b : ANALYZE_IAT_BUCKETS - 1;
+}
+
+/* Lower bound of log-linear bucket, microseconds. */
+static
+Uint64 analyze_iat_floor (int b)
+{
+  if (b < 32)
+    return b;
+  int e = (b - 32) / 16 + 5;
+  return ((Uint64)1 << e) + ((Uint64)((b - 32) % 16) << (e - 4));
+}
+
+/* Power-of-two bucket, as used for press durations. */
+static
+int analyze_log2_bucket (Uint64 v, int nbuckets)
+{
+  int b = 0;
+  while ((b < nbuckets - 1) && (((Uint64)1 << b) <= v))
+    b++;
+  return b;
+}
+
+/* Total order of notes: by time, ties broken by content, so sorting is the same however notes were gathered. */
+static
+int ananote_cmp (const void * a, const void * b)
+{
+  const ananote_t * na = (const ananote_t*)a;
+  const ananote_t * nb = (const ananote_t*)b;
+  if (na->counter != nb->counter)
+    return (na->counter < nb->counter) ? -1 : 1;
+  if (na->kind != nb->kind)
+    return (na->kind < nb->kind) ? -1 : 1;
+  if (na->cat != nb->cat)
+    return (na->cat < nb->cat) ? -1 : 1;
+  if (na->which != nb->which)
+    return (na->which < nb->which) ? -1 : 1;
+  if (na->index != nb->index)
+    return (na->index < nb->index) ? -1 : 1;
+  return (na->span < nb->span) ? -1 : (na->span > nb->span);
+}
+
+/* Sort notes and keep the earliest ANALYZE_MAX_NOTES.  A note dropped here has that many before it in the
+   same set, so it could not be among the earliest of the whole capture either. */
+static
+void analyze_trim_notes (anachunk_t * chunk)
+{
+  SDL_qsort(chunk->notes, chunk->nnotes, sizeof(ananote_t), ananote_cmp);
+  if (chunk->nnotes > ANALYZE_MAX_NOTES)
+    {
+      chunk->lostnotes += chunk->nnotes - ANALYZE_MAX_NOTES;
+      chunk->nnotes = ANALYZE_MAX_NOTES;
+    }
+}
+
+static
+void analyze_note (anachunk_t * chunk, Uint64 counter, enum ananote_e kind, int cat, Sint32 which, Sint32 index, Uint64 span)
+{
+  if (chunk->nnotes == 2 * ANALYZE_MAX_NOTES)
+    analyze_trim_notes(chunk);
+  ananote_t * note = chunk->notes + chunk->nnotes++;
+  note->counter = counter;
+  note->kind = kind;
+  note->cat = cat;
+  note->which = which;
+  note->index = index;
+  note->span = span;
+}
+
+/* Device slot, added if new; NULL if the table is full. */
+static
+anadev_t * analyze_dev (anachunk_t * chunk, int cat, Sint32 which)
+{
+  int i;
+  for (i = 0; i < chunk->ndevs; i++)
+    {
+      if ((chunk->devs[i].cat == cat) && (chunk->devs[i].which == which))
+	return chunk->devs + i;
+    }
+  if (i == ANALYZE_MAX_DEVICES)
+    {
+      chunk->devs_full = SDL_TRUE;
+      return NULL;
+    }
+  anadev_t * dev = chunk->devs + chunk->ndevs++;
+  dev->cat = cat;
+  dev->which = which;
+  for (i = 0; i < ANALYZE_MAX_AXES; i++)
+    {
+      dev->axismin[i] = SDL_MAX_SINT32;
+      dev->axismax[i] = SDL_MIN_SINT32;
+    }
+  return dev;
+}
+
+/* Record interval between two reports; flags a gap when a streaming device (last interval short) goes quiet. */
+static
+void analyze_interval (anachunk_t * chunk, anadev_t * dev, Uint64 at, Uint64 interval, Uint64 before)
+{
+  Uint64 us = (Uint64)(interval * chunk->us_per_tick);
+  dev->iat[analyze_iat_bucket(us)]++;
+  if (interval > dev->iatmax)
+    dev->iatmax = interval;
+  if ((interval > chunk->gap_ticks) && before && (before <= chunk->gap_ticks / 10))
+    analyze_note(chunk, at - interval, ANANOTE_GAP, dev->cat, dev->which, -1, interval);
+}
+
+/* Record completed press. */
+static
+void analyze_press (anachunk_t * chunk, anadev_t * dev, int b, Uint64 down, Uint64 up)
+{
+  anabutton_t * button = dev->buttons + b;
+  Uint64 dur = up - down;
+  button->presses++;
+  button->hist[analyze_log2_bucket((Uint64)(dur * chunk->us_per_tick / 1000), ANALYZE_DUR_BUCKETS)]++;
+  if (dur > button->maxdur)
+    button->maxdur = dur;
+  if (dur > chunk->stuck_ticks)
+    analyze_note(chunk, down, ANANOTE_STUCK, dev->cat, dev->which, b, dur);
+}
+
+/* Fold one record into run's partial results. */
+static
+void analyze_record (anachunk_t * chunk, const evfeed_record_t * rec)
+{
+  switch (rec->type)
+    {
+    case SDL_JOYDEVICEADDED:
+    case SDL_CONTROLLERDEVICEADDED:
+      analyze_note(chunk, rec->counter, ANANOTE_ADDED, event_category(rec->type), rec->which, -1, 0);
+      return;
+    case SDL_JOYDEVICEREMOVED:
+    case SDL_CONTROLLERDEVICEREMOVED:
+      analyze_note(chunk, rec->counter, ANANOTE_REMOVED, event_category(rec->type), rec->which, -1, 0);
+      return;
+    default:
+      break;
+    }
+  int cat = event_category(rec->type);
+  if ((cat == CAT_MISC) || (cat == CAT_KEYB))
+    return;
+  anadev_t * dev = analyze_dev(chunk, cat, rec->which);
+  if (! dev)
+    return;
+
+  dev->events++;
+  if (!dev->reports || (rec->counter != dev->last))
+    {
+      if (! dev->reports)
+	dev->first = rec->counter;
+      else
+	{
+	  Uint64 interval = rec->counter - dev->last;
+	  if (dev->reports == 1)
+	    {
+	      /* the interval before this one is in the previous run. */
+	      dev->firstgap = interval;
+	      dev->iat[analyze_iat_bucket((Uint64)(interval * chunk->us_per_tick))]++;
+	      if (interval > dev->iatmax)
+		dev->iatmax = interval;
+	    }
+	  else
+	    analyze_interval(chunk, dev, rec->counter, interval, dev->lastgap);
+	  dev->lastgap = interval;
+	}
+      Uint64 * oldest = dev->recent + (dev->reports % ANALYZE_BURST_REPORTS);
+      SDL_bool burst = (dev->reports >= ANALYZE_BURST_REPORTS) && (rec->counter - *oldest < chunk->burst_ticks);
+      /* whether the first full window starts a burst depends on the run before; decided at merge. */
+      if (burst && !dev->inburst && (dev->reports > ANALYZE_BURST_REPORTS))
+	analyze_note(chunk, *oldest, ANANOTE_BURST, cat, rec->which, -1, rec->counter - *oldest);
+      if (dev->reports <= ANALYZE_BURST_REPORTS)
+	dev->early[dev->reports] = rec->counter;
+      dev->inburst = burst;
+      *oldest = rec->counter;
+      dev->last = rec->counter;
+      dev->reports++;
+    }
+
+  switch (rec->type)
+    {
+    case SDL_JOYAXISMOTION:
+    case SDL_CONTROLLERAXISMOTION:
+      if ((rec->index >= 0) && (rec->index < ANALYZE_MAX_AXES))
+	{
+	  int a = rec->index;
+	  dev->axis[a][((rec->value + 32768) & 0xffff) * ANALYZE_AXIS_BUCKETS / 65536]++;
+	  if (rec->value < dev->axismin[a]) dev->axismin[a] = rec->value;
+	  if (rec->value > dev->axismax[a]) dev->axismax[a] = rec->value;
+	}
+      break;
+    case SDL_JOYBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+    case SDL_CONTROLLERBUTTONUP:
+    case SDL_MOUSEBUTTONUP:
+      if ((rec->index >= 0) && (rec->index < ANALYZE_MAX_BUTTONS))
+	{
+	  anabutton_t * button = dev->buttons + rec->index;
+	  if (rec->value == SDL_PRESSED)
+	    {
+	      if (! button->down)
+		button->down = rec->counter;
+	    }
+	  else if (button->down)
+	    {
+	      analyze_press(chunk, dev, rec->index, button->down, rec->counter);
+	      button->down = 0;
+	    }
+	  else if (! button->seen)
+	    button->firstup = rec->counter;
+	  button->seen = SDL_TRUE;
+	}
+      break;
+    default:
+      break;
+    }
+}
+
+/* Worker: read own run of records and fold them in. */
+static
+int analyze_thread (void * data)
+{
+  anachunk_t * chunk = (anachunk_t*)data;
+  SDL_RWops * io = SDL_RWFromFile(chunk->path, "rb");
+  evfeed_record_t * buf = SDL_malloc(ANALYZE_READ_RECORDS * sizeof(evfeed_record_t));
+  if (! buf)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in analyze.thread");
+      abort();
+    }
+  if (!io || (SDL_RWseek(io, chunk->offset + chunk->start * sizeof(evfeed_record_t), RW_SEEK_SET) < 0))
+    chunk->failed = 1;
+  for (Sint64 left = chunk->count; !chunk->failed && (left > 0); )
+    {
+      size_t want = (left < ANALYZE_READ_RECORDS) ? (size_t)left : ANALYZE_READ_RECORDS;
+      size_t got = SDL_RWread(io, buf, sizeof(evfeed_record_t), want);
+      if (got != want)
+	chunk->failed = 1;
+      for (size_t i = 0; i < got; i++)
+	analyze_record(chunk, buf + i);
+      left -= got;
+    }
+  if (io)
+    SDL_RWclose(io);
+  SDL_free(buf);
+  return 0;
+}
+
+/* Judge bursts ending at run's first reports, whose windows reach into the runs before (report indices
+   are global: base is the index of the run's first report), then continue the ring of latest reports. */
+static
+void analyze_merge_bursts (anachunk_t * total, anadev_t * g, const anadev_t * d)
+{
+  const int n = ANALYZE_BURST_REPORTS;
+  SDL_bool same = g->reports && d->reports && (d->first == g->last);
+  long base = g->reports - (same ? 1 : 0);
+  long k;
+  SDL_bool inburst = g->inburst;
+  for (k = same ? 1 : 0; (k <= n) && (k < d->reports); k++)
+    {
+      if (base + k < n)
+	continue;
+      Uint64 oldest = (k >= n) ? d->early[k - n] : g->recent[(base + k - n) % n];
+      SDL_bool burst = (d->early[k] - oldest < total->burst_ticks);
+      if (burst && !inburst)
+	analyze_note(total, oldest, ANANOTE_BURST, d->cat, d->which, -1, d->early[k] - oldest);
+      inburst = burst;
+    }
+  g->inburst = (d->reports > n + 1) ? d->inburst : inburst;
+  for (k = (d->reports > n) ? d->reports - n : 0; k < d->reports; k++)
+    g->recent[(base + k) % n] = d->recent[k % n];
+}
+
+/* Merge run's partial results into totals, in capture order. */
+static
+void analyze_merge (anachunk_t * total, const anachunk_t * chunk)
+{
+  int i, b, a;
+  for (i = 0; i < chunk->ndevs; i++)
+    {
+      const anadev_t * d = chunk->devs + i;
+      anadev_t * g = analyze_dev(total, d->cat, d->which);
+      if (! g)
+	continue;
+      analyze_merge_bursts(total, g, d);
+      if (g->reports && d->reports)
+	{
+	  /* interval across boundary, then the run's first interval now that the one before is known. */
+	  Uint64 before = g->lastgap;
+	  if (d->first == g->last)
+	    g->reports--;
+	  else
+	    {
+	      analyze_interval(total, g, d->first, d->first - g->last, before);
+	      before = d->first - g->last;
+	    }
+	  if (d->reports >= 2)
+	    {
+	      Uint64 gap = d->firstgap;
+	      if ((gap > total->gap_ticks) && before && (before <= total->gap_ticks / 10))
+		analyze_note(total, d->first, ANANOTE_GAP, d->cat, d->which, -1, gap);
+	    }
+	  if (d->reports < 2)
+	    g->lastgap = before;
+	}
+      if (d->reports >= 2)
+	g->lastgap = d->lastgap;
+      if (!g->reports && d->reports)
+	g->first = d->first;
+      if (d->reports)
+	g->last = d->last;
+      g->events += d->events;
+      g->reports += d->reports;
+      for (b = 0; b < ANALYZE_IAT_BUCKETS; b++)
+	g->iat[b] += d->iat[b];
+      if (d->iatmax > g->iatmax)
+	g->iatmax = d->iatmax;
+      for (a = 0; a < ANALYZE_MAX_AXES; a++)
+	{
+	  for (b = 0; b < ANALYZE_AXIS_BUCKETS; b++)
+	    g->axis[a][b] += d->axis[a][b];
+	  if (d->axismin[a] < g->axismin[a]) g->axismin[a] = d->axismin[a];
+	  if (d->axismax[a] > g->axismax[a]) g->axismax[a] = d->axismax[a];
+	}
+      for (b = 0; b < ANALYZE_MAX_BUTTONS; b++)
+	{
+	  const anabutton_t * db = d->buttons + b;
+	  anabutton_t * gb = g->buttons + b;
+	  if (db->firstup && gb->down)
+	    {
+	      analyze_press(total, g, b, gb->down, db->firstup);
+	      gb->down = 0;
+	    }
+	  gb->presses += db->presses;
+	  for (int h = 0; h < ANALYZE_DUR_BUCKETS; h++)
+	    gb->hist[h] += db->hist[h];
+	  if (db->maxdur > gb->maxdur)
+	    gb->maxdur = db->maxdur;
+	  if (db->seen)
+	    gb->down = db->down;
+	  gb->seen = gb->seen || db->seen;
+	}
+    }
+  total->devs_full = total->devs_full || chunk->devs_full;
+  for (i = 0; i < chunk->nnotes; i++)
+    {
+      const ananote_t * n = chunk->notes + i;
+      analyze_note(total, n->counter, n->kind, n->cat, n->which, n->index, n->span);
+    }
+  total->lostnotes += chunk->lostnotes;
+}
+
+/* Quantile (per mille) of interval histogram, microseconds (lower bound of bucket). */
+static
+Uint64 analyze_quantile (const long * iat, long n, int permille)
+{
+  long want = (n * permille + 999) / 1000, seen = 0;
+  for (int b = 0; b < ANALYZE_IAT_BUCKETS; b++)
+    {
+      seen += iat[b];
+      if (seen >= want)
+	return analyze_iat_floor(b);
+    }
+  return analyze_iat_floor(ANALYZE_IAT_BUCKETS - 1);
+}
+
+/* Print merged results. */
+static
+void analyze_print (const anachunk_t * total, Uint64 t0)
+{
+  static const char shades[] = " .:-=+*#%@";
+  const double ms = total->us_per_tick / 1000;
+  int i, a, b;
+
+  for (i = 0; i < total->ndevs; i++)
+    {
+      const anadev_t * dev = total->devs + i;
+      double span = (dev->last - dev->first) * total->us_per_tick / 1e6;
+      long nintervals = 0;
+      for (b = 0; b < ANALYZE_IAT_BUCKETS; b++)
+	nintervals += dev->iat[b];
+      printf("\n%s %d: %ld events in %ld reports over %.3f s, %.1f reports/s\n", catlabel[dev->cat], dev->which,
+	     dev->events, dev->reports, span, (span > 0) ? (dev->reports - 1) / span : 0.0);
+      if (nintervals)
+	printf("  interval us: p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %.0f\n",
+	       (unsigned long long)analyze_quantile(dev->iat, nintervals, 500),
+	       (unsigned long long)analyze_quantile(dev->iat, nintervals, 900),
+	       (unsigned long long)analyze_quantile(dev->iat, nintervals, 990),
+	       (unsigned long long)analyze_quantile(dev->iat, nintervals, 999),
+	       dev->iatmax * total->us_per_tick);
+      for (a = 0; a < ANALYZE_MAX_AXES; a++)
+	{
+	  char bar[ANALYZE_AXIS_BUCKETS + 1];
+	  long peak = 0, n = 0;
+	  for (b = 0; b < ANALYZE_AXIS_BUCKETS; b++)
+	    {
+	      n += dev->axis[a][b];
+	      if (dev->axis[a][b] > peak)
+		peak = dev->axis[a][b];
+	    }
+	  if (! n)
+	    continue;
+	  for (b = 0; b < ANALYZE_AXIS_BUCKETS; b++)
+	    {
+	      long v = dev->axis[a][b];
+	      bar[b] = shades[v ? 1 + (v * (sizeof(shades) - 3) + peak - 1) / peak : 0];
+	    }
+	  bar[ANALYZE_AXIS_BUCKETS] = 0;
+	  printf("  axis %d: %ld values in [%d, %d]  |%s|\n", a, n, dev->axismin[a], dev->axismax[a], bar);
+	}
+      for (b = 0; b < ANALYZE_MAX_BUTTONS; b++)
+	{
+	  const anabutton_t * button = dev->buttons + b;
+	  long seen = 0, median = 0;
+	  if (! button->presses)
+	    continue;
+	  for (int h = 0; h < ANALYZE_DUR_BUCKETS; h++)
+	    {
+	      seen += button->hist[h];
+	      if (seen * 2 >= button->presses)
+		{
+		  median = h ? (1L << (h - 1)) : 0;
+		  break;
+		}
+	    }
+	  printf("  button %d: %ld presses, median %ld ms and up, longest %.1f ms\n",
+		 b, button->presses, median, button->maxdur * ms);
+	}
+    }
+
+  SDL_bool any = SDL_FALSE;
+  for (i = 0; i < total->nnotes; i++)
+    {
+      const ananote_t * note = total->notes + i;
+      if ((note->kind != ANANOTE_ADDED) && (note->kind != ANANOTE_REMOVED))
+	continue;
+      if (! any)
+	printf("\nHotplug:\n");
+      any = SDL_TRUE;
+      printf("  %12.6f %s %s %d\n", (note->counter - t0) * total->us_per_tick / 1e6, catlabel[note->cat],
+	     (note->kind == ANANOTE_ADDED) ? "added" : "removed", note->which);
+    }
+
+  int nanomalies = 0;
+  for (i = 0; i < total->nnotes; i++)
+    {
+      const ananote_t * note = total->notes + i;
+      double at = (note->counter - t0) * total->us_per_tick / 1e6;
+      if ((note->kind == ANANOTE_ADDED) || (note->kind == ANANOTE_REMOVED))
+	continue;
+      if (nanomalies++ == 0)
+	printf("\nAnomalies:\n");
+      if (nanomalies > ANALYZE_PRINT_NOTES)
+	continue;
+      switch (note->kind)
+	{
+	case ANANOTE_GAP:
+	  printf("  %12.6f %s %d: no reports for %.1f ms\n", at, catlabel[note->cat], note->which, note->span * ms);
+	  break;
+	case ANANOTE_BURST:
+	  printf("  %12.6f %s %d: burst of %d reports in %.2f ms\n", at, catlabel[note->cat], note->which,
+		 ANALYZE_BURST_REPORTS, note->span * ms);
+	  break;
+	case ANANOTE_STUCK:
+	  printf("  %12.6f %s %d: button %d held %.1f s\n", at, catlabel[note->cat], note->which, note->index,
+		 note->span * ms / 1000);
+	  break;
+	default:
+	  break;
+	}
+    }
+  if (nanomalies > ANALYZE_PRINT_NOTES)
+    printf("  ... and %d more\n", nanomalies - ANALYZE_PRINT_NOTES);
+  if (total->lostnotes)
+    printf("  (%ld hotplug events and anomalies not kept)\n", total->lostnotes);
+  if (total->devs_full)
+    printf("\nMore than %d devices; the rest were not analyzed.\n", ANALYZE_MAX_DEVICES);
+}
+
+static
+void analyze_chunk_alloc (anachunk_t * chunk)
+{
+  chunk->devs = SDL_calloc(ANALYZE_MAX_DEVICES, sizeof(anadev_t));
+  chunk->notes = SDL_malloc(2 * ANALYZE_MAX_NOTES * sizeof(ananote_t));
+  if (!chunk->devs || !chunk->notes)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in analyze.chunk");
+      abort();
+    }
+}
+
+/* Analyze capture on nthreads threads (0 for all cores) and print report; returns 0 on success. */
+int analyze_run (const char * path, int nthreads)
+{
+  evcapture_header_t hdr;
+  evfeed_record_t first;
+  SDL_memset(&first, 0, sizeof(first));
+  Uint64 started = SDL_GetPerformanceCounter();
+  SDL_RWops * io = SDL_RWFromFile(path, "rb");
+  if (!io)
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Unable to open capture file '%s'.", path);
+      return 2;
+    }
+  Sint64 size = SDL_RWsize(io);
+  char * meta = NULL;
+  size_t got = SDL_RWread(io, &hdr, sizeof(hdr), 1);
+  if ((got < 1) || (hdr.magic != EVCAPTURE_MAGIC) || (hdr.version < 1) || (hdr.version > EVCAPTURE_VERSION)
+      || (hdr.recsize != sizeof(evfeed_record_t)) || (hdr.frequency == 0)
+      || (hdr.metasize > CAPTURE_META_MAX) || (size < (Sint64)(sizeof(hdr) + hdr.metasize)))
+    {
+      SDL_RWclose(io);
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "'%s' is not a capture file of this version.", path);
+      return 2;
+    }
+  meta = SDL_calloc(1, hdr.metasize + 1);
+  if (! meta)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in analyze.run");
+      abort();
+    }
+  if (hdr.metasize)
+    SDL_RWread(io, meta, hdr.metasize, 1);
+  SDL_RWread(io, &first, sizeof(first), 1);
+  SDL_RWclose(io);
+  Sint64 offset = sizeof(hdr) + hdr.metasize;
+  Sint64 nrecords = (size - offset) / (Sint64)sizeof(evfeed_record_t);
+
+  int nchunks = nthreads ? nthreads : SDL_GetCPUCount();
+  if (nchunks > ANALYZE_MAX_THREADS)
+    nchunks = ANALYZE_MAX_THREADS;
+  if (nchunks > nrecords / ANALYZE_MIN_CHUNK)
+    nchunks = (int)(nrecords / ANALYZE_MIN_CHUNK);
+  if (nchunks < 1)
+    nchunks = 1;
+
+  anachunk_t total;
+  anachunk_t * chunks = SDL_calloc(nchunks, sizeof(anachunk_t));
+  if (! chunks)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in analyze.run");
+      abort();
+    }
+  SDL_memset(&total, 0, sizeof(total));
+  total.us_per_tick = 1000000.0 / hdr.frequency;
+  total.gap_ticks = hdr.frequency * ANALYZE_GAP_MS / 1000;
+  total.burst_ticks = hdr.frequency * ANALYZE_BURST_MS / 1000;
+  total.stuck_ticks = hdr.frequency * ANALYZE_STUCK_MS / 1000;
+  analyze_chunk_alloc(&total);
+
+  for (int i = 0; i < nchunks; i++)
+    {
+      anachunk_t * chunk = chunks + i;
+      *chunk = total;
+      analyze_chunk_alloc(chunk);
+      chunk->path = path;
+      chunk->offset = offset;
+      chunk->start = nrecords * i / nchunks;
+      chunk->count = nrecords * (i + 1) / nchunks - chunk->start;
+      chunk->thread = SDL_CreateThread(analyze_thread, "analyze", chunk);
+      if (! chunk->thread)
+	analyze_thread(chunk);
+    }
+  int failed = 0;
+  for (int i = 0; i < nchunks; i++)
+    {
+      if (chunks[i].thread)
+	SDL_WaitThread(chunks[i].thread, NULL);
+      failed |= chunks[i].failed;
+      analyze_merge(&total, chunks + i);
+      SDL_free(chunks[i].devs);
+      SDL_free(chunks[i].notes);
+    }
+  SDL_free(chunks);
+
+  /* presses still open at the end of the capture. */
+  for (int i = 0; i < total.ndevs; i++)
+    {
+      anadev_t * dev = total.devs + i;
+      for (int b = 0; b < ANALYZE_MAX_BUTTONS; b++)
+	{
+	  Uint64 down = dev->buttons[b].down;
+	  if (down && (dev->last - down > total.stuck_ticks))
+	    analyze_note(&total, down, ANANOTE_STUCK, dev->cat, dev->which, b, dev->last - down);
+	}
+    }
+  analyze_trim_notes(&total);
+
+  double elapsed = (SDL_GetPerformanceCounter() - started) / (double)SDL_GetPerformanceFrequency();
+  printf("%s: %lld events, analyzed in %.3f s on %d threads.\n", path, (long long)nrecords, elapsed, nchunks);
+  if (failed)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "'%s' could not be read completely.", path);
+  if (meta[0])
+    printf("\nAttached at start (instance, kind, GUID, name):\n%s", meta);
+  SDL_free(meta);
+  analyze_print(&total, first.counter);
+  SDL_free(total.devs);
+  SDL_free(total.notes);
+  return failed ? 2 : 0;
+}
+
+
+
+/* Controller mapping database: streamed load, GUID index, live reload. */
+
+/* Normalize GUID string into lookup key.
+   Bytes 2-3 of newer SDL GUIDs carry a CRC of the device name, which database entries usually leave as zero; SDL matches either way, so the key ignores them. */
+static
+void mapdb_guidkey (char key[32], const char * guid)
+{
+  SDL_memcpy(key, guid, 32);
+  SDL_memcpy(key + 4, "0000", 4);
+}
+
+static
+int mapent_cmp (const void * a, const void * b)
+{
+  const mapent_t * ea = (const mapent_t*)a;
+  const mapent_t * eb = (const mapent_t*)b;
+  int cmp = SDL_memcmp(ea->key, eb->key, sizeof(ea->key));
+  if (cmp) return cmp;
+  return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+static
+int mapdb_key_cmp (const void * a, const void * b)
+{
+  return SDL_memcmp(a, b, 32);
+}
+
+/* Is key among sorted array of keys? */
+static
+SDL_bool mapdb_key_in (const char key[32], const char (*keys)[32], int nkeys)
+{
+  int lo = 0, hi = nkeys;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      int cmp = SDL_memcmp(keys[mid], key, 32);
+      if (cmp == 0)
+	return SDL_TRUE;
+      if (cmp < 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return SDL_FALSE;
+}
+
+/* Find last (i.e. overriding) index entry for key, or NULL. */
+static
+mapent_t * mapdb_find (mapdb_t * mapdb, const char key[32])
+{
+  int lo = 0, hi = mapdb->nentries;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      if (SDL_memcmp(mapdb->entries[mid].key, key, 32) <= 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  if ((lo > 0) && (0 == SDL_memcmp(mapdb->entries[lo-1].key, key, 32)))
+    return mapdb->entries + lo - 1;
+  return NULL;
+}
+
+/* Does mapping line apply to this platform? Lines without a platform field apply everywhere. */
+static
+SDL_bool mapdb_platform_p (const char * line)
+{
+  const char * field = SDL_strstr(line, "platform:");
+  if (!field)
+    return SDL_TRUE;
+  field += 9;
+  const char * platform = SDL_GetPlatform();
+  int n = SDL_strlen(platform);
+  return (0 == SDL_strncmp(field, platform, n)) && ((field[n] == ',') || (field[n] == '\0'));
+}
+
+/* Examine one complete line from database stream. */
+static
+void mapdb_line (mapdb_t * mapdb, char * line, int len, long offset,
+		 const char (*connected)[32], int nconnected)
+{
+  if ((len < 33) || (line[0] == '#') || (line[32] != ','))
+    return;
+  line[len] = '\0';
+  if (! mapdb_platform_p(line))
+    return;
+  mapdb->nlines++;
+
+  char key[32];
+  mapdb_guidkey(key, line);
+  if (mapdb_key_in(key, connected, nconnected))
+    {
+      if (SDL_GameControllerAddMapping(line) >= 0)
+	mapdb->napplied++;
+      return;
+    }
+  if (! mapdb->path)
+    return;  /* stdin cannot be re-read at hotplug time. */
+
+  if (mapdb->nentries >= mapdb->alloc)
+    {
+      int newalloc = mapdb->alloc ? (mapdb->alloc * 2) : 256;
+      mapent_t * grown = SDL_realloc(mapdb->entries, newalloc * sizeof(mapent_t));
+      if (!grown)
+	{
+	  SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in mapdb.line");
+	  abort();
+	}
+      mapdb->entries = grown;
+      mapdb->alloc = newalloc;
+    }
+  mapent_t * ent = mapdb->entries + mapdb->nentries++;
+  SDL_memcpy(ent->key, key, sizeof(ent->key));
+  ent->offset = offset;
+  ent->len = len;
+}
+
+/* Stream mapping database: apply lines for connected devices, index the rest.
+   Returns number of mappings applied, or -1 on error. */
+int mapdb_load (mapdb_t * mapdb)
+{
+  Uint64 t0 = SDL_GetPerformanceCounter();
+  SDL_RWops * io = mapdb->path ? SDL_RWFromFile(mapdb->path, "rb") : SDL_RWFromFP(stdin, SDL_FALSE);
+  if (!io)
+    {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Error loading mappings from '%s': %s", mapdb->path, SDL_GetError());
+      return -1;
+    }
+
+  /* GUID keys of connected devices, sorted for lookup. */
+  int nconnected = SDL_NumJoysticks();
+  char (*connected)[32] = SDL_malloc((nconnected > 0 ? nconnected : 1) * 32);
+  char * chunk = SDL_malloc(MAPDB_CHUNK);
+  char * line = SDL_malloc(MAPDB_MAX_LINE + 1);
+  if (!connected || !chunk || !line)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in mapdb.load");
+      abort();
+    }
+  for (int i = 0; i < nconnected; i++)
+    {
+      char guid[33];
+      SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(i), guid, sizeof(guid));
+      mapdb_guidkey(connected[i], guid);
+    }
+  SDL_qsort(connected, nconnected, 32, mapdb_key_cmp);
+
+  mapdb->nlines = 0;
+  mapdb->napplied = 0;
+  mapdb->nentries = 0;
+
+  long offset = 0;     /* stream offset of current chunk. */
+  long linestart = 0;  /* stream offset of current line. */
+  int linelen = 0;
+  SDL_bool overlong = SDL_FALSE;
+  size_t n;
+  while ((n = SDL_RWread(io, chunk, 1, MAPDB_CHUNK)) > 0)
+    {
+      for (size_t i = 0; i < n; i++)
+	{
+	  char c = chunk[i];
+	  if ((c == '\n') || (c == '\r'))
+	    {
+	      if (overlong)
+		SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Skipping overlong mapping at offset %ld.", linestart);
+	      else if (linelen > 0)
+		mapdb_line(mapdb, line, linelen, linestart, (const char (*)[32])connected, nconnected);
+	      linelen = 0;
+	      overlong = SDL_FALSE;
+	      linestart = offset + i + 1;
+	    }
+	  else if (linelen < MAPDB_MAX_LINE)
+	    line[linelen++] = c;
+	  else
+	    overlong = SDL_TRUE;
+	}
+      offset += n;
+    }
+  if ((linelen > 0) && !overlong)
+    mapdb_line(mapdb, line, linelen, linestart, (const char (*)[32])connected, nconnected);
+
+  SDL_RWclose(io);
+  SDL_free(line);
+  SDL_free(chunk);
+  SDL_free(connected);
+
+  SDL_qsort(mapdb->entries, mapdb->nentries, sizeof(mapent_t), mapent_cmp);
+
+  double ms = (double)(SDL_GetPerformanceCounter() - t0) * 1000.0 / SDL_GetPerformanceFrequency();
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+	      "Loaded mappings from '%s' in %.2f ms: %d for this platform, %d applied, %d indexed for hotplug.",
+	      mapdb->path ? mapdb->path : "(stdin)", ms, mapdb->nlines, mapdb->napplied, mapdb->nentries);
+  return mapdb->napplied;
+}
+
+/* Apply indexed mapping for a newly attached device, if database has one.
+   Returns 1 if a mapping was applied. */
+int mapdb_apply (mapdb_t * mapdb, const char * guid)
+{
+  char key[32];
+  if (!mapdb->nentries || (SDL_strlen(guid) < 32))
+    return 0;
+  mapdb_guidkey(key, guid);
+  mapent_t * ent = mapdb_find(mapdb, key);
+  if (!ent)
+    return 0;
+
+  char line[MAPDB_MAX_LINE + 1];
+  SDL_RWops * io = SDL_RWFromFile(mapdb->path, "rb");
+  if (!io)
+    return 0;
+  int ok = (SDL_RWseek(io, ent->offset, RW_SEEK_SET) == ent->offset)
+    && (SDL_RWread(io, line, 1, ent->len) == (size_t)ent->len);
+  SDL_RWclose(io);
+  char linekey[32];
+  if (ok)
+    mapdb_guidkey(linekey, line);
+  if (!ok || (line[32] != ',') || SDL_memcmp(linekey, key, 32))
+    {
+      /* file changed since indexed, not yet seen by mapdb_poll(); rescan, which applies any mapping for connected devices. */
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Mapping file '%s' changed; rescanning for %s.", mapdb->path, guid);
+      mapdb_load(mapdb);
+      char * mapping = SDL_GameControllerMappingForGUID(SDL_JoystickGetGUIDFromString(guid));
+      int applied = (mapping != NULL);
+      SDL_free(mapping);
+      return applied;
+    }
+  line[ent->len] = '\0';
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Applying indexed mapping for %s.", guid);
+  return (SDL_GameControllerAddMapping(line) >= 0);
+}
+
+#ifdef HAVE_INOTIFY
+/* Watch database's directory, so replace-by-rename saves (most editors) are seen too. */
+int mapdb_watch (mapdb_t * mapdb)
+{
+  mapdb->watch_fd = -1;
+  if (! mapdb->path)
+    return -1;
+  char dir[4096];
+  SDL_snprintf(dir, sizeof(dir), "%s", mapdb->path);
+  char * sep = SDL_strrchr(dir, '/');
+  if (sep)
+    sep[sep == dir ? 1 : 0] = '\0';
+  else
+    SDL_snprintf(dir, sizeof(dir), ".");
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to watch '%s' for mapping changes.", dir);
+      close(fd);
+      return -1;
+    }
+  mapdb->watch_fd = fd;
+  return fd;
+}
+
+/* Reload database if file changed since last poll.  Returns 1 if reloaded. */
+int mapdb_poll (mapdb_t * mapdb, long t)
+{
+  if ((mapdb->watch_fd < 0) || (t - mapdb->last_poll < MAPDB_POLL_PERIOD))
+    return 0;
+  mapdb->last_poll = t;
+
+  const char * base = SDL_strrchr(mapdb->path, '/');
+  base = base ? base + 1 : mapdb->path;
+  SDL_bool changed = SDL_FALSE;
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while ((n = read(mapdb->watch_fd, buf, sizeof(buf))) > 0)
+    {
+      for (char * p = buf; p < buf + n; )
+	{
+	  struct inotify_event * ev = (struct inotify_event*)p;
+	  if (ev->len && (0 == SDL_strcmp(ev->name, base)))
+	    changed = SDL_TRUE;
+	  p += sizeof(struct inotify_event) + ev->len;
+	}
+    }
+  if (!changed)
+    return 0;
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Mapping file '%s' changed; reloading.", mapdb->path);
+  /* changed mappings of open controllers raise SDL_CONTROLLERDEVICEREMAPPED. */
+  mapdb_load(mapdb);
+  return 1;
+}
+#else
+int mapdb_watch (mapdb_t * mapdb)
+{
+  mapdb->watch_fd = -1;
+  return -1;
+}
+
+int mapdb_poll (mapdb_t * mapdb, long t)
+{
+  (void)mapdb;
+  (void)t;
+  return 0;
+}
+#endif /* HAVE_INOTIFY */
+
+mapdb_t * mapdb_destroy (mapdb_t * mapdb)
+{
+  if (mapdb->watch_fd >= 0)
+    close(mapdb->watch_fd);
+  mapdb->watch_fd = -1;
+  SDL_free(mapdb->entries);
+  mapdb->entries = NULL;
+  mapdb->nentries = mapdb->alloc = 0;
+  return mapdb;
+}
+
+
+
+/* Mark end of a startup phase (--trace-startup). */
+void app_startup_phase (app_t * app, const char * name)
+{
+  struct startup_s * startup = &app->startup;
+  if (startup->nphases >= MAX_STARTUP_PHASES)
+    return;
+  startup->names[startup->nphases] = name;
+  startup->stamps[startup->nphases] = SDL_GetPerformanceCounter();
+  startup->nphases++;
+}
+
+/* Log startup phase durations, once first frame is on screen. */
+void app_startup_report (app_t * app)
+{
+  struct startup_s * startup = &app->startup;
+  if (!startup->trace || (startup->nphases < 2))
+    return;
+  const double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+  for (int i = 1; i < startup->nphases; i++)
+    {
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "startup: %-12s %8.3f ms",
+		  startup->names[i],
+		  (startup->stamps[i] - startup->stamps[i-1]) * ms_per_tick);
+    }
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "startup: %-12s %8.3f ms", "total",
+	      (startup->stamps[startup->nphases-1] - startup->stamps[0]) * ms_per_tick);
+  startup->trace = SDL_FALSE;
+}
+
+/* Locate font data (built-in, or whole font file read into memory), and start TTF.
+   Deferred until some text is not covered by the glyph atlas. */
+static
+int app_font_data (app_t * app)
+{
+  if (app->font_data)
+    return 0;
+  app->fontlock = SDL_CreateMutex();
+  if (! app->fontlock)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed mutex in app.font_data");
+      abort();
+    }
+  TTF_Init();
+
+  if (ttf0_size > 0)
+    {
+      /* use built-in font. */
+      app->font_data = ttf0_data;
+      app->font_size = ttf0_size;
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Using built-in font.");
+      return 0;
+    }
+
+  /* search for suitable font file. */
+#ifdef _PC_PATH_MAX
+  const int max_pathlen = pathconf("/", _PC_PATH_MAX);
+#else
+  const int max_pathlen = 4096; /* something sensible as of Y2013. */
+#endif /* _PC_PATH_MAX */
+  char * fqpn_font = SDL_malloc(max_pathlen);
+  SDL_RWops * rw = find_path_to_ttf_file(DEFAULT_FONT_FILENAME, fqpn_font, max_pathlen);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Using font file '%s'", fqpn_font);
+  SDL_free(fqpn_font);
+  if (! rw)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to open any font file.");
+      abort();
+    }
+
+  /* whole file in memory, so each rasterization thread can open its own instance. */
+  Sint64 size = SDL_RWsize(rw);
+  app->font_buf = (size > 0) ? SDL_malloc(size) : NULL;
+  if (!app->font_buf || (SDL_RWread(rw, app->font_buf, 1, size) != (size_t)size))
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to read font file.");
+      abort();
+    }
+  SDL_RWclose(rw);
+  app->font_data = app->font_buf;
+  app->font_size = size;
+  return 0;
+}
+
+/* Open TTF fonts for main thread. */
+static
+int app_load_fonts (app_t * app)
+{
+  app_font_data(app);
+  app->font_io[0] = SDL_RWFromConstMem(app->font_data, app->font_size);
+  if (! app->font_io[0])
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to open any font file.");
+      abort();
+    }
+  SDL_LockMutex(app->fontlock);
+  for (int i = 0; i < MAX_FONTS; i++)
+    {
+      app->fonts[i] = res_font(TTF_OpenFontRW(app->font_io[0], 0/*do not auto-close*/, fontsizes[i]));
+    }
+  SDL_UnlockMutex(app->fontlock);
+
+  /* Do not close the RW until TTF lib shuts down. */
+  return 0;
+}
+
+/* Font for slot, opening fonts on first use. */
+TTF_Font * app_get_font (app_t * app, int fontnum)
+{
+  if (! app->font_io[0])
+    app_load_fonts(app);
+  return app->fonts[fontnum];
+}
+
+#ifdef HAVE_GLYPH_ATLAS
+/* Decode one UTF-8 sequence, advancing *pp; malformed input yields U+FFFD. */
+static
+Uint32 utf8_next (const char ** pp)
+{
+  const unsigned char * p = (const unsigned char*)*pp;
+  Uint32 cp = *p++;
+  int extra = 0;
+  if (cp >= 0xf0) { cp &= 0x07; extra = 3; }
+  else if (cp >= 0xe0) { cp &= 0x0f; extra = 2; }
+  else if (cp >= 0xc0) { cp &= 0x1f; extra = 1; }
+  else if (cp >= 0x80) { cp = 0xfffd; }
+  while (extra-- > 0)
+    {
+      if ((*p & 0xc0) != 0x80)
+	{
+	  cp = 0xfffd;
+	  break;
+	}
+      cp = (cp << 6) | (*p++ & 0x3f);
+    }
+  *pp = (const char*)p;
+  return cp;
+}
+
+/* Index of codepoint's cell in glyph atlas, or -1 if not baked. */
+static
+int atlas_index (Uint32 cp)
+{
+  if ((0x20 <= cp) && (cp < 0x7f))
+    return cp - 0x20;
+  for (int i = 0x7f - 0x20; i < GLYPH_ATLAS_COUNT; i++)
+    {
+      if (glyph_atlas_codepoints[i] == cp)
+	return i;
+    }
+  return -1;
+}
+
+/* Compose text from prebaked glyph cells; white with coverage as alpha (ARGB8888), or bare coverage (INDEX8).
+   Returns NULL if any glyph is not in the atlas. */
+static
+SDL_Surface * atlas_render (const char * msg, Uint32 format)
+{
+  int ncells = 0;
+  const char * p = msg;
+  while (*p)
+    {
+      Uint32 cp = utf8_next(&p);
+      if (atlas_index(cp) < 0)
+	return NULL;
+      /* combining marks overlay previous cell. */
+      if (!((0x0300 <= cp) && (cp < 0x0370)) || (ncells == 0))
+	ncells++;
+    }
+  if (ncells == 0)
+    return NULL;
+
+  SDL_bool mask = (format == SDL_PIXELFORMAT_INDEX8);
+  SDL_Surface * surf = res_surface(SDL_CreateRGBSurfaceWithFormat(0, ncells * GLYPH_ATLAS_CELL_W, GLYPH_ATLAS_CELL_H, mask ? 8 : 32, format));
+  if (! surf)
+    return NULL;
+
+  int cell = -1;
+  for (p = msg; *p; )
+    {
+      Uint32 cp = utf8_next(&p);
+      SDL_bool combining = (0x0300 <= cp) && (cp < 0x0370);
+      if (!combining || (cell < 0))
+	cell++;
+      const Uint8 * cov = glyph_atlas_coverage[atlas_index(cp)];
+      for (int y = 0; y < GLYPH_ATLAS_CELL_H; y++)
+	{
+	  Uint8 * base = (Uint8*)surf->pixels + y * surf->pitch;
+	  if (mask)
+	    {
+	      Uint8 * row = base + cell * GLYPH_ATLAS_CELL_W;
+	      for (int x = 0; x < GLYPH_ATLAS_CELL_W; x++)
+		{
+		  Uint8 a = *cov++;
+		  if (!combining || (a > row[x]))
+		    row[x] = a;
+		}
+	      continue;
+	    }
+	  Uint32 * row = (Uint32*)base + cell * GLYPH_ATLAS_CELL_W;
+	  for (int x = 0; x < GLYPH_ATLAS_CELL_W; x++)
+	    {
+	      Uint32 a = *cov++;
+	      if (combining)
+		{
+		  Uint32 prev = row[x] >> 24;
+		  a = (a > prev) ? a : prev;
+		}
+	      row[x] = (a << 24) | 0x00ffffff;
+	    }
+	}
+    }
+  return surf;
+}
+#endif /* HAVE_GLYPH_ATLAS */
+
+/* Reduce ARGB8888 text to its alpha channel as INDEX8 coverage mask; frees input. */
+static
+SDL_Surface * coverage_from_argb (SDL_Surface * textsurf)
+{
+  if (! textsurf)
+    return NULL;
+  SDL_Surface * surf = res_surface(SDL_ConvertSurfaceFormat(textsurf, SDL_PIXELFORMAT_ARGB8888, 0));
+  res_free_surface(textsurf);
+  if (! surf)
+    return NULL;
+  SDL_Surface * mask = res_surface(SDL_CreateRGBSurfaceWithFormat(0, surf->w, surf->h, 8, SDL_PIXELFORMAT_INDEX8));
+  if (mask)
+    {
+      for (int y = 0; y < surf->h; y++)
+	{
+	  const Uint32 * src = (const Uint32*)((const Uint8*)surf->pixels + y * surf->pitch);
+	  Uint8 * dst = (Uint8*)mask->pixels + y * mask->pitch;
+	  for (int x = 0; x < surf->w; x++)
+	    dst[x] = src[x] >> 24;
+	}
+    }
+  res_free_surface(surf);
+  return mask;
+}
+
+/* Rasterize text in white from glyph atlas, as coverage mask (INDEX8) if mask;
+   NULL if font size or some glyph is not in the atlas.  Safe on any thread. */
+static
+SDL_Surface * raster_atlas (int fontnum, const char * msg, SDL_bool mask)
+{
+#ifdef HAVE_GLYPH_ATLAS
+  if (fontsizes[fontnum] == GLYPH_ATLAS_PTSIZE)
+    return atlas_render(msg, mask ? SDL_PIXELFORMAT_INDEX8 : SDL_PIXELFORMAT_ARGB8888);
+#else
+  (void)fontnum;
+  (void)msg;
+  (void)mask;
+#endif /* HAVE_GLYPH_ATLAS */
+  return NULL;
+}
+
+/* Rasterize text in white by TTF, as coverage mask (INDEX8) if mask.
+   Font must belong to calling thread. */
+static
+SDL_Surface * raster_ttf (TTF_Font * font, const char * msg, SDL_bool mask)
+{
+  SDL_Color fg = { 0xff, 0xff, 0xff, 0xff };
+  PROBE1(raster_start, msg);
+  SDL_Surface * textsurf = font ? res_surface(TTF_RenderUTF8_Blended(font, msg, fg)) : NULL;
+  if (font)
+    SDL_AtomicAdd(&resstats.rasterized, 1);
+  PROBE3(raster_done, msg, textsurf ? textsurf->w : 0, textsurf ? textsurf->h : 0);
+  return mask ? coverage_from_argb(textsurf) : textsurf;
+}
+
+/* Rasterize text in white; from glyph atlas when possible, else by TTF.
+   When compositing on CPU, yields coverage mask (INDEX8) instead. */
+SDL_Surface * app_render_text (app_t * app, int fontnum, const char * msg)
+{
+  if (!msg || !*msg)
+    return NULL;
+  SDL_Surface * surf = raster_atlas(fontnum, msg, app->comp.active);
+  if (surf)
+    return surf;
+  TTF_Font * font = app_get_font(app, fontnum);
+  SDL_LockMutex(app->fontlock);
+  surf = raster_ttf(font, msg, app->comp.active);
+  SDL_UnlockMutex(app->fontlock);
+  return surf;
+}
+
+/* Worker's own font instance for slot, opened on first use. */
+static
+TTF_Font * raster_font (rasterworker_t * worker, int fontnum)
+{
+  if (! worker->fonts[fontnum])
+    {
+      rasterpool_t * pool = worker->pool;
+      SDL_LockMutex(pool->fontlock);
+      SDL_RWops * rw = SDL_RWFromConstMem(pool->font_data, pool->font_size);
+      worker->fonts[fontnum] = rw ? res_font(TTF_OpenFontRW(rw, 1/*auto-close*/, fontsizes[fontnum])) : NULL;
+      SDL_UnlockMutex(pool->fontlock);
+    }
+  return worker->fonts[fontnum];
+}
+
+static
+int raster_thread (void * data)
+{
+  rasterworker_t * worker = data;
+  rasterpool_t * pool = worker->pool;
+  trace_thread("raster");
+
+  SDL_LockMutex(pool->lock);
+  for (;;)
+    {
+      while (pool->alive && (pool->njobs == 0))
+	SDL_CondWait(pool->jobcond, pool->lock);
+      if (! pool->alive)
+	break;
+      rasterjob_t job = pool->jobs[pool->jobhead];
+      pool->jobhead = (pool->jobhead + 1) % RASTER_QUEUE_LEN;
+      pool->njobs--;
+      SDL_UnlockMutex(pool->lock);
+
+      TRACE_BEGIN(TRACE_RASTER_JOB);
+      job.surf = raster_atlas(job.fontnum, job.text, job.mask);
+      if (! job.surf)
+	job.surf = raster_ttf(raster_font(worker, job.fontnum), job.text, job.mask);
+      TRACE_END(TRACE_RASTER_JOB);
+
+      SDL_LockMutex(pool->lock);
+      /* cannot overflow: outstanding jobs are capped at RASTER_QUEUE_LEN. */
+      pool->done[(pool->donehead + pool->ndone) % RASTER_QUEUE_LEN] = job;
+      pool->ndone++;
+    }
+  SDL_UnlockMutex(pool->lock);
+
+  SDL_LockMutex(pool->fontlock);
+  for (int i = 0; i < MAX_FONTS; i++)
+    {
+      if (worker->fonts[i])
+	res_close_font(worker->fonts[i]);
+      worker->fonts[i] = NULL;
+    }
+  SDL_UnlockMutex(pool->fontlock);
+  return 0;
+}
+
+/* Start worker threads over in-memory font data, taking fontlock around TTF calls; returns number running. */
+int rasterpool_start (rasterpool_t * pool, const void * font_data, size_t font_size, SDL_mutex * fontlock)
+{
+  int n = pool->nthreads;
+  if (n < 0)
+    {
+      /* leave a core for the main thread. */
+      n = SDL_GetCPUCount() - 1;
+      if (n < 1) n = 1;
+      if (n > 4) n = 4;
+    }
+  if (n > MAX_RASTER_THREADS)
+    n = MAX_RASTER_THREADS;
+  pool->font_data = font_data;
+  pool->font_size = font_size;
+  pool->lock = SDL_CreateMutex();
+  pool->fontlock = fontlock;
+  pool->jobcond = SDL_CreateCond();
+  if (!pool->lock || !pool->fontlock || !pool->jobcond)
+    return 0;
+  pool->alive = SDL_TRUE;
+  for (int i = 0; i < n; i++)
+    {
+      rasterworker_t * worker = pool->workers + pool->nworkers;
+      worker->pool = pool;
+      worker->thread = SDL_CreateThread(raster_thread, "raster", worker);
+      if (! worker->thread)
+	break;
+      pool->nworkers++;
+    }
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Rasterizing text on %d threads.", pool->nworkers);
+  return pool->nworkers;
+}
+
+/* Queue job; returns -1 if too many are in flight (retry next frame). */
+int rasterpool_submit (rasterpool_t * pool, const rasterjob_t * job)
+{
+  if (pool->outstanding >= RASTER_QUEUE_LEN)
+    return -1;
+  pool->outstanding++;
+  SDL_LockMutex(pool->lock);
+  pool->jobs[(pool->jobhead + pool->njobs) % RASTER_QUEUE_LEN] = *job;
+  pool->njobs++;
+  SDL_CondSignal(pool->jobcond);
+  SDL_UnlockMutex(pool->lock);
+  return 0;
+}
+
+/* Take up to max finished jobs; returns number taken. */
+int rasterpool_collect (rasterpool_t * pool, rasterjob_t * out, int max)
+{
+  int n = 0;
+  SDL_LockMutex(pool->lock);
+  while ((n < max) && (pool->ndone > 0))
+    {
+      out[n++] = pool->done[pool->donehead];
+      pool->donehead = (pool->donehead + 1) % RASTER_QUEUE_LEN;
+      pool->ndone--;
+    }
+  SDL_UnlockMutex(pool->lock);
+  pool->outstanding -= n;
+  return n;
+}
+
+/* Stop workers, dropping unfinished jobs and uncollected results. */
+int rasterpool_stop (rasterpool_t * pool)
+{
+  if (pool->lock)
+    {
+      SDL_LockMutex(pool->lock);
+      pool->alive = SDL_FALSE;
+      SDL_CondBroadcast(pool->jobcond);
+      SDL_UnlockMutex(pool->lock);
+    }
+  for (int i = 0; i < pool->nworkers; i++)
+    SDL_WaitThread(pool->workers[i].thread, NULL);
+  pool->nworkers = 0;
+  for (; pool->ndone > 0; pool->ndone--)
+    {
+      res_free_surface(pool->done[pool->donehead].surf);
+      pool->donehead = (pool->donehead + 1) % RASTER_QUEUE_LEN;
+    }
+  pool->njobs = 0;
+  pool->outstanding = 0;
+  if (pool->jobcond)
+    SDL_DestroyCond(pool->jobcond);
+  if (pool->lock)
+    SDL_DestroyMutex(pool->lock);
+  pool->jobcond = NULL;
+  pool->fontlock = NULL;
+  pool->lock = NULL;
+  return 0;
+}
+
+
+/* Blend white text into opaque ARGB8888 pixels: per channel dst += (255 - dst) * a / 256,
+   where a is coverage scaled by alpha, mapped to 0..256.  Kernels must agree bit for bit. */
+typedef void (*blend_span_fn) (Uint32 * dst, const Uint8 * cov, int n, unsigned alpha);
+
+static
+void blend_span_c (Uint32 * dst, const Uint8 * cov, int n, unsigned alpha)
+{
+  for (int i = 0; i < n; i++)
+    {
+      unsigned a = cov[i] * alpha;
+      a = (a + (a >> 8) + 0x80) >> 8;
+      if (! a)
+	continue;
+      a += a >> 7;
+      Uint32 rb = dst[i] & 0x00ff00ff;
+      Uint32 g = dst[i] & 0x0000ff00;
+      rb += (((0x00ff00ff - rb) * a) >> 8) & 0x00ff00ff;
+      g += (((0x0000ff00 - g) * a) >> 8) & 0x0000ff00;
+      dst[i] = 0xff000000 | rb | g;
+    }
+}
+
+#ifdef __SSE2__
+/* 4 pixels per step. */
+static
+void blend_span_sse2 (Uint32 * dst, const Uint8 * cov, int n, unsigned alpha)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i full = _mm_set1_epi16(0xff);
+  const __m128i round = _mm_set1_epi16(0x80);
+  const __m128i va = _mm_set1_epi16(alpha);
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      int c4 = cov[i] | (cov[i+1] << 8) | (cov[i+2] << 16) | ((Uint32)cov[i+3] << 24);
+      if (! c4)
+	continue;
+      __m128i a = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(c4), zero), va);
+      a = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), round), 8);
+      a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+      a = _mm_unpacklo_epi16(a, a);
+      __m128i a01 = _mm_unpacklo_epi32(a, a);  /* a0 x4, a1 x4 */
+      __m128i a23 = _mm_unpackhi_epi32(a, a);
+
+      __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+      __m128i d01 = _mm_unpacklo_epi8(d, zero);
+      __m128i d23 = _mm_unpackhi_epi8(d, zero);
+      d01 = _mm_add_epi16(d01, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(full, d01), a01), 8));
+      d23 = _mm_add_epi16(d23, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(full, d23), a23), 8));
+      _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(d01, d23));
+    }
+  blend_span_c(dst + i, cov + i, n - i, alpha);
+}
+#endif /* __SSE2__ */
+
+#ifdef HAVE_AVX2_KERNEL
+/* 8 pixels per step; selected at run time. */
+__attribute__((target("avx2")))
+static
+void blend_span_avx2 (Uint32 * dst, const Uint8 * cov, int n, unsigned alpha)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m256i full = _mm256_set1_epi16(0xff);
+  const __m128i round = _mm_set1_epi16(0x80);
+  const __m128i va = _mm_set1_epi16(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      __m128i c = _mm_loadl_epi64((const __m128i*)(cov + i));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero)) == 0xffff)
+	continue;
+      __m128i a = _mm_mullo_epi16(_mm_cvtepu8_epi16(c), va);
+      a = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), round), 8);
+      a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+      __m128i a03 = _mm_unpacklo_epi16(a, a);
+      __m128i a47 = _mm_unpackhi_epi16(a, a);
+      __m256i va03 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(a03, a03)), _mm_unpackhi_epi32(a03, a03), 1);
+      __m256i va47 = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi32(a47, a47)), _mm_unpackhi_epi32(a47, a47), 1);
+
+      __m256i d = _mm256_loadu_si256((const __m256i*)(dst + i));
+      __m256i d03 = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d));
+      __m256i d47 = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1));
+      d03 = _mm256_add_epi16(d03, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(full, d03), va03), 8));
+      d47 = _mm256_add_epi16(d47, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(full, d47), va47), 8));
+      /* packus interleaves 128-bit lanes; restore pixel order. */
+      d = _mm256_permute4x64_epi64(_mm256_packus_epi16(d03, d47), 0xd8);
+      _mm256_storeu_si256((__m256i*)(dst + i), d);
+    }
+  blend_span_c(dst + i, cov + i, n - i, alpha);
+}
+#endif /* HAVE_AVX2_KERNEL */
+
+#ifdef HAVE_NEON_KERNEL
+/* 8 pixels per step, channels deinterleaved by vld4. */
+static
+void blend_span_neon (Uint32 * dst, const Uint8 * cov, int n, unsigned alpha)
+{
+  const uint16x8_t full = vdupq_n_u16(0xff);
+  const uint8x8_t va = vdup_n_u8(alpha);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      uint8x8_t c = vld1_u8(cov + i);
+      if (vget_lane_u64(vreinterpret_u64_u8(c), 0) == 0)
+	continue;
+      uint16x8_t a = vmull_u8(c, va);
+      a = vrshrq_n_u16(vsraq_n_u16(a, a, 8), 8);
+      a = vsraq_n_u16(a, a, 7);
+      uint8x8x4_t d = vld4_u8((const uint8_t*)(dst + i));
+      for (int k = 0; k < 4; k++)
+	{
+	  uint16x8_t dk = vmovl_u8(d.val[k]);
+	  dk = vaddq_u16(dk, vshrq_n_u16(vmulq_u16(vsubq_u16(full, dk), a), 8));
+	  d.val[k] = vmovn_u16(dk);
+	}
+      vst4_u8((uint8_t*)(dst + i), d);
+    }
+  blend_span_c(dst + i, cov + i, n - i, alpha);
+}
+#endif /* HAVE_NEON_KERNEL */
+
+static blend_span_fn blend_span = blend_span_c;
+
+/* Select widest blend kernel supported by this CPU; returns its name. */
+static
+const char * blend_select (void)
+{
+#ifdef HAVE_AVX2_KERNEL
+  if (SDL_HasAVX2())
+    {
+      blend_span = blend_span_avx2;
+      return "AVX2";
+    }
+#endif /* HAVE_AVX2_KERNEL */
+#if defined(__SSE2__)
+  blend_span = blend_span_sse2;
+  return "SSE2";
+#elif defined(HAVE_NEON_KERNEL)
+  blend_span = blend_span_neon;
+  return "NEON";
+#else
+  blend_span = blend_span_c;
+  return "C";
+#endif
+}
+
+/* Decide whether to composite on CPU, per mode and renderer in use. */
+int composite_init (composite_t * comp, SDL_Renderer * r, enum composite_mode_e mode)
+{
+  SDL_RendererInfo rinfo;
+  SDL_bool software = r && (SDL_GetRendererInfo(r, &rinfo) == 0) && (rinfo.flags & SDL_RENDERER_SOFTWARE);
+  comp->active = (mode == COMPOSITE_ALWAYS) || ((mode == COMPOSITE_AUTO) && software);
+  if (comp->active)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Compositing on CPU (%s blend).", blend_select());
+  return comp->active;
+}
+
+/* (Re)allocate framebuffer and streaming texture to match window size. */
+int composite_resize (composite_t * comp, SDL_Renderer * r, int width, int height)
+{
+  if (!comp->active || ((comp->w == width) && (comp->h == height) && comp->fb))
+    return 0;
+  SDL_free(comp->fb);
+  if (comp->tex)
+    res_destroy_texture(comp->tex);
+  comp->fb = SDL_malloc(sizeof(Uint32) * width * height);
+  if (! comp->fb)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in composite.resize");
+      abort();
+    }
+  comp->tex = res_texture(SDL_CreateTexture(r, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height));
+  comp->w = width;
+  comp->h = height;
+  return 0;
+}
+
+composite_t * composite_destroy (composite_t * comp)
+{
+  SDL_free(comp->fb);
+  comp->fb = NULL;
+  if (comp->tex)
+    res_destroy_texture(comp->tex);
+  comp->tex = NULL;
+  comp->w = comp->h = 0;
+  return comp;
+}
+
+/* Fill framebuffer with opaque black. */
+void composite_clear (composite_t * comp)
+{
+  SDL_memset4(comp->fb, 0xff000000, comp->w * comp->h);
+}
+
+/* Vertical white line from y0 (inclusive) to y1 (exclusive); clipped. */
+void composite_vline (composite_t * comp, int x, int y0, int y1)
+{
+  if ((x < 0) || (x >= comp->w))
+    return;
+  if (y0 < 0) y0 = 0;
+  if (y1 > comp->h) y1 = comp->h;
+  for (int y = y0; y < y1; y++)
+    comp->fb[y * comp->w + x] = 0xffffffff;
+}
+
+/* Horizontal white line of w pixels from x; clipped. */
+void composite_hline (composite_t * comp, int x, int y, int w)
+{
+  if ((y < 0) || (y >= comp->h))
+    return;
+  int x0 = (x < 0) ? 0 : x;
+  int x1 = (x + w > comp->w) ? comp->w : x + w;
+  if (x0 < x1)
+    SDL_memset4(comp->fb + y * comp->w + x0, 0xffffffff, x1 - x0);
+}
+
+/* Blend coverage mask (INDEX8) as white text at x,y with alpha; clipped. */
+void composite_blit (composite_t * comp, int x, int y, SDL_Surface * mask, unsigned alpha)
+{
+  int x0 = (x < 0) ? 0 : x;
+  int x1 = (x + mask->w > comp->w) ? comp->w : x + mask->w;
+  int y0 = (y < 0) ? 0 : y;
+  int y1 = (y + mask->h > comp->h) ? comp->h : y + mask->h;
+  if ((x0 >= x1) || (alpha == 0))
+    return;
+  for (int row = y0; row < y1; row++)
+    {
+      const Uint8 * cov = (const Uint8*)mask->pixels + (row - y) * mask->pitch + (x0 - x);
+      blend_span(comp->fb + row * comp->w + x0, cov, x1 - x0, alpha);
+    }
+}
+
+#ifdef HAVE_GLYPH_ATLAS
+/* Blend text straight from glyph atlas cells, no intermediate surface; -1 if any glyph is not in the atlas. */
+int composite_glyphs (composite_t * comp, int x, int y, const char * msg, unsigned alpha)
+{
+  for (const char * p = msg; *p; )
+    {
+      if (atlas_index(utf8_next(&p)) < 0)
+	return -1;
+    }
+  int y0 = (y < 0) ? 0 : y;
+  int y1 = (y + GLYPH_ATLAS_CELL_H > comp->h) ? comp->h : y + GLYPH_ATLAS_CELL_H;
+  if ((y0 >= y1) || (alpha == 0))
+    return 0;
+  int cell = -1;
+  for (const char * p = msg; *p; )
+    {
+      Uint32 cp = utf8_next(&p);
+      /* combining marks overlay previous cell. */
+      if (!((0x0300 <= cp) && (cp < 0x0370)) || (cell < 0))
+	cell++;
+      if (cp == ' ')
+	continue;
+      int cx = x + cell * GLYPH_ATLAS_CELL_W;
+      int x0 = (cx < 0) ? 0 : cx;
+      int x1 = (cx + GLYPH_ATLAS_CELL_W > comp->w) ? comp->w : cx + GLYPH_ATLAS_CELL_W;
+      if (x0 >= x1)
+	continue;
+      const Uint8 * cov = glyph_atlas_coverage[atlas_index(cp)];
+      for (int row = y0; row < y1; row++)
+	blend_span(comp->fb + row * comp->w + x0, cov + (row - y) * GLYPH_ATLAS_CELL_W + (x0 - cx), x1 - x0, alpha);
+    }
+  return 0;
+}
+#endif /* HAVE_GLYPH_ATLAS */
+
+/* Upload framebuffer (once per frame) and copy it to the render target. */
+int composite_present (composite_t * comp, SDL_Renderer * r)
+{
+  TRACE_BEGIN(TRACE_GFX_UPLOAD);
+  SDL_UpdateTexture(comp->tex, NULL, comp->fb, comp->w * sizeof(Uint32));
+  SDL_RenderCopy(r, comp->tex, NULL, NULL);
+  TRACE_END(TRACE_GFX_UPLOAD);
+  return 0;
+}
+
+
+
+/* Ensure array holds at least need elements, doubling; aborts when out of memory. */
+static
+void * grow_array (void * arr, int * alloc, int need, size_t elemsize, int initial)
+{
+  if (need <= *alloc)
+    return arr;
+  int n = *alloc ? *alloc : initial;
+  while (n < need)
+    n *= 2;
+  arr = SDL_realloc(arr, n * elemsize);
+  if (! arr)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in grow_array");
+      abort();
+    }
+  *alloc = n;
+  return arr;
+}
+
+/* Queue textured quad; src NULL for whole texture. */
+void displist_copy (displist_t * dl, SDL_Texture * tex, const SDL_Rect * src, const SDL_Rect * dst, Uint8 alpha)
+{
+  if (!tex)
+    return;
+  dl->cmds = grow_array(dl->cmds, &dl->alloc, dl->len + 1, sizeof(drawcmd_t), DISPLIST_INITIAL_CMDS);
+  drawcmd_t * cmd = dl->cmds + dl->len;
+  cmd->tex = tex;
+  if (src)
+    cmd->src = *src;
+  else
+    SDL_memset(&cmd->src, 0, sizeof(cmd->src));
+  cmd->dst = *dst;
+  cmd->alpha = alpha;
+  cmd->seq = dl->len++;
+}
+
+/* Queue solid rectangle in current draw color. */
+void displist_fill (displist_t * dl, const SDL_Rect * rect)
+{
+  dl->fills = grow_array(dl->fills, &dl->fillalloc, dl->nfills + 1, sizeof(SDL_Rect), MAX_CATEGORIES);
+  dl->fills[dl->nfills++] = *rect;
+}
+
+/* Hand over texture to be destroyed once the frame is submitted. */
+void displist_transient (displist_t * dl, SDL_Texture * tex)
+{
+  dl->transient = grow_array(dl->transient, &dl->transientalloc, dl->ntransient + 1, sizeof(SDL_Texture*), 8);
+  dl->transient[dl->ntransient++] = tex;
+}
+
+/* Order by texture, then position (duplicates adjacent), then submission. */
+static
+int drawcmd_cmp (const void * a, const void * b)
+{
+  const drawcmd_t * p = a;
+  const drawcmd_t * q = b;
+  if (p->tex != q->tex)
+    return ((uintptr_t)p->tex < (uintptr_t)q->tex) ? -1 : 1;
+  if (p->dst.y != q->dst.y)
+    return p->dst.y - q->dst.y;
+  if (p->dst.x != q->dst.x)
+    return p->dst.x - q->dst.x;
+  if (p->src.y != q->src.y)
+    return p->src.y - q->src.y;
+  if (p->src.x != q->src.x)
+    return p->src.x - q->src.x;
+  return p->seq - q->seq;
+}
+
+static
+SDL_bool drawcmd_same_p (const drawcmd_t * p, const drawcmd_t * q)
+{
+  return (p->tex == q->tex)
+    && (0 == SDL_memcmp(&p->src, &q->src, sizeof(p->src)))
+    && (0 == SDL_memcmp(&p->dst, &q->dst, sizeof(p->dst)));
+}
+
+#ifdef HAVE_RENDER_GEOMETRY
+/* One draw call for run of quads sharing a texture; fade alpha as vertex color. */
+static
+int displist_geometry (displist_t * dl, SDL_Renderer * r, const drawcmd_t * run, int n)
+{
+  /* both scratch arrays are sized in quads. */
+  int alloc = dl->quadalloc;
+  dl->verts = grow_array(dl->verts, &alloc, n, 4 * sizeof(SDL_Vertex), DISPLIST_INITIAL_CMDS);
+  dl->indices = grow_array(dl->indices, &dl->quadalloc, n, 6 * sizeof(int), DISPLIST_INITIAL_CMDS);
+
+  int texw = 1, texh = 1;
+  SDL_QueryTexture(run->tex, NULL, NULL, &texw, &texh);
+  for (int i = 0; i < n; i++)
+    {
+      const drawcmd_t * cmd = run + i;
+      SDL_Rect src = cmd->src;
+      if (src.w == 0)
+	{
+	  src.w = texw;
+	  src.h = texh;
+	}
+      float u0 = (float)src.x / texw, u1 = (float)(src.x + src.w) / texw;
+      float v0 = (float)src.y / texh, v1 = (float)(src.y + src.h) / texh;
+      float x0 = cmd->dst.x, x1 = cmd->dst.x + cmd->dst.w;
+      float y0 = cmd->dst.y, y1 = cmd->dst.y + cmd->dst.h;
+      SDL_Color color = { 0xff, 0xff, 0xff, cmd->alpha };
+      SDL_Vertex * v = dl->verts + i * 4;
+      v[0].position.x = x0; v[0].position.y = y0; v[0].tex_coord.x = u0; v[0].tex_coord.y = v0;
+      v[1].position.x = x1; v[1].position.y = y0; v[1].tex_coord.x = u1; v[1].tex_coord.y = v0;
+      v[2].position.x = x1; v[2].position.y = y1; v[2].tex_coord.x = u1; v[2].tex_coord.y = v1;
+      v[3].position.x = x0; v[3].position.y = y1; v[3].tex_coord.x = u0; v[3].tex_coord.y = v1;
+      for (int k = 0; k < 4; k++)
+	v[k].color = color;
+      int * idx = dl->indices + i * 6;
+      idx[0] = i*4 + 0; idx[1] = i*4 + 1; idx[2] = i*4 + 2;
+      idx[3] = i*4 + 0; idx[4] = i*4 + 2; idx[5] = i*4 + 3;
+    }
+  return SDL_RenderGeometry(r, run->tex, dl->verts, n * 4, dl->indices, n * 6);
+}
+#endif /* HAVE_RENDER_GEOMETRY */
+
+/* Draw the frame's commands and empty the list.
+   Fills go first; quads are grouped by texture, so order across textures is not kept
+   (only white text on black, where overlap order does not show). */
+int displist_submit (displist_t * dl, SDL_Renderer * r, struct framestats_s * stats)
+{
+  stats->cmds += dl->len + dl->nfills;
+  if (dl->nfills)
+    {
+      SDL_RenderFillRects(r, dl->fills, dl->nfills);
+      stats->drawcalls++;
+    }
+
+  SDL_qsort(dl->cmds, dl->len, sizeof(drawcmd_t), drawcmd_cmp);
+  int len = 0;
+  for (int i = 0; i < dl->len; i++)
+    {
+      if ((i + 1 < dl->len) && drawcmd_same_p(dl->cmds + i, dl->cmds + i + 1))
+	{
+	  stats->dropped++;
+	  continue;
+	}
+      dl->cmds[len++] = dl->cmds[i];
+    }
+
+  for (int i = 0, j; i < len; i = j)
+    {
+      for (j = i + 1; (j < len) && (dl->cmds[j].tex == dl->cmds[i].tex); j++)
+	;
+      stats->switches++;
+#ifdef HAVE_RENDER_GEOMETRY
+      displist_geometry(dl, r, dl->cmds + i, j - i);
+      stats->drawcalls++;
+#else
+      for (int k = i; k < j; k++)
+	{
+	  drawcmd_t * cmd = dl->cmds + k;
+	  SDL_SetTextureAlphaMod(cmd->tex, cmd->alpha);
+	  SDL_RenderCopy(r, cmd->tex, cmd->src.w ? &cmd->src : NULL, &cmd->dst);
+	  stats->drawcalls++;
+	}
+#endif /* HAVE_RENDER_GEOMETRY */
+    }
+
+  for (int i = 0; i < dl->ntransient; i++)
+    res_destroy_texture(dl->transient[i]);
+  dl->ntransient = 0;
+  dl->nfills = 0;
+  dl->len = 0;
+  return 0;
+}
+
+displist_t * displist_destroy (displist_t * dl)
+{
+  for (int i = 0; i < dl->ntransient; i++)
+    res_destroy_texture(dl->transient[i]);
+  SDL_free(dl->transient);
+  SDL_free(dl->fills);
+  SDL_free(dl->cmds);
+#ifdef HAVE_RENDER_GEOMETRY
+  SDL_free(dl->verts);
+  SDL_free(dl->indices);
+#endif /* HAVE_RENDER_GEOMETRY */
+  SDL_memset(dl, 0, sizeof(*dl));
+  return dl;
+}
+
+/* Upload surface as texture, counting for per-frame stats. */
+SDL_Texture * app_upload (app_t * app, SDL_Surface * surf)
+{
+  if (! surf)
+    return NULL;
+  SDL_Texture * tex = res_texture(SDL_CreateTextureFromSurface(app->r, surf));
+  if (tex)
+    {
+      app->frame.textures++;
+      app->frame.uploaded += (long)surf->h * surf->pitch;
+    }
+  return tex;
+}
+
+/* Place line's text into a pooled row and free surf; or, when it does not fit a row or none is left, keep surf with a texture of its own. */
+void app_upload_line (app_t * app, logentry_t * entry, SDL_Surface * surf)
+{
+  if (! surf)
+    return;
+  rowpool_t * rows = &app->rows;
+  if (! rows->rowh)
+    rows->rowh = surf->h;
+  int row = 0;
+  if ((surf->h <= rows->rowh) && (surf->w <= rows->roww))
+    row = rowpool_acquire(rows, app->r);
+  else
+    rows->oversized++;
+  if (! row)
+    {
+      entry->surf = surf;
+      entry->tex = app_upload(app, surf);
+      return;
+    }
+  SDL_Rect rect;
+  rowpool_rect(rows, row, &rect);
+  rect.w = surf->w;
+  rect.h = surf->h;
+  SDL_UpdateTexture(rowpool_sheet(rows, row), &rect, surf->pixels, surf->pitch);
+  app->frame.uploaded += (long)rect.h * rect.w * sizeof(Uint32);
+  entry->row = row;
+  entry->w = rect.w;
+  entry->h = rect.h;
+  res_free_surface(surf);
+}
+
+#ifdef HAVE_GLYPH_BATCH
+/* Glyph atlas as one white texture, coverage as alpha, cells in rows of GLYPH_SHEET_COLUMNS. */
+static
+SDL_Texture * app_glyph_sheet (app_t * app)
+{
+  if (app->glyph_sheet)
+    return app->glyph_sheet;
+  int nrows = (GLYPH_ATLAS_COUNT + GLYPH_SHEET_COLUMNS - 1) / GLYPH_SHEET_COLUMNS;
+  SDL_Surface * surf = res_surface(SDL_CreateRGBSurfaceWithFormat(0, GLYPH_SHEET_COLUMNS * GLYPH_ATLAS_CELL_W, nrows * GLYPH_ATLAS_CELL_H, 32, SDL_PIXELFORMAT_ARGB8888));
+  if (! surf)
+    return NULL;
+  for (int idx = 0; idx < GLYPH_ATLAS_COUNT; idx++)
+    {
+      const Uint8 * cov = glyph_atlas_coverage[idx];
+      int x0 = (idx % GLYPH_SHEET_COLUMNS) * GLYPH_ATLAS_CELL_W;
+      int y0 = (idx / GLYPH_SHEET_COLUMNS) * GLYPH_ATLAS_CELL_H;
+      for (int y = 0; y < GLYPH_ATLAS_CELL_H; y++)
+	{
+	  Uint32 * row = (Uint32*)((Uint8*)surf->pixels + (y0 + y) * surf->pitch) + x0;
+	  for (int x = 0; x < GLYPH_ATLAS_CELL_W; x++)
+	    row[x] = ((Uint32)*cov++ << 24) | 0x00ffffff;
+	}
+    }
+  app->glyph_sheet = app_upload(app, surf);
+  SDL_SetTextureBlendMode(app->glyph_sheet, SDL_BLENDMODE_BLEND);
+  res_free_surface(surf);
+  return app->glyph_sheet;
+}
+#endif /* HAVE_GLYPH_BATCH */
+
+#ifdef HAVE_GLYPH_ATLAS
+/* Whether text can be drawn from the glyph atlas (sheet or compositor) instead of its own surface. */
+SDL_bool app_glyphs_p (app_t * app, int fontnum, const char * msg)
+{
+#ifndef HAVE_GLYPH_BATCH
+  if (! app->comp.active)
+    return SDL_FALSE;
+#else
+  (void)app;
+#endif /* HAVE_GLYPH_BATCH */
+  if (fontsizes[fontnum] != GLYPH_ATLAS_PTSIZE)
+    return SDL_FALSE;
+  while (*msg)
+    {
+      if (atlas_index(utf8_next(&msg)) < 0)
+	return SDL_FALSE;
+    }
+  return SDL_TRUE;
+}
+
+/* Draw text from the glyph atlas: blended in place, or queued as quads from the glyph sheet.
+   Allocates nothing once the sheet exists; returns -1 if not drawable so. */
+int app_glyph_text (app_t * app, int fontnum, int x, int y, const char * msg, Uint8 alpha)
+{
+  if (fontsizes[fontnum] != GLYPH_ATLAS_PTSIZE)
+    return -1;
+  if (app->comp.active)
+    return composite_glyphs(&app->comp, x, y, msg, alpha);
+#ifdef HAVE_GLYPH_BATCH
+  if (! app_glyph_sheet(app))
+    return -1;
+  displist_t * dl = &app->displist;
+  int start = dl->len;
+  int cell = -1;
+  for (const char * p = msg; *p; )
+    {
+      Uint32 cp = utf8_next(&p);
+      int idx = atlas_index(cp);
+      if (idx < 0)
+	{
+	  /* withdraw glyphs queued so far. */
+	  dl->len = start;
+	  return -1;
+	}
+      /* combining marks overlay previous cell. */
+      if (!((0x0300 <= cp) && (cp < 0x0370)) || (cell < 0))
+	cell++;
+      if (cp == ' ')
+	continue;
+      SDL_Rect src = { (idx % GLYPH_SHEET_COLUMNS) * GLYPH_ATLAS_CELL_W, (idx / GLYPH_SHEET_COLUMNS) * GLYPH_ATLAS_CELL_H, GLYPH_ATLAS_CELL_W, GLYPH_ATLAS_CELL_H };
+      SDL_Rect dst = { x + cell * GLYPH_ATLAS_CELL_W, y, GLYPH_ATLAS_CELL_W, GLYPH_ATLAS_CELL_H };
+      displist_copy(dl, app->glyph_sheet, &src, &dst, alpha);
+    }
+  return 0;
+#else
+  (void)x;
+  (void)y;
+  (void)msg;
+  (void)alpha;
+  return -1;
+#endif /* HAVE_GLYPH_BATCH */
+}
+#else
+SDL_bool app_glyphs_p (app_t * app, int fontnum, const char * msg)
+{
+  (void)app;
+  (void)fontnum;
+  (void)msg;
+  return SDL_FALSE;
+}
+
+int app_glyph_text (app_t * app, int fontnum, int x, int y, const char * msg, Uint8 alpha)
+{
+  (void)app;
+  (void)fontnum;
+  (void)x;
+  (void)y;
+  (void)msg;
+  (void)alpha;
+  return -1;
+}
+#endif /* HAVE_GLYPH_ATLAS */
+
+
+
+int app_resize (app_t *, int, int);
+void app_ingest_report (app_t *);
+int app_resource_report (app_t *);
+int app_bench_format (app_t *, int);
+void app_metrics_render (app_t *, long);
+void app_open_sensors (app_t *);
+void app_close_sensors (app_t *);
+
+/*
+   Initialize app state.
+
+   Returns pointer to app instance,
+   or returns NULL if app cannot proceed (error or forced quit).
+*/
+app_t * app_init (app_t * app, int argc, char ** argv)
+{
+  Uint64 t0 = SDL_GetPerformanceCounter();
+  int hooked = alloc_hook();
+  if (!app)
+    {
+      app = SDL_malloc(sizeof(app_t));
+    }
+  if (!app)
+    {
+      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in app.new");
+      abort();
+    }
+  /* Zero out struct. */
+  SDL_memset(app, 0, sizeof(*app));
+  app->startup.names[0] = "start";
+  app->startup.stamps[0] = t0;
+  app->startup.nphases = 1;
+
+  int i;
+  for (i = 0; i < MAX_CATEGORIES; i++)
+    {
+      logbuf_init(app->logbuf + i, 0);
+      app->logbuf[i].rows = &app->rows;
+    }
+  logbuf_init(&app->entrybox, 1);
+  app->mapdb.watch_fd = -1;
+  app->raster.nthreads = -1;
+  app->raster_budget_ms = DEFAULT_RASTER_BUDGET_MS;
+  app->diff.drift_ms = DEFAULT_DIFF_DRIFT_MS;
+  app->capture.window_s = DEFAULT_TRIGGER_WINDOW_S;
+  app->metrics.interval_s = DEFAULT_METRICS_INTERVAL_S;
+  app->sensors_mode = SENSORS_CONTROLLER;
+  app->sensor_window_ms = DEFAULT_SENSOR_WINDOW_MS;
+  app->touch_decimate = DEFAULT_TOUCH_DECIMATE;
+  for (int i = 0; i < MAX_FINGERS; i++)
+    app->fingers[i].motion = -1;
+  app->exitcode = 1;
+
+  /* Parse command-line arguments here. */
+  if (! app_parse_argv(app, argc, argv))
+    return NULL;
+  app_startup_phase(app, "argv");
+  if ((app->checkalloc.seconds > 0) && (hooked != 0))
+    {
+      SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "--check-alloc needs SDL 2.0.7 or later.");
+      return NULL;
+    }
+  if (app->bench_format > 0)
+    {
+      app->exitcode = app_bench_format(app, app->bench_format) ? 1 : 0;
+      return NULL;
+    }
+  if (app->diff.patha)
+    {
+      app->exitcode = capdiff_run(&app->diff);
+      return NULL;
+    }
+  if (app->analyze_path)
+    {
+      app->exitcode = analyze_run(app->analyze_path, 0);
+      return NULL;
+    }
+
+  if (app->trace_path && (trace_open(app->trace_path) == 0))
+    trace_thread("main");
+
+
+  /* Start invoking SDL; only the input subsystems for now, video once a window is wanted. */
+  SDL_Init(SDL_INIT_GAMECONTROLLER);
+  app_startup_phase(app, "SDL_Init");
+
+
+  /* Prepare game controller mappings. */
+  switch (app->mapping_protocol)
+    {
+    case MAPPING_FILE:
+      /* filename, or stdin if empty. */
+      app->mapdb.path = app->mapping_locator[0] ? app->mapping_locator : NULL;
+      mapdb_load(&app->mapdb);
+      mapdb_watch(&app->mapdb);
+      break;
+    case MAPPING_ENV:
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+		  "Loading mapping from env '%s'",
+		  app->mapping_locator);
+      if (getenv(app->mapping_locator))
+	SDL_GameControllerAddMapping(getenv(app->mapping_locator));
+      else
+	SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Environment variable '%s' not set.", app->mapping_locator);
+      break;
+    case MAPPING_LITERAL:
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+		  "Loading mapping \"%s\".",
+		  app->mapping_locator);
+      SDL_GameControllerAddMapping(app->mapping_locator);
+      break;
+    case MAPPING_HELP:
+	{
+	  int i;
+	  char jsguid[80] = { 0, };
+	  char jsname[80] = { 0, };
+	  for (i = 0; i < SDL_NumJoysticks(); i++)
+	    {
+	      jsguid[0] = 0;
+	      jsname[0] = 0;
+	      SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(i);
+	      SDL_JoystickGetGUIDString(guid, jsguid, sizeof(jsguid));
+	      SDL_snprintf(jsname, sizeof(jsname), "%s", SDL_JoystickNameForIndex(i));
+	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "JS #%d: GUID=%s (%s)\n", i, jsguid, jsname);
+	    }
+	  return NULL;
+	}
+      break;
+    case MAPPING_NONE:
+    default:
+      break;
+    }
+  app_startup_phase(app, "mappings");
+
+  /* Attach virtual joysticks, if requested. */
+  if (synth_start(&app->synth))
+    app_startup_phase(app, "synth");
+
+  /* Publish events to other processes, if requested. */
+  if (app->feed.name)
+    {
+      feed_open(&app->feed);
+      app_startup_phase(app, "feed");
+    }
+  if (server_start(&app->server))
+    app_startup_phase(app, "serve");
+  if (app->capture.path)
+    {
+      capture_open(&app->capture);
+      app_startup_phase(app, "record");
+    }
+  if (app->metrics.path || app->metrics.port)
+    {
+      metrics_start(&app->metrics);
+      app_startup_phase(app, "metrics");
+    }
+
+#ifdef HAVE_SENSORS
+  if (app->sensors_mode == SENSORS_ALL)
+    {
+      app_open_sensors(app);
+      app_startup_phase(app, "sensors");
+    }
+#endif
+
+  /* Enable joystick events. */
+  SDL_JoystickEventState(SDL_ENABLE);
+  /* Enable game controller events. */
+  SDL_GameControllerEventState(SDL_ENABLE);
+
+  /* open main window. */
+  SDL_InitSubSystem(SDL_INIT_VIDEO);
+  app_startup_phase(app, "video");
+  SDL_snprintf(app->title0, sizeof(app->title0), APP_TITLE);
+  if (! app->width) app->width = DEFAULT_WIDTH;
+  if (! app->height) app->height = DEFAULT_HEIGHT;
+  app->x0 = SDL_WINDOWPOS_UNDEFINED;
+  app->y0 = SDL_WINDOWPOS_UNDEFINED;
+  app->wflags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+  app->rindex = 0;
+  app->rflags = 0;
+  app->rowsize = 20;
+
+  app->w = SDL_CreateWindow(app->title0,
+			    app->x0, app->y0,
+			    app->width, app->height,
+			    app->wflags);
+  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Opened window %dx%d", app->width, app->height);
+  app_startup_phase(app, "window");
+  app->r = SDL_CreateRenderer(app->w, -1, app->rflags);
+  composite_init(&app->comp, app->r, app->composite_mode);
+  app_startup_phase(app, "renderer");
+
+  if (! app->age_fade_period) app->age_fade_period = DEFAULT_AGE_FADE_PERIOD;
+  if (! app->age_fade_start) app->age_fade_start = DEFAULT_AGE_FADE_ALPHA_START;
+  if (! app->age_fade_end) app->age_fade_end = DEFAULT_AGE_FADE_ALPHA_END;
+
+  app_resize(app, app->width, app->height);
+
+
+  /* fonts are loaded on demand, see app_get_font(). */
+
+
+  /* Open game controllers (apply mappings) */
+  for (int jsnum = 0; jsnum < SDL_NumJoysticks(); jsnum++)
+    {
+      if (SDL_IsGameController(jsnum))
+	{
+	  /* Emulate controller device add event to trigger handler. */
+	  SDL_Event pushevt;
+	  pushevt.cdevice.type = SDL_CONTROLLERDEVICEADDED;
+	  pushevt.cdevice.timestamp = 0;
+	  pushevt.cdevice.which = jsnum;
+	  SDL_PushEvent(&pushevt);
+	}
+    }
+  app_startup_phase(app, "devices");
+
+
+  return app;
+}
+
+app_t * app_destroy (app_t * app)
+{
+  app_ingest_report(app);
+  rasterpool_stop(&app->raster);
+  if (app->font_io[0])
+    {
+      SDL_LockMutex(app->fontlock);
+      for (int i = MAX_FONTS - 1; i >= 0; i--)
+	res_close_font(app->fonts[i]);
+      SDL_UnlockMutex(app->fontlock);
+      SDL_RWclose(app->font_io[0]);
+    }
+  if (app->font_data)
+    TTF_Quit();
+  if (app->fontlock)
+    SDL_DestroyMutex(app->fontlock);
+  app->fontlock = NULL;
+  SDL_free(app->font_buf);
+
+  synth_stop(&app->synth);
+  feed_close(&app->feed);
+  server_stop(&app->server);
+  capture_close(&app->capture);
+  if (app->metrics.text)
+    app_metrics_render(app, SDL_GetTicks());
+  metrics_stop(&app->metrics);
+#ifdef HAVE_SENSORS
+  app_close_sensors(app);
+#endif
+  devreg_destroy(&app->devices);
+  mapdb_destroy(&app->mapdb);
+
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    logbuf_destroy(app->logbuf + catnum);
+  logbuf_destroy(&app->entrybox);
+  for (int i = 0; i < MAX_GFXDECOR; i++)
+    {
+      res_free_surface(app->decor[i].surf);
+      res_destroy_texture(app->decor[i].tex);
+      app->decor[i].surf = NULL;
+      app->decor[i].tex = NULL;
+    }
+
+  composite_destroy(&app->comp);
+  displist_destroy(&app->displist);
+  if (app->rows.hits + app->rows.newsheets + app->rows.exhausted + app->rows.oversized)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Row pool: %ld reused, %ld new sheet, %ld exhausted, %ld oversized, peak %d of %d rows.",
+		app->rows.hits, app->rows.newsheets, app->rows.exhausted, app->rows.oversized,
+		app->rows.peak, app->rows.nsheets * ROWPOOL_SHEET_ROWS);
+  rowpool_reset(&app->rows, 0);
+  if (app->glyph_sheet)
+    res_destroy_texture(app->glyph_sheet);
+  app->glyph_sheet = NULL;
+  SDL_DestroyRenderer(app->r);
+  app->r = NULL;
+  SDL_DestroyWindow(app->w);
+  app->w = NULL;
+  if (app_resource_report(app) > 0)
+    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Resources still held at exit.");
+  trace_close();
+  SDL_Quit();
+  return app;
+}
+
+int app_clear (app_t * app)
+{
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    {
+      logbuf_clear(app->logbuf + catnum);
+    }
+  return 0;
+}
+
+
+/* Fold line into summary, by its type (text before ": ", or whole line). */
+void overload_add (overload_t * ov, const char * msg)
+{
+  const char * sep = SDL_strstr(msg, ": ");
+  int keylen = sep ? (int)(sep - msg) : (int)SDL_strlen(msg);
+  const char * value = sep ? sep + 2 : "";
+  ov->summarized++;
+
+  summary_t * ent = NULL;
+  for (int i = 0; i < ov->nkeys; i++)
+    {
+      summary_t * cand = ov->keys + i;
+      if ((SDL_strncmp(cand->key, msg, keylen) == 0) && (cand->key[keylen] == 0))
+	{
+	  ent = cand;
+	  break;
+	}
+    }
+  if (! ent)
+    {
+      if ((ov->nkeys >= MAX_SUMMARY_KEYS) || (keylen >= (int)sizeof(ent->key)))
+	{
+	  ov->other++;
+	  return;
+	}
+      ent = ov->keys + ov->nkeys++;
+      SDL_memcpy(ent->key, msg, keylen);
+      ent->key[keylen] = 0;
+      ent->count = ent->window = 0;
+      ent->rate = 0;
+    }
+  ent->count++;
+  ent->window++;
+  SDL_strlcpy(ent->last, value, sizeof(ent->last));
+}
+
+int app_write (app_t * app, int category, const char * msg)
+{
+  overload_t * ov = app->overload + category;
+  ov->window++;
+  if (ov->active)
+    {
+      overload_add(ov, msg);
+      return 0;
+    }
+  int n;
+  n = SDL_strlen(msg)+1;
+  logbuf_append(app->logbuf + category, msg, n);
+  return 0;
+}
+
+int app_vfwrite (app_t * app, int category, const char * fmt, va_list vp)
+{
+  char buf[MAX_LINELENGTH];
+  int res = SDL_vsnprintf(buf, sizeof(buf), fmt, vp);
+  app_write(app, category, buf);
+  return res;
+}
+
+int app_fwrite (app_t * app, int category, const char * fmt, ...)
+{
+  int retval = 0;
+  va_list vp;
+  va_start(vp, fmt);
+  retval = app_vfwrite(app, category, fmt, vp);
+  va_end(vp);
+  return retval;
+}
+
+
+/* Formatting for high-rate event lines: writers append to p and return the new end, unterminated.
+   Lines built with them stay far below MAX_LINELENGTH (11 characters per integer at most). */
+static const char digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static
+char * fmt_lit (char * p, const char * lit)
+{
+  while (*lit)
+    *p++ = *lit++;
+  return p;
+}
+
+/* As "%u". */
+static
+char * fmt_uint (char * p, unsigned v)
+{
+  int n = (v < 10) ? 1 : (v < 100) ? 2 : (v < 1000) ? 3 : (v < 10000) ? 4 : (v < 100000) ? 5
+    : (v < 1000000) ? 6 : (v < 10000000) ? 7 : (v < 100000000) ? 8 : (v < 1000000000) ? 9 : 10;
+  char * end = p + n;
+  /* two digits at a time, from the right. */
+  while (v >= 100)
+    {
+      unsigned r = (v % 100) * 2;
+      v /= 100;
+      *--end = digit_pairs[r + 1];
+      *--end = digit_pairs[r];
+    }
+  if (v >= 10)
+    {
+      *--end = digit_pairs[v * 2 + 1];
+      *--end = digit_pairs[v * 2];
+    }
+  else
+    {
+      *--end = '0' + v;
+    }
+  return p + n;
+}
+
+/* As "%d". */
+static
+char * fmt_int (char * p, int v)
+{
+  if (v < 0)
+    {
+      *p++ = '-';
+      return fmt_uint(p, 0u - (unsigned)v);
+    }
+  return fmt_uint(p, v);
+}
+
+/* As "%+d". */
+static
+char * fmt_sint (char * p, int v)
+{
+  if (v >= 0)
+    *p++ = '+';
+  return fmt_int(p, v);
+}
+
+/* Start a line for category, to be written in place (straight into its log slot) then ended with app_line_end(). */
+char * app_line_begin (app_t * app, int category)
+{
+  if (app->overload[category].active)
+    return app->linebuf;
+  return logbuf_reserve(app->logbuf + category)->line;
+}
+
+/* Terminate line begun with app_line_begin() at end, and add it. */
+int app_line_end (app_t * app, int category, char * end)
+{
+  overload_t * ov = app->overload + category;
+  *end = 0;
+  ov->window++;
+  if (ov->active)
+    {
+      overload_add(ov, app->linebuf);
+      return 0;
+    }
+  return logbuf_commit(app->logbuf + category);
+}
+
+/* Line template "<id><label><n>: <value>", as axis and hat lines. */
+static
+int app_line_idnv (app_t * app, int category, int id, const char * label, int n, int value)
+{
+  char * p = app_line_begin(app, category);
+  p = fmt_int(p, id);
+  p = fmt_lit(p, label);
+  p = fmt_int(p, n);
+  *p++ = ':';
+  *p++ = ' ';
+  p = fmt_int(p, value);
+  return app_line_end(app, category, p);
+}
+
+/* Line template "<id><label><value>", as button lines. */
+static
+int app_line_idv (app_t * app, int category, int id, const char * label, int value)
+{
+  char * p = app_line_begin(app, category);
+  p = fmt_int(p, id);
+  p = fmt_lit(p, label);
+  p = fmt_int(p, value);
+  return app_line_end(app, category, p);
+}
+
+/* Line template "<label><value>", as mouse button lines. */
+static
+int app_line_v (app_t * app, int category, const char * label, int value)
+{
+  char * p = app_line_begin(app, category);
+  p = fmt_lit(p, label);
+  p = fmt_int(p, value);
+  return app_line_end(app, category, p);
+}
+
+
+int app_on_quit (app_t * app, SDL_Event * evt)
+{
+  (void)evt;  /* deliberately ignoring argument. */
+  app_write(app, CAT_MISC, "QUIT");
+  app->alive = 0;
+  return 0;
+}
+
+int app_invalidate_decors (app_t * app);
+
+int app_resize (app_t * app, int width, int height)
+{
+  app->width = width;
+  app->height = height;
+  app_clear(app);
+  app_invalidate_decors(app);
+  composite_resize(&app->comp, app->r, width, height);
+  int histsize = (height - RESERVED_ROWS) / app->rowsize;
+  if (histsize < 1) histsize = 1;
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    {
+      logbuf_resize(app->logbuf + catnum, histsize);
+    }
+  /* all rows were released above. */
+  rowpool_reset(&app->rows, width / MAX_CATEGORIES);
+
+  return 0;
+}
+
+int app_on_window (app_t * app, SDL_Event * evt)
+{
+  switch (evt->window.event)
+    {
+    case SDL_WINDOWEVENT_SHOWN:
+      app_write(app, CAT_MISC, "WIN SHOWN");
+      break;
+    case SDL_WINDOWEVENT_HIDDEN:
+      app_write(app, CAT_MISC, "WIN HIDDEN");
+      break;
+    case SDL_WINDOWEVENT_EXPOSED:
+      app_write(app, CAT_MISC, "WIN EXPOSED");
+      break;
+    case SDL_WINDOWEVENT_MOVED:
+      app_write(app, CAT_MISC, "WIN MOVED");
+      break;
+    case SDL_WINDOWEVENT_RESIZED:
+      app_write(app, CAT_MISC, "WIN RESIZED");
+      break;
+    case SDL_WINDOWEVENT_SIZE_CHANGED:
+      /* TODO: check windowID for which window. */
+      app_resize(app, evt->window.data1, evt->window.data2);
+      app_write(app, CAT_MISC, "WIN SIZE_CHANGED");
+      break;
+    case SDL_WINDOWEVENT_MINIMIZED:
+      app_write(app, CAT_MISC, "WIN MINIMIZED");
+      break;
+    case SDL_WINDOWEVENT_MAXIMIZED:
+      app_write(app, CAT_MISC, "WIN MAXIMIZED");
+      break;
+    case SDL_WINDOWEVENT_RESTORED:
+      app_write(app, CAT_MISC, "WIN RESTORED");
+      break;
+    case SDL_WINDOWEVENT_ENTER:
+      app_write(app, CAT_MISC, "WIN ENTER");
+      break;
+    case SDL_WINDOWEVENT_LEAVE:
+      app_write(app, CAT_MISC, "WIN LEAVE");
+      break;
+    case SDL_WINDOWEVENT_FOCUS_GAINED:
+      app_write(app, CAT_MISC, "WIN FOCUS_GAINED");
+      break;
+    case SDL_WINDOWEVENT_FOCUS_LOST:
+      app_write(app, CAT_MISC, "WIN FOCUS_LOST");
+      break;
+    case SDL_WINDOWEVENT_CLOSE:
+      app_write(app, CAT_MISC, "WIN CLOSE");
+      break;
+    default:
+      break;
+    }
+  return 0;
+}
+
+/* handle KEYDOWN (keyboard key press) event. */
+int app_on_keydown (app_t * app, SDL_Event * evt)
+{
+  if (evt->key.repeat)
+    return 0;
+
+  const char * keyname = SDL_GetKeyName(evt->key.keysym.sym);
+  if (!keyname)
+    {
+      char altname[32];
+      SDL_snprintf(altname, sizeof(altname), "(%d)", evt->key.keysym.sym);
+      keyname = altname;
+    }
+  app_fwrite(app, CAT_KEYB, "PRESS: %s", keyname);
+  return 0;
+}
 
-
-/* utility function: pick first index in array of pointers fulfilling a criteria (default is-NULL, for finding an empty slot). */
-static
-int find_slot (int packcount, void ** pack, int (*predicate)(void*, void*), void * userdata)
+/* handle KEYUP (keyboard key release) event. */
+int app_on_keyup (app_t * app, SDL_Event * evt)
 {
-  int i = 0;
-  for (i = 0; i < packcount; i++)
+  const char * keyname = SDL_GetKeyName(evt->key.keysym.sym);
+  if (!keyname)
+    {
+      char altname[32];
+      SDL_snprintf(altname, sizeof(altname), "(%d)", evt->key.keysym.sym);
+      keyname = altname;
+    }
+  app_fwrite(app, CAT_KEYB, "RELEASE: %s", keyname);
+  if (evt->key.keysym.sym == SDLK_ESCAPE)
+    {
+      app->alive = 0;
+    }
+  if (evt->key.keysym.sym == SDLK_F3)
+    {
+      app->show_stats = !app->show_stats;
+    }
+  if (evt->key.keysym.sym == SDLK_F9)
+    {
+      if (capture_trigger(&app->capture, SDL_GetTicks()))
+	app_fwrite(app, CAT_MISC, "TRIGGER: segment %u kept", app->capture.segment);
+    }
+  if (evt->key.keysym.sym == SDLK_F2)
     {
-      if (predicate)
+      if (SDL_IsTextInputActive())
 	{
-	  /* delegate to predicate function. */
-	  if (predicate(pack[i], userdata))
-	    break;
+	  SDL_StopTextInput();
 	}
       else
 	{
-	  /* default predicate: compare to NULL */
-	  if (pack[i] == NULL)
-	    break;
+	  SDL_StartTextInput();
+	  SDL_Rect iptRect = { 16, 20, 120, 20 };
+	  SDL_SetTextInputRect(&iptRect);
 	}
     }
-  if (i < packcount)
-    return i;
-  return -1;
+  return 0;
 }
 
+/* handle MOUSEMOTION (mouse moving) event. */
+int app_on_mousemove (app_t * app, SDL_Event * evt)
+{
+  /* "MV: %+d%+d:(%d,%d)" */
+  char * p = app_line_begin(app, CAT_MOUSE);
+  p = fmt_lit(p, "MV: ");
+  p = fmt_sint(p, evt->motion.xrel);
+  p = fmt_sint(p, evt->motion.yrel);
+  p = fmt_lit(p, ":(");
+  p = fmt_int(p, evt->motion.x);
+  *p++ = ',';
+  p = fmt_int(p, evt->motion.y);
+  *p++ = ')';
+  return app_line_end(app, CAT_MOUSE, p);
+}
+
+/* handle MOUSEBUTTONDOWN (mouse button press) event. */
+int app_on_mousebdown (app_t * app, SDL_Event * evt)
+{
+  return app_line_v(app, CAT_MOUSE, "PRESS: ", evt->button.button);
+}
 
+/* handle MOUSEBUTTONUP (mouse button release) event. */
+int app_on_mousebup (app_t * app, SDL_Event * evt)
+{
+  return app_line_v(app, CAT_MOUSE, "RELEASE: ", evt->button.button);
+}
 
-int app_resize (app_t *, int, int);
+/* handle MOUSEWHEEL (mouse wheel) event. */
+int app_on_mousewheel (app_t * app, SDL_Event * evt)
+{
+  char * p = app_line_begin(app, CAT_MOUSE);
+  p = fmt_lit(p, "WHEEL: ");
+  p = fmt_sint(p, evt->wheel.x);
+  p = fmt_sint(p, evt->wheel.y);
+  return app_line_end(app, CAT_MOUSE, p);
+}
 
-/*
-   Initialize app state.
 
-   Returns pointer to app instance,
-   or returns NULL if app cannot proceed (error or forced quit).
-*/
-app_t * app_init (app_t * app, int argc, char ** argv)
+/* Track axis noise; returns whether the change is outside the deadband (or untracked) and should be logged. */
+static
+SDL_bool app_axis_filter (app_t * app, int kind, SDL_JoystickID instid, int axis, Sint16 value, Uint32 timestamp)
 {
-  if (!app)
-    {
-      app = SDL_malloc(sizeof(app_t));
-    }
-  if (!app)
-    {
-      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "failed malloc in app.new");
-      abort();
-    }
-  /* Zero out struct. */
-  SDL_memset(app, 0, sizeof(*app));
+  gamedev_t * dev = devreg_find(&app->devices, instid);
+  if (!dev || (axis < 0) || (axis >= NOISE_MAX_AXES))
+    return SDL_TRUE;
+  if (axisnoise_update(dev->noise[kind] + axis, value, timestamp, app->deadband))
+    return SDL_TRUE;
+  app->frame.quiet++;
+  return SDL_FALSE;
+}
 
-  int i;
-  for (i = 0; i < MAX_CATEGORIES; i++)
-    {
-      logbuf_init(app->logbuf + i, 0);
-    }
-  logbuf_init(&app->entrybox, 1);
+/* handle JOYAXISMOTION (joystick axis) event. */
+int app_on_joyaxis (app_t * app, SDL_Event * evt)
+{
+  if (! app_axis_filter(app, NOISE_JOYSTICK, evt->jaxis.which, evt->jaxis.axis, evt->jaxis.value, evt->jaxis.timestamp))
+    return 0;
+  return app_line_idnv(app, CAT_JOY, evt->jaxis.which, "/AXIS/", evt->jaxis.axis, evt->jaxis.value);
+}
 
-  /* Parse command-line arguments here. */
-  if (! app_parse_argv(app, argc, argv))
-    return NULL;
+/* handle JOYHATMOTION (joystick hat) event. */
+int app_on_joyhat (app_t * app, SDL_Event * evt)
+{
+  return app_line_idnv(app, CAT_JOY, evt->jhat.which, "/HAT/", evt->jhat.hat, evt->jhat.value);
+}
+
+/* handle JOYBALLMOTION (joystick trackball) event. */
+int app_on_joyball (app_t * app, SDL_Event * evt)
+{
+  /* "%d/BALL/%d: %+d%+d" */
+  char * p = app_line_begin(app, CAT_JOY);
+  p = fmt_int(p, evt->jball.which);
+  p = fmt_lit(p, "/BALL/");
+  p = fmt_int(p, evt->jball.ball);
+  *p++ = ':';
+  *p++ = ' ';
+  p = fmt_sint(p, evt->jball.xrel);
+  p = fmt_sint(p, evt->jball.yrel);
+  return app_line_end(app, CAT_JOY, p);
+}
+
+/* handle JOYBUTTONDOWN (joystick button press) event. */
+int app_on_joybdown (app_t * app, SDL_Event * evt)
+{
+  return app_line_idv(app, CAT_JOY, evt->jbutton.which, "/PRESS: ", evt->jbutton.button);
+}
 
+/* handle JOYBUTTONUP (joystick button up) event. */
+int app_on_joybup (app_t * app, SDL_Event * evt)
+{
+  return app_line_idv(app, CAT_JOY, evt->jbutton.which, "/RELEASE: ", evt->jbutton.button);
+}
 
-  /* Start invoking SDL. */
-  SDL_Init(SDL_INIT_EVERYTHING);
+/* handle joystick device events: connect, disconnect. */
+int app_on_joydev (app_t * app, SDL_Event * evt)
+{
+  const char * action = "?";
+  char jsname[12] = { 0, };
+  gamedev_t * dev = NULL;
 
+  /* device number, queried from system. */
+  int devnum = -1;
+  /* Joystick instance id, used by SDL events reporting. */
+  SDL_JoystickID instid = -1;
 
-  /* Prepare game controller mappings. */
-  switch (app->mapping_protocol)
+  switch (evt->jdevice.type)
     {
-    case MAPPING_FILE:
-      if (app->mapping_locator[0])
+    case SDL_JOYDEVICEADDED:
+      action = "ADD";
+      /* add to open devices. */
+      devnum = evt->jdevice.which; /* joystick device index. */
+      instid = SDL_JoystickGetDeviceInstanceID(devnum);
+      dev = devreg_attach(&app->devices, instid);
+      if (dev->js)
+	{
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Joystick #%d already open.", instid);
+	  SDL_snprintf(jsname, sizeof(jsname), "%s", dev->name);
+	  break;
+	}
+      if (! dev->gc)
+	{
+	  gamedev_describe(dev, devnum);
+	  if (!dev->mapping && mapdb_apply(&app->mapdb, dev->guid))
+	    {
+	      gamedev_describe(dev, devnum);
+	      if (SDL_IsGameController(devnum))
+		{
+		  /* Emulate controller device add event to trigger handler. */
+		  SDL_Event pushevt;
+		  pushevt.cdevice.type = SDL_CONTROLLERDEVICEADDED;
+		  pushevt.cdevice.timestamp = 0;
+		  pushevt.cdevice.which = devnum;
+		  SDL_PushEvent(&pushevt);
+		}
+	    }
+	}
+      dev->js = SDL_JoystickOpen(devnum);
+      if (dev->js)
 	{
-	  /* filename */
-	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-		      "Loading mapping from '%s'",
-		      app->mapping_locator);
-	  int res = SDL_GameControllerAddMappingsFromFile(app->mapping_locator);
-	  if (res == -1)
-	    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Error loading mappings from '%s'.", app->mapping_locator);
+	  SDL_snprintf(jsname, sizeof(jsname), "%s", dev->name);
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opened joystick instance #%d from index %d \"%s\" (%s); %d device(s).", instid, devnum, dev->name, dev->guid, app->devices.len);
 	}
       else
 	{
-	  /* stdin */
-	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-		      "Loading mapping from stdin");
-	  SDL_RWops * io = SDL_RWFromFP(stdin, SDL_TRUE);
-	  SDL_GameControllerAddMappingsFromRW(io, SDL_TRUE);
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Unable to open joystick #%d.", devnum);
+	  if (! dev->gc)
+	    devreg_detach(&app->devices, instid);
 	}
       break;
-    case MAPPING_ENV:
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-		  "Loading mapping from env '%s'",
-		  app->mapping_locator);
-      SDL_GameControllerAddMapping(getenv(app->mapping_locator));
-      break;
-    case MAPPING_LITERAL:
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-		  "Loading mapping \"%s\".",
-		  app->mapping_locator);
-      SDL_GameControllerAddMapping(getenv(app->mapping_locator));
-      break;
-    case MAPPING_HELP:
+    case SDL_JOYDEVICEREMOVED:
+      action = "REMOVE";
+      /* remove from open devices. */
+      instid = evt->jdevice.which; /* joystick instance id. */
+      dev = devreg_find(&app->devices, instid);
+      if (dev && dev->js)
 	{
-	  int i;
-	  char jsguid[80] = { 0, };
-	  char jsname[80] = { 0, };
-	  for (i = 0; i < SDL_NumJoysticks(); i++)
-	    {
-	      jsguid[0] = 0;
-	      jsname[0] = 0;
-	      SDL_JoystickGUID guid = SDL_JoystickGetDeviceGUID(i);
-	      SDL_JoystickGetGUIDString(guid, jsguid, sizeof(jsguid));
-	      SDL_snprintf(jsname, sizeof(jsname), "%s", SDL_JoystickNameForIndex(i));
-	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "JS #%d: GUID=%s (%s)\n", i, jsguid, jsname);
-	    }
-	  return NULL;
+	  /* name recorded at attach time; device is already gone. */
+	  SDL_snprintf(jsname, sizeof(jsname), "%s", dev->name);
+	  SDL_JoystickClose(dev->js);
+	  dev->js = NULL;
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Closed joystick #%d \"%s\"", instid, dev->name);
+	  if (! dev->gc)
+	    devreg_detach(&app->devices, instid);
 	}
       break;
-    case MAPPING_NONE:
-    default:
-      break;
     }
+  /* TODO: truncate jsname at 12th glyph, not 12th byte. */
+  app_fwrite(app, CAT_JOY, "%s: %d=%s", action, instid, jsname);
+  return 0;
+}
 
-  /* Enable joystick events. */
-  SDL_JoystickEventState(SDL_ENABLE);
-  /* Enable game controller events. */
-  SDL_GameControllerEventState(SDL_ENABLE);
 
-  /* open main window. */
-  SDL_snprintf(app->title0, sizeof(app->title0), APP_TITLE);
-  if (! app->width) app->width = DEFAULT_WIDTH;
-  if (! app->height) app->height = DEFAULT_HEIGHT;
-  app->x0 = SDL_WINDOWPOS_UNDEFINED;
-  app->y0 = SDL_WINDOWPOS_UNDEFINED;
-  app->wflags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
-  app->rindex = 0;
-  app->rflags = 0;
-  app->rowsize = 20;
+/* handle CONTROLLERAXISMOTION (SDL Game Controller joystick) event. */
+int app_on_gameaxis (app_t * app, SDL_Event * evt)
+{
+  if (! app_axis_filter(app, NOISE_CONTROLLER, evt->caxis.which, evt->caxis.axis, evt->caxis.value, evt->caxis.timestamp))
+    return 0;
+  return app_line_idnv(app, CAT_CONTROLLER, evt->caxis.which, "/AXIS/", evt->caxis.axis, evt->caxis.value);
+}
 
-  app->w = SDL_CreateWindow(app->title0,
-			    app->x0, app->y0,
-			    app->width, app->height,
-			    app->wflags);
-  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Opened window %dx%d", app->width, app->height);
-  app->r = SDL_CreateRenderer(app->w, -1, app->rflags);
+/* handle CONTROLLERBUTTONDOWN (SDL Game Controller button press) event. */
+int app_on_gamebdown (app_t * app, SDL_Event * evt)
+{
+  return app_line_idv(app, CAT_CONTROLLER, evt->cbutton.which, "/PRESS: ", evt->cbutton.button);
+}
 
-  if (! app->age_fade_period) app->age_fade_period = DEFAULT_AGE_FADE_PERIOD;
-  if (! app->age_fade_start) app->age_fade_start = DEFAULT_AGE_FADE_ALPHA_START;
-  if (! app->age_fade_end) app->age_fade_end = DEFAULT_AGE_FADE_ALPHA_END;
+/* handle CONTROLLERBUTTONUP (SDL Game Controller button release) event. */
+int app_on_gamebup (app_t * app, SDL_Event * evt)
+{
+  return app_line_idv(app, CAT_CONTROLLER, evt->cbutton.which, "/RELEASE: ", evt->cbutton.button);
+}
 
-  app_resize(app, app->width, app->height);
+/* Labels of SDL_SensorType values, for sensor lines. */
+static const char * sensor_names[SENSOR_MAX_TYPES] = {
+    "SENSOR", "ACCEL", "GYRO", "ACCEL_L", "GYRO_L", "ACCEL_R", "GYRO_R"
+};
 
+/* Log window summary of sensor: "<prefix><id>/<type> <rate>Hz" and mean[min,max] of each axis; end is when the window closed.  Empties the window. */
+static
+int app_sensor_report (app_t * app, int category, const char * prefix, int id, int type, sensorwin_t * win, Uint32 end)
+{
+  Uint32 span = end - win->start;
+  if (span == 0)
+    span = 1;
+  int hz = (win->n * 1000L + span / 2) / span;
+  double k = 1.0 / win->n;
+  win->n = 0;
+  return app_fwrite(app, category, "%s%d/%s %dHz x%+.2f[%+.2f,%+.2f] y%+.2f[%+.2f,%+.2f] z%+.2f[%+.2f,%+.2f]",
+		    prefix, id, sensor_names[type], hz,
+		    win->sum[0] * k, win->min[0], win->max[0],
+		    win->sum[1] * k, win->min[1], win->max[1],
+		    win->sum[2] * k, win->min[2], win->max[2]);
+}
 
-  /* load fonts. */
-  TTF_Init();
+#ifdef HAVE_SENSORS
+/* Take one sample of sensor: folded into the summary window (reported once the sample falls past its end),
+   and logged itself every --sensor-decimate samples. */
+static
+int app_sensor_sample (app_t * app, int category, const char * prefix, int id, int type, sensorwin_t * win, const float * data, Uint32 timestamp)
+{
+  if (app->sensor_window_ms > 0)
+    {
+      if (win->n && ((Sint32)(timestamp - win->start) >= app->sensor_window_ms))
+	app_sensor_report(app, category, prefix, id, type, win, timestamp);
+      if (win->n == 0)
+	{
+	  win->start = timestamp;
+	  for (int i = 0; i < 3; i++)
+	    {
+	      win->min[i] = win->max[i] = data[i];
+	      win->sum[i] = 0;
+	    }
+	}
+      for (int i = 0; i < 3; i++)
+	{
+	  if (data[i] < win->min[i]) win->min[i] = data[i];
+	  if (data[i] > win->max[i]) win->max[i] = data[i];
+	  win->sum[i] += data[i];
+	}
+      win->n++;
+    }
+  win->samples++;
+  if ((app->sensor_decimate > 0) && ((win->samples % app->sensor_decimate) == 0))
+    return app_fwrite(app, category, "%s%d/%s: %+.3f %+.3f %+.3f", prefix, id, sensor_names[type], data[0], data[1], data[2]);
+  return 0;
+}
+#endif
 
-  if (ttf0_size > 0)
+/* Report summary windows that ended without a later sample to close them, e.g. a sensor gone quiet. */
+static
+void app_update_sensors (app_t * app, long t)
+{
+  int window = app->sensor_window_ms;
+  if (window <= 0)
+    return;
+  for (int i = 0; i < app->devices.alloc; i++)
     {
-      /* use built-in font. */
-      app->font_io[0] = SDL_RWFromMem((void*)ttf0_data, ttf0_size);
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Using built-in font.");
+      gamedev_t * dev = app->devices.slots[i];
+      if (!dev) continue;
+      for (int type = 0; type < SENSOR_MAX_TYPES; type++)
+	{
+	  sensorwin_t * win = dev->sensors + type;
+	  if (win->n && ((Sint32)((Uint32)t - win->start) >= window))
+	    app_sensor_report(app, CAT_CONTROLLER, "", dev->instid, type, win, win->start + window);
+	}
     }
-  else
+  for (int i = 0; i < app->nsensors; i++)
     {
-      /* search for suitable font file. */
-#ifdef _PC_PATH_MAX
-      const int max_pathlen = pathconf("/", _PC_PATH_MAX);
-#else
-      const int max_pathlen = 4096; /* something sensible as of Y2013. */
-#endif /* _PC_PATH_MAX */
-      char * fqpn_font = SDL_malloc(max_pathlen);
-      app->font_io[0] = find_path_to_ttf_file(DEFAULT_FONT_FILENAME, fqpn_font, max_pathlen);
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Using font file '%s'", fqpn_font);
-      SDL_free(fqpn_font);
+      sensordev_t * sd = app->sensors + i;
+      if (sd->win.n && ((Sint32)((Uint32)t - sd->win.start) >= window))
+	app_sensor_report(app, CAT_MISC, "S", sd->instid, sd->type, &sd->win, sd->win.start + window);
     }
+}
 
-  if (! app->font_io[0])
+#ifdef HAVE_SENSORS
+/* Open every standalone sensor (--sensors=all); they report SENSORUPDATE. */
+void app_open_sensors (app_t * app)
+{
+  if (SDL_InitSubSystem(SDL_INIT_SENSOR) < 0)
     {
-      SDL_LogCritical(SDL_LOG_CATEGORY_APPLICATION, "Unable to open any font file.");
-      abort();
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to start sensor subsystem: %s", SDL_GetError());
+      return;
     }
-  app->fonts[0] = TTF_OpenFontRW(app->font_io[0], 0/*do not auto-close*/, 12);
-  app->fonts[1] = TTF_OpenFontRW(app->font_io[0], 0, 16);
-  app->fonts[2] = TTF_OpenFontRW(app->font_io[0], 0, 20);
+  for (int i = 0; (i < SDL_NumSensors()) && (app->nsensors < MAX_SENSORS); i++)
+    {
+      SDL_Sensor * sensor = SDL_SensorOpen(i);
+      if (! sensor)
+	{
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to open sensor #%d: %s", i, SDL_GetError());
+	  continue;
+	}
+      sensordev_t * sd = app->sensors + app->nsensors++;
+      sd->sensor = sensor;
+      sd->instid = SDL_SensorGetInstanceID(sensor);
+      sd->type = SDL_SensorGetType(sensor);
+      if ((sd->type < 0) || (sd->type >= SENSOR_MAX_TYPES))
+	sd->type = SDL_SENSOR_UNKNOWN;
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opened sensor (instance=%d) \"%s\", %s.", sd->instid, SDL_SensorGetName(sensor), sensor_names[sd->type]);
+    }
+}
 
-  /* Do not close the RW until TTF lib shuts down. */
+void app_close_sensors (app_t * app)
+{
+  for (int i = 0; i < app->nsensors; i++)
+    SDL_SensorClose(app->sensors[i].sensor);
+  app->nsensors = 0;
+}
 
+/* handle SENSORUPDATE (standalone sensor) event. */
+int app_on_sensor (app_t * app, SDL_Event * evt)
+{
+  for (int i = 0; i < app->nsensors; i++)
+    {
+      sensordev_t * sd = app->sensors + i;
+      if (sd->instid == evt->sensor.which)
+	return app_sensor_sample(app, CAT_MISC, "S", sd->instid, sd->type, &sd->win, evt->sensor.data, evt->sensor.timestamp);
+    }
+  return 0;
+}
+#endif /* HAVE_SENSORS */
 
-  /* Open game controllers (apply mappings) */
-  for (int jsnum = 0; jsnum < SDL_NumJoysticks(); jsnum++)
+#ifdef HAVE_CONTROLLER_SENSORS
+/* Turn on game controller's accelerometer and gyro, so they report CONTROLLERSENSORUPDATE. */
+void gamedev_enable_sensors (gamedev_t * dev)
+{
+  static const SDL_SensorType types[] = { SDL_SENSOR_ACCEL, SDL_SENSOR_GYRO };
+  for (size_t i = 0; i < SDL_arraysize(types); i++)
     {
-      if (SDL_IsGameController(jsnum))
+      if (! SDL_GameControllerHasSensor(dev->gc, types[i]))
+	continue;
+      if (SDL_GameControllerSetSensorEnabled(dev->gc, types[i], SDL_TRUE) < 0)
 	{
-	  /* Emulate controller device add event to trigger handler. */
-	  SDL_Event pushevt;
-	  pushevt.cdevice.type = SDL_CONTROLLERDEVICEADDED;
-	  pushevt.cdevice.timestamp = 0;
-	  pushevt.cdevice.which = jsnum;
-	  SDL_PushEvent(&pushevt);
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to enable %s of game controller %d: %s", sensor_names[types[i]], dev->instid, SDL_GetError());
+	  continue;
 	}
+#if SDL_VERSION_ATLEAST(2,0,16)
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Enabled %s of game controller %d, %.0f Hz.", sensor_names[types[i]], dev->instid,
+		  SDL_GameControllerGetSensorDataRate(dev->gc, types[i]));
+#else
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Enabled %s of game controller %d.", sensor_names[types[i]], dev->instid);
+#endif
     }
-
-
-  return app;
+  int ntouchpads = SDL_GameControllerGetNumTouchpads(dev->gc);
+  if (ntouchpads > 0)
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Game controller %d has %d touchpad(s).", dev->instid, ntouchpads);
 }
 
-app_t * app_destroy (app_t * app)
+/* handle CONTROLLERSENSORUPDATE (game controller gyro, accelerometer) event. */
+int app_on_gamesensor (app_t * app, SDL_Event * evt)
 {
-  TTF_CloseFont(app->fonts[2]);
-  TTF_CloseFont(app->fonts[1]);
-  TTF_CloseFont(app->fonts[0]);
-  SDL_RWclose(app->font_io[0]);
-  TTF_Quit();
-
-  SDL_DestroyRenderer(app->r);
-  app->r = NULL;
-  SDL_DestroyWindow(app->w);
-  app->w = NULL;
-  SDL_Quit();
-  return app;
+  int type = evt->csensor.sensor;
+  gamedev_t * dev = devreg_find(&app->devices, evt->csensor.which);
+  if (!dev || (type < 0) || (type >= SENSOR_MAX_TYPES))
+    return 0;
+  return app_sensor_sample(app, CAT_CONTROLLER, "", evt->csensor.which, type, dev->sensors + type, evt->csensor.data, evt->csensor.timestamp);
 }
 
-int app_clear (app_t * app)
+/* handle CONTROLLERTOUCHPADDOWN/MOTION/UP (game controller touchpad) events; motion every --touch-decimate. */
+int app_on_gametouch (app_t * app, SDL_Event * evt)
 {
-  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+  const char * action = "MOVE";
+  gamedev_t * dev = devreg_find(&app->devices, evt->ctouchpad.which);
+  int touchpad = evt->ctouchpad.touchpad, finger = evt->ctouchpad.finger;
+  long * motion = NULL;
+  if (dev && (touchpad >= 0) && (touchpad < TOUCHPAD_MAX) && (finger >= 0) && (finger < TOUCHPAD_MAX_FINGERS))
+    motion = &dev->touchmotion[touchpad][finger];
+  if (evt->type == SDL_CONTROLLERTOUCHPADDOWN)
     {
-      logbuf_clear(app->logbuf + catnum);
+      action = "DOWN";
+      if (motion)
+	*motion = 0;
     }
-  return 0;
+  else if (evt->type == SDL_CONTROLLERTOUCHPADUP)
+    action = "UP";
+  else if (motion && ((*motion)++ % app->touch_decimate) != 0)
+    return 0;
+  return app_fwrite(app, CAT_CONTROLLER, "%d/TOUCH/%d/%d %s: %.3f,%.3f p%.2f",
+		    evt->ctouchpad.which, evt->ctouchpad.touchpad, evt->ctouchpad.finger, action,
+		    evt->ctouchpad.x, evt->ctouchpad.y, evt->ctouchpad.pressure);
 }
+#endif /* HAVE_CONTROLLER_SENSORS */
 
-
-int app_write (app_t * app, int category, const char * msg)
+/* handle FINGERDOWN/MOTION/UP (touch screen or trackpad) events; motion every --touch-decimate. */
+int app_on_finger (app_t * app, SDL_Event * evt)
 {
-  int n;
-  n = SDL_strlen(msg)+1;
-  logbuf_append(app->logbuf + category, msg, n);
-  return 0;
+  const char * action = "MOVE";
+  int slot = -1, spare = -1;
+  for (int i = 0; i < MAX_FINGERS; i++)
+    {
+      if (app->fingers[i].motion < 0)
+	{
+	  if (spare < 0)
+	    spare = i;
+	}
+      else if ((app->fingers[i].touchid == evt->tfinger.touchId) && (app->fingers[i].fingerid == evt->tfinger.fingerId))
+	slot = i;
+    }
+  /* finger down before startup also gets a slot on its first motion. */
+  if ((slot < 0) && (evt->type != SDL_FINGERUP) && (spare >= 0))
+    {
+      slot = spare;
+      app->fingers[slot].touchid = evt->tfinger.touchId;
+      app->fingers[slot].fingerid = evt->tfinger.fingerId;
+      app->fingers[slot].motion = 0;
+    }
+  if (evt->type == SDL_FINGERDOWN)
+    {
+      action = "DOWN";
+      if (slot >= 0)
+	app->fingers[slot].motion = 0;
+    }
+  else if (evt->type == SDL_FINGERUP)
+    {
+      action = "UP";
+      if (slot >= 0)
+	app->fingers[slot].motion = -1;
+    }
+  /* more fingers than slots: log all their motion. */
+  else if ((slot >= 0) && (app->fingers[slot].motion++ % app->touch_decimate) != 0)
+    return 0;
+  return app_fwrite(app, CAT_MOUSE, "FINGER %lld/%lld %s: %.3f,%.3f p%.2f",
+		    (long long)evt->tfinger.touchId, (long long)evt->tfinger.fingerId, action,
+		    evt->tfinger.x, evt->tfinger.y, evt->tfinger.pressure);
 }
 
-int app_vfwrite (app_t * app, int category, const char * fmt, va_list vp)
+/* handle SDL Game Controller device events: add, remove, remap. */
+int app_on_gamedev (app_t * app, SDL_Event * evt)
 {
-  char buf[MAX_LINELENGTH];
-  int res = SDL_vsnprintf(buf, sizeof(buf), fmt, vp);
-  app_write(app, category, buf);
-  return res;
+  const char * action = "?";
+  char gcname[12] = { 0, };
+  int devnum = -1;
+  SDL_JoystickID instid = -1;
+  gamedev_t * dev = NULL;
+
+  switch (evt->cdevice.type)
+    {
+    case SDL_CONTROLLERDEVICEADDED:
+      action = "ADD";
+      devnum = evt->cdevice.which; /* joystick device index. */
+      instid = SDL_JoystickGetDeviceInstanceID(devnum);
+      dev = devreg_attach(&app->devices, instid);
+      /* avoid duplicate */
+      if (dev->gc) /* controller already handled. */
+	{
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Re-opening game controller (jsinstance=%d)\n", instid);
+	  action = NULL;
+	  break;
+	}
+      if (! dev->js)
+	gamedev_describe(dev, devnum);
+      dev->gc = SDL_GameControllerOpen(devnum);
+      if (dev->gc)
+	{
+	  /* controller name may differ from joystick name (mapping-provided). */
+	  SDL_snprintf(dev->name, sizeof(dev->name), "%s", SDL_GameControllerName(dev->gc));
+	  SDL_free(dev->mapping);
+	  dev->mapping = SDL_GameControllerMapping(dev->gc);
+	  SDL_snprintf(gcname, sizeof(gcname), "%s", dev->name);
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opened game controller (jsinstance=%d, sysid=%d) \"%s\"; %d device(s).", instid, devnum, dev->name, app->devices.len);
+#ifdef HAVE_CONTROLLER_SENSORS
+	  if (app->sensors_mode != SENSORS_OFF)
+	    gamedev_enable_sensors(dev);
+#endif
+	}
+      else
+	{
+	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to open game controller #%d.", devnum);
+	  if (! dev->js)
+	    devreg_detach(&app->devices, instid);
+	}
+      break;
+    case SDL_CONTROLLERDEVICEREMOVED:
+      action = "REMOVE";
+      instid = evt->cdevice.which;
+      dev = devreg_find(&app->devices, instid);
+      if (dev && dev->gc)
+	{
+	  /* found for removal. */
+	  SDL_snprintf(gcname, sizeof(gcname), "%s", dev->name);
+	  SDL_GameControllerClose(dev->gc);
+	  dev->gc = NULL;
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Closed game controller (js #%d) \"%s\".", instid, dev->name);
+	  if (! dev->js)
+	    devreg_detach(&app->devices, instid);
+	}
+      break;
+    case SDL_CONTROLLERDEVICEREMAPPED:
+      action = "REMAP";
+      instid = evt->cdevice.which;
+      dev = devreg_find(&app->devices, instid);
+      if (dev && dev->gc)
+	{
+	  SDL_free(dev->mapping);
+	  dev->mapping = SDL_GameControllerMapping(dev->gc);
+	  SDL_snprintf(gcname, sizeof(gcname), "%s", dev->name);
+	}
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Remapping on game controller %d: %s", instid, (dev && dev->mapping) ? dev->mapping : "(none)");
+      break;
+    }
+  /* TODO: truncate gcname at 12th glyph, not 12th byte. */
+  if (action)
+    {
+      app_fwrite(app, CAT_CONTROLLER, "%s: %d=%s",
+		 action,
+		 instid,
+		 gcname);
+    }
+  return 0;
 }
 
-int app_fwrite (app_t * app, int category, const char * fmt, ...)
+int app_on_textinput (app_t * app, SDL_Event * evt)
 {
-  int retval = 0;
-  va_list vp;
-  va_start(vp, fmt);
-  retval = app_vfwrite(app, category, fmt, vp);
-  va_end(vp);
-  return retval;
+  char buf[MAX_LINELENGTH];
+  snprintf(buf, sizeof(buf), "TEXTINPUT %s", evt->text.text);
+  app_write(app, CAT_MISC, buf);
+  return 0;
 }
 
-
-int app_on_quit (app_t * app, SDL_Event * evt)
+int app_on_textedit (app_t * app, SDL_Event * evt)
 {
-  (void)evt;  /* deliberately ignoring argument. */
-  app_write(app, CAT_MISC, "QUIT");
-  app->alive = 0;
+  (void)evt;
+  app_write(app, CAT_MISC, "TEXTEDITING");
   return 0;
 }
 
-int app_invalidate_decors (app_t * app);
 
-int app_resize (app_t * app, int width, int height)
+/* Render text at a location for the current presentation cycle (frame). */
+int app_printxy (app_t * app, int fontnum, int x, int y, const char * msg)
 {
-  app->width = width;
-  app->height = height;
-  app_clear(app);
-  app_invalidate_decors(app);
-  int histsize = (height - RESERVED_ROWS) / app->rowsize;
-  if (histsize < 1) histsize = 1;
-  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+  if (app_glyph_text(app, fontnum, x, y, msg, 0xff) == 0)
+    return 0;
+  SDL_Surface * textsurf = app_render_text(app, fontnum, msg);
+  if (!textsurf)
+    return -1;
+  if (app->comp.active)
     {
-      logbuf_resize(app->logbuf + catnum, histsize);
+      composite_blit(&app->comp, x, y, textsurf, 0xff);
+      res_free_surface(textsurf);
+      return 0;
     }
+  SDL_Rect dst = { x, y, textsurf->w, textsurf->h };
+  SDL_Texture * blttex = app_upload(app, textsurf);
+  res_free_surface(textsurf);
+  if (!blttex)
+    return -1;
+  displist_copy(&app->displist, blttex, NULL, &dst, 0xff);
+  displist_transient(&app->displist, blttex);
 
   return 0;
 }
 
-int app_on_window (app_t * app, SDL_Event * evt)
+struct gfxdecor_s * app_get_decor (app_t * app, int decor_idx)
 {
-  switch (evt->window.event)
-    {
-    case SDL_WINDOWEVENT_SHOWN:
-      app_write(app, CAT_MISC, "WIN SHOWN");
-      break;
-    case SDL_WINDOWEVENT_HIDDEN:
-      app_write(app, CAT_MISC, "WIN HIDDEN");
-      break;
-    case SDL_WINDOWEVENT_EXPOSED:
-      app_write(app, CAT_MISC, "WIN EXPOSED");
-      break;
-    case SDL_WINDOWEVENT_MOVED:
-      app_write(app, CAT_MISC, "WIN MOVED");
-      break;
-    case SDL_WINDOWEVENT_RESIZED:
-      app_write(app, CAT_MISC, "WIN RESIZED");
-      break;
-    case SDL_WINDOWEVENT_SIZE_CHANGED:
-      /* TODO: check windowID for which window. */
-      app_resize(app, evt->window.data1, evt->window.data2);
-      app_write(app, CAT_MISC, "WIN SIZE_CHANGED");
-      break;
-    case SDL_WINDOWEVENT_MINIMIZED:
-      app_write(app, CAT_MISC, "WIN MINIMIZED");
-      break;
-    case SDL_WINDOWEVENT_MAXIMIZED:
-      app_write(app, CAT_MISC, "WIN MAXIMIZED");
-      break;
-    case SDL_WINDOWEVENT_RESTORED:
-      app_write(app, CAT_MISC, "WIN RESTORED");
-      break;
-    case SDL_WINDOWEVENT_ENTER:
-      app_write(app, CAT_MISC, "WIN ENTER");
-      break;
-    case SDL_WINDOWEVENT_LEAVE:
-      app_write(app, CAT_MISC, "WIN LEAVE");
-      break;
-    case SDL_WINDOWEVENT_FOCUS_GAINED:
-      app_write(app, CAT_MISC, "WIN FOCUS_GAINED");
-      break;
-    case SDL_WINDOWEVENT_FOCUS_LOST:
-      app_write(app, CAT_MISC, "WIN FOCUS_LOST");
-      break;
-    case SDL_WINDOWEVENT_CLOSE:
-      app_write(app, CAT_MISC, "WIN CLOSE");
-      break;
-    default:
-      break;
-    }
-  return 0;
+  if ((decor_idx < 0) || (decor_idx >= MAX_GFXDECOR))
+    return NULL;
+  struct gfxdecor_s * retval = app->decor + decor_idx;
+  if ((! retval->surf) && (! retval->tex) && (! retval->glyphs))
+    return NULL;
+  return retval;
 }
 
-/* handle KEYDOWN (keyboard key press) event. */
-int app_on_keydown (app_t * app, SDL_Event * evt)
+int app_invalidate_decors (app_t * app)
 {
-  if (evt->key.repeat)
-    return 0;
-
-  const char * keyname = SDL_GetKeyName(evt->key.keysym.sym);
-  if (!keyname)
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
     {
-      char altname[32];
-      SDL_snprintf(altname, sizeof(altname), "(%d)", evt->key.keysym.sym);
-      keyname = altname;
+      int decor_idx = catnum + DECORID_CATEGORIES;
+      struct gfxdecor_s * retval = app->decor + decor_idx;
+      retval->glyphs = SDL_FALSE;
+      if (retval->tex)
+	{
+	  res_destroy_texture(retval->tex);
+	  retval->tex = NULL;
+	}
+      if (retval->surf)
+	{
+	  res_free_surface(retval->surf);
+	  retval->surf = NULL;
+	}
     }
-  app_fwrite(app, CAT_KEYB, "PRESS: %s", keyname);
   return 0;
 }
 
-/* handle KEYUP (keyboard key release) event. */
-int app_on_keyup (app_t * app, SDL_Event * evt)
+/* Generate and store text at a location to be rendered across many presentation cycles. */
+int app_install_text (app_t * app, int decor_idx, int fontnum, int x, int y, const char * msg)
 {
-  const char * keyname = SDL_GetKeyName(evt->key.keysym.sym);
-  if (!keyname)
+  SDL_Texture * blttex = NULL;
+  SDL_Surface * textsurf = app->decor[decor_idx].surf;
+
+  if (textsurf)
     {
-      char altname[32];
-      SDL_snprintf(altname, sizeof(altname), "(%d)", evt->key.keysym.sym);
-      keyname = altname;
+      /* delete in preparation for overwrite. */
+      res_free_surface(textsurf);
+      textsurf = NULL;
+      blttex = app->decor[decor_idx].tex;
+      if (blttex)
+	{
+	  res_destroy_texture(blttex);
+	  app->decor[decor_idx].tex = NULL;
+	}
     }
-  app_fwrite(app, CAT_KEYB, "RELEASE: %s", keyname);
-  if (evt->key.keysym.sym == SDLK_ESCAPE)
+
+  gfxdecor_t * decor = app->decor + decor_idx;
+  decor->x = x;
+  decor->y = y;
+  decor->glyphs = app_glyphs_p(app, fontnum, msg);
+  if (decor->glyphs)
     {
-      app->alive = 0;
+      /* redrawn from the atlas every frame; nothing to allocate. */
+      decor->fontnum = fontnum;
+      SDL_strlcpy(decor->text, msg, sizeof(decor->text));
+      decor->surf = NULL;
+      decor->tex = NULL;
+      return 0;
     }
-  if (evt->key.keysym.sym == SDLK_F2)
+
+  textsurf = app_render_text(app, fontnum, msg);
+  blttex = app->comp.active ? NULL : app_upload(app, textsurf);
+  app->decor[decor_idx].x = x;
+  app->decor[decor_idx].y = y;
+  app->decor[decor_idx].surf = textsurf;
+  app->decor[decor_idx].tex = blttex;
+
+  return 0;
+}
+
+/* Render the permanent decorations. */
+int app_render_decor (app_t * app)
+{
+  for (int i = 0; i < MAX_GFXDECOR; i++)
     {
-      if (SDL_IsTextInputActive())
+      struct gfxdecor_s * decor = app->decor + i;
+      SDL_Texture * blttex = decor->tex;
+      SDL_Surface * textsurf = decor->surf;
+      if (decor->glyphs)
 	{
-	  SDL_StopTextInput();
+	  app_glyph_text(app, decor->fontnum, decor->x, decor->y, decor->text, 0xff);
+	  continue;
 	}
-      else
+      if (app->comp.active)
 	{
-	  SDL_StartTextInput();
-	  SDL_Rect iptRect = { 16, 20, 120, 20 };
-	  SDL_SetTextInputRect(&iptRect);
+	  if (textsurf)
+	    composite_blit(&app->comp, decor->x, decor->y, textsurf, 0xff);
+	  continue;
+	}
+      if (!textsurf)
+	continue;
+      if (! blttex)
+	{
+	  blttex = app_upload(app, textsurf);
+	  decor->tex = blttex;
 	}
+      SDL_Rect dst;
+      dst.x = decor->x;
+      dst.y = decor->y;
+      dst.w = textsurf->w;
+      dst.h = textsurf->h;
+
+      displist_copy(&app->displist, blttex, NULL, &dst, 0xff);
     }
-  return 0;
-}
 
-/* handle MOUSEMOTION (mouse moving) event. */
-int app_on_mousemove (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_MOUSE, "MV: %+d%+d:(%d,%d)",
-	     evt->motion.xrel,
-	     evt->motion.yrel,
-	     evt->motion.x,
-	     evt->motion.y
-	     );
   return 0;
 }
 
-/* handle MOUSEBUTTONDOWN (mouse button press) event. */
-int app_on_mousebdown (app_t * app, SDL_Event * evt)
+/* Width of placeholder for line awaiting rasterization; within its column. */
+static
+int app_placeholder_width (app_t * app, const logentry_t * entry)
 {
-  app_fwrite(app, CAT_MOUSE, "PRESS: %d", evt->button.button);
-  return 0;
+  int w = SDL_strlen(entry->line) * PLACEHOLDER_ADVANCE;
+  int colw = app->width / MAX_CATEGORIES - 8;
+  return (w < colw) ? w : colw;
 }
 
-/* handle MOUSEBUTTONUP (mouse button release) event. */
-int app_on_mousebup (app_t * app, SDL_Event * evt)
+/* Overlay of previous frame's render counts (F3). */
+int app_render_stats (app_t * app)
 {
-  app_fwrite(app, CAT_MOUSE, "RELEASE: %d", evt->button.button);
-  return 0;
+  if (! app->show_stats)
+    return 0;
+  const struct framestats_s * stats = &app->stats;
+  char buf[MAX_LINELENGTH];
+  SDL_snprintf(buf, sizeof(buf), "draw %d sw %d cmd %d-%d up %ldB defer %d alloc %d/%ldB rows %d/%d quiet %d",
+	       stats->drawcalls, stats->switches, stats->cmds, stats->dropped, stats->uploaded, stats->deferred,
+	       stats->allocs, stats->allocbytes, app->rows.inuse, app->rows.nsheets * ROWPOOL_SHEET_ROWS, stats->quiet);
+  if (app->capture.mem)
+    {
+      capture_t * capture = &app->capture;
+      char rec[MAX_LINELENGTH];
+      SDL_LockMutex(capture->lock);
+      SDL_snprintf(rec, sizeof(rec), "rec buf %d/%d flush %.1f/%.1fms stall %d drop %llu seg %u trig %d",
+		   capture->queued + (capture->fill >= 0), CAPTURE_BUFFERS,
+		   capture->flush_last_us / 1000.0, capture->flush_max_us / 1000.0,
+		   capture->stalls, (unsigned long long)capture->dropped, capture->segment, capture->triggers);
+      SDL_UnlockMutex(capture->lock);
+      app_printxy(app, FONT_LARGE, app->width / 3, app->height - 40, rec);
+    }
+  return app_printxy(app, FONT_LARGE, app->width / 3, app->height - 20, buf);
 }
 
-/* handle MOUSEWHEEL (mouse wheel) event. */
-int app_on_mousewheel (app_t * app, SDL_Event * evt)
+/* Graphics output composited into one CPU framebuffer (software renderer). */
+static
+int app_composite_gfx (app_t * app)
 {
-  app_fwrite(app, CAT_MOUSE, "WHEEL: %+d%+d", evt->wheel.x, evt->wheel.y);
-  return 0;
-}
+  composite_t * comp = &app->comp;
+  composite_clear(comp);
 
+  int x0 = 0;
+  int y0 = 40;
+  int x, y;
+  TRACE_BEGIN(TRACE_GFX_COLUMNS);
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    {
+      x = x0 + (catnum * app->width / MAX_CATEGORIES);
+      y = y0;
+      if (catnum > 0)
+	{
+	  // separator line.
+	  composite_vline(comp, x-4, y, app->height);
+	}
 
-/* handle JOYAXISMOTION (joystick axis) event. */
-int app_on_joyaxis (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_JOY, "%d/AXIS/%d: %d",
-	     evt->jaxis.which,
-	     evt->jaxis.axis,
-	     evt->jaxis.value);
-  return 0;
-}
+      /* Place category name as column header. */
+      int decorid_cat = catnum + DECORID_CATEGORIES;
+      if (!app_get_decor(app, decorid_cat))
+	app_install_text(app, decorid_cat, FONT_LARGE, x, y, catlabel[catnum]);
 
-/* handle JOYHATMOTION (joystick hat) event. */
-int app_on_joyhat (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_JOY, "%d/HAT/%d: %d",
-	     evt->jhat.which,
-	     evt->jhat.hat,
-	     evt->jhat.value);
-  return 0;
-}
+      /* Blend log lines for current category, age-fade in the same pass. */
+      struct logbuf_s * logbuf = app->logbuf + catnum;
+      int maxlines = logbuf->cap;
+      for (int linenum = 0; linenum < maxlines; linenum++)
+	{
+	  y += app->rowsize;
+	  logentry_t * entry = logbuf_get(logbuf, linenum);
+	  if (!entry) continue;
+	  if (entry->glyphs)
+	    {
+	      app_glyph_text(app, FONT_LARGE, x, y, entry->line, entry->fade.intensity);
+	      app->frame.lines++;
+	      continue;
+	    }
+	  if (!entry->surf)
+	    {
+	      /* rule in place of text not rasterized yet. */
+	      if (entry->line[0])
+		composite_hline(comp, x, y + app->rowsize / 2, app_placeholder_width(app, entry));
+	      continue;
+	    }
+	  /* intensity persists past fade period, as texture alpha mod does. */
+	  composite_blit(comp, x, y, entry->surf, entry->fade.intensity);
+	  app->frame.lines++;
+	}
+    }
+  TRACE_END(TRACE_GFX_COLUMNS);
 
-/* handle JOYBALLMOTION (joystick trackball) event. */
-int app_on_joyball (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_JOY, "%d/BALL/%d: %+d%+d",
-	     evt->jball.which,
-	     evt->jball.ball,
-	     evt->jball.xrel,
-	     evt->jball.yrel);
-  return 0;
-}
+  TRACE_BEGIN(TRACE_GFX_DECOR);
+  app_render_decor(app);
+  app_render_stats(app);
+  TRACE_END(TRACE_GFX_DECOR);
 
-/* handle JOYBUTTONDOWN (joystick button press) event. */
-int app_on_joybdown (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_JOY, "%d/PRESS: %d",
-	     evt->jbutton.which,
-	     evt->jbutton.button);
-  return 0;
-}
+  composite_present(comp, app->r);
+  app->frame.drawcalls++;
+  app->frame.switches++;
+  app->frame.uploaded += (long)comp->w * comp->h * sizeof(Uint32);
+
+  TRACE_BEGIN(TRACE_GFX_PRESENT);
+  PROBE1(present_start, app->heartbeats.n);
+  SDL_RenderPresent(app->r);
+  PROBE1(present_done, app->heartbeats.n);
+  TRACE_END(TRACE_GFX_PRESENT);
 
-/* handle JOYBUTTONUP (joystick button up) event. */
-int app_on_joybup (app_t * app, SDL_Event * evt)
-{
-  return app_fwrite(app, CAT_JOY, "%d/RELEASE: %d",
-	     evt->jbutton.which,
-	     evt->jbutton.button);
   return 0;
 }
 
-/* handle joystick device events: connect, disconnect. */
-int app_on_joydev (app_t * app, SDL_Event * evt)
+/* Handle all graphics output: collect the frame in the display list, then submit in batches. */
+int app_cycle_gfx (app_t * app, long t)
 {
-  const char * action = "?";
-  char jsname[80] = { 0, };
-  char jsguid[80] = { 0, };
-  int n = 0;
-  int packidx = -1; /* opened joystick handles used by this app. */
+  (void)t;
+  if (app->comp.active)
+    return app_composite_gfx(app);
+  displist_t * dl = &app->displist;
+  SDL_SetRenderDrawColor(app->r, 0,0,0,0);
+  SDL_RenderClear(app->r);
 
-  /* device number, queried from system. */
-  int devnum = -1;
-  /* Joystick instance id, used by SDL events reporting. */
-  int instid = -1;
+  SDL_SetRenderDrawColor(app->r, 0xff,0xff,0xff,0xff);
 
-  switch (evt->jdevice.type)
+  int x0 = 0;
+  int y0 = 40;
+  int x, y;
+  TRACE_BEGIN(TRACE_GFX_COLUMNS);
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
     {
-    case SDL_JOYDEVICEADDED:
-      action = "ADD";
-      /* add to open devices. */
-      devnum = evt->jdevice.which; /* joystick device index. */
-      /* find empty handle slot. */
-      packidx = find_slot(MAX_JOYSTICKS, (void**)(app->jspack), NULL, NULL);
-      if ((0 <= packidx) && (packidx < MAX_JOYSTICKS))
+      x = x0 + (catnum * app->width / MAX_CATEGORIES);
+      y = y0;
+      if (catnum > 0)
+	{
+	  // separator line.
+	  SDL_Rect sep = { x-4, y, 1, app->height - y };
+	  displist_fill(dl, &sep);
+	}
+
+      /* Place category name as column header. */
+      int decorid_cat = catnum + DECORID_CATEGORIES;
+      if (!app_get_decor(app, decorid_cat))
+	app_install_text(app, decorid_cat, FONT_LARGE, x, y, catlabel[catnum]);
+
+      /* Queue log lines for current category, with age-fade alpha. */
+      struct logbuf_s * logbuf = app->logbuf + catnum;
+      int maxlines = logbuf->cap;
+      for (int linenum = 0; linenum < maxlines; linenum++)
 	{
-	  /* valid slot, open device. */
-	  SDL_Joystick * openjs = SDL_JoystickOpen(devnum);
-	  app->jspack[packidx] = openjs;
-	  if (openjs)
+	  y += app->rowsize;
+	  logentry_t * entry = logbuf_get(logbuf, linenum);
+	  if (!entry) continue;
+	  /* intensity persists past fade period, as texture alpha mod did. */
+	  if (entry->glyphs)
 	    {
-	      instid = SDL_JoystickInstanceID(openjs);
-	      SDL_JoystickGetGUIDString(SDL_JoystickGetGUID(openjs), jsguid, sizeof(jsguid));
-	      n = SDL_snprintf(jsname, sizeof(jsname), "%s", SDL_JoystickName(openjs));
-	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opened joystick handle %d as instance #%d from index %d \"%s\" (%s).", packidx, instid, devnum, jsname, jsguid);
+	      app_glyph_text(app, FONT_LARGE, x, y, entry->line, entry->fade.intensity);
+	      app->frame.lines++;
 	    }
-	  else
+	  else if (entry->row)
 	    {
-	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Out of handles while tyring to open joystick #%d", devnum);
+	      SDL_Rect src;
+	      rowpool_rect(&app->rows, entry->row, &src);
+	      src.w = entry->w;
+	      src.h = entry->h;
+	      SDL_Rect dst = { x, y, entry->w, entry->h };
+	      displist_copy(dl, rowpool_sheet(&app->rows, entry->row), &src, &dst, entry->fade.intensity);
+	      app->frame.lines++;
 	    }
-	}
-      else
-	{
-	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Unable to open joystick #%d.", devnum);
-	}
-      break;
-    case SDL_JOYDEVICEREMOVED:
-      action = "REMOVE";
-      /* remove from open devices. */
-      instid = evt->jdevice.which; /* joystick instance id. */
-      /* find matching instid. */
-      for (packidx = 0; packidx < MAX_JOYSTICKS; packidx++)
-	{
-	  if (! app->jspack[packidx])
-	    continue;
-	  SDL_Joystick * doomedjs = app->jspack[packidx];
-	  if (SDL_JoystickInstanceID(doomedjs) == instid)
+	  else if (entry->tex && entry->surf)
 	    {
-	      /* joystick number matches; close and remove from handles */
-	      n = SDL_snprintf(jsname, sizeof(jsname), "%s", SDL_JoystickName(doomedjs));
-	      SDL_JoystickClose(app->jspack[packidx]);
-	      app->jspack[packidx] = NULL;
-	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Closed joystck handle %d being joystick #%d \"%s\"", packidx, instid, jsname);
+	      SDL_Rect dst = { x, y, entry->surf->w, entry->surf->h };
+	      displist_copy(dl, entry->tex, NULL, &dst, entry->fade.intensity);
+	      app->frame.lines++;
+	    }
+	  else if (entry->line[0])
+	    {
+	      /* rule in place of text not rasterized yet. */
+	      SDL_Rect rule = { x, y + app->rowsize / 2, app_placeholder_width(app, entry), 1 };
+	      displist_fill(dl, &rule);
 	    }
 	}
-      break;
     }
-  /* TODO: truncate jsname at 12th glyph, not 12th byte. */
-  if (n > 11)
-    jsname[11] = '\0';
-  app_fwrite(app, CAT_JOY, "%s: %d=%s", action, instid, jsname);
-  return 0;
-}
+  TRACE_END(TRACE_GFX_COLUMNS);
 
+  /* render the permanent decorations. */
+  TRACE_BEGIN(TRACE_GFX_DECOR);
+  app_render_decor(app);
+  app_render_stats(app);
+  TRACE_END(TRACE_GFX_DECOR);
 
-/* handle CONTROLLERAXISMOTION (SDL Game Controller joystick) event. */
-int app_on_gameaxis (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_CONTROLLER, "%d/AXIS/%d: %d",
-	     evt->caxis.which,
-	     evt->caxis.axis,
-	     evt->caxis.value);
-  return 0;
-}
+  TRACE_BEGIN(TRACE_GFX_SUBMIT);
+  displist_submit(dl, app->r, &app->frame);
+  TRACE_END(TRACE_GFX_SUBMIT);
 
-/* handle CONTROLLERBUTTONDOWN (SDL Game Controller button press) event. */
-int app_on_gamebdown (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_CONTROLLER, "%d/PRESS: %d",
-	     evt->cbutton.which,
-	     evt->cbutton.button);
-  return 0;
-}
+  TRACE_BEGIN(TRACE_GFX_PRESENT);
+  PROBE1(present_start, app->heartbeats.n);
+  SDL_RenderPresent(app->r);
+  PROBE1(present_done, app->heartbeats.n);
+  TRACE_END(TRACE_GFX_PRESENT);
 
-/* handle CONTROLLERBUTTONUP (SDL Game Controller button release) event. */
-int app_on_gamebup (app_t * app, SDL_Event * evt)
-{
-  app_fwrite(app, CAT_CONTROLLER, "%d/RELEASE: %d",
-	     evt->cbutton.which,
-	     evt->cbutton.button);
   return 0;
 }
 
+/* Dispatch one event by type. */
 static
-int gamedev_instanceid_eq_p (void * obj, void * userdata)
+int app_dispatch (app_t * app, SDL_Event * evt)
 {
-  SDL_GameController * gc = (SDL_GameController*)obj;
-  int cmp = (long)userdata;
-  if (obj == NULL) return 0;
-  return (cmp == SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(gc)));
+  PROBE_EVENT(handler_entry, evt);
+  switch (evt->type)
+    {
+    case SDL_QUIT:
+      app->alive = 0;
+      break;
+    case SDL_WINDOWEVENT:
+      app_on_window(app, evt);
+      break;
+    case SDL_KEYDOWN:
+      app_on_keydown(app, evt);
+      break;
+    case SDL_KEYUP:
+      app_on_keyup(app, evt);
+      break;
+    case SDL_MOUSEMOTION:
+      app_on_mousemove(app, evt);
+      break;
+    case SDL_MOUSEBUTTONDOWN:
+      app_on_mousebdown(app, evt);
+      break;
+    case SDL_MOUSEBUTTONUP:
+      app_on_mousebup(app, evt);
+      break;
+    case SDL_MOUSEWHEEL:
+      app_on_mousewheel(app, evt);
+      break;
+    case SDL_JOYAXISMOTION:
+      app_on_joyaxis(app, evt);
+      break;
+    case SDL_JOYHATMOTION:
+      app_on_joyhat(app, evt);
+      break;
+    case SDL_JOYBALLMOTION:
+      app_on_joyball(app, evt);
+      break;
+    case SDL_JOYBUTTONDOWN:
+      app_on_joybdown(app, evt);
+      break;
+    case SDL_JOYBUTTONUP:
+      app_on_joybup(app, evt);
+      break;
+    case SDL_JOYDEVICEADDED:
+    case SDL_JOYDEVICEREMOVED:
+      app_on_joydev(app, evt);
+      break;
+    case SDL_CONTROLLERAXISMOTION:
+      app_on_gameaxis(app, evt);
+      break;
+    case SDL_CONTROLLERBUTTONDOWN:
+      app_on_gamebdown(app, evt);
+      break;
+    case SDL_CONTROLLERBUTTONUP:
+      app_on_gamebup(app, evt);
+      break;
+    case SDL_CONTROLLERDEVICEADDED:
+    case SDL_CONTROLLERDEVICEREMOVED:
+    case SDL_CONTROLLERDEVICEREMAPPED:
+      app_on_gamedev(app, evt);
+      break;
+#ifdef HAVE_CONTROLLER_SENSORS
+    case SDL_CONTROLLERSENSORUPDATE:
+      app_on_gamesensor(app, evt);
+      break;
+    case SDL_CONTROLLERTOUCHPADDOWN:
+    case SDL_CONTROLLERTOUCHPADMOTION:
+    case SDL_CONTROLLERTOUCHPADUP:
+      app_on_gametouch(app, evt);
+      break;
+#endif
+#ifdef HAVE_SENSORS
+    case SDL_SENSORUPDATE:
+      app_on_sensor(app, evt);
+      break;
+#endif
+    case SDL_FINGERDOWN:
+    case SDL_FINGERUP:
+    case SDL_FINGERMOTION:
+      app_on_finger(app, evt);
+      break;
+    case SDL_TEXTINPUT:
+      app_on_textinput(app, evt);
+      break;
+    case SDL_TEXTEDITING:
+      app_on_textedit(app, evt);
+      break;
+    default:
+      break;
+    }
+  PROBE_EVENT(handler_return, evt);
+  return 0;
 }
 
-/* handle SDL Game Controller device events: add, remove, remap. */
-int app_on_gamedev (app_t * app, SDL_Event * evt)
+/* Dispatch a run of n events of the same type; floods of motion get a loop without the type switch. */
+static
+int app_dispatch_run (app_t * app, SDL_Event * evts, int n)
 {
-  const char * action = "?";
-  char gcname[80] = { 0, };
-  int n = 0;
-  int devnum = -1;
-  long instid = -1;
-  int packidx = -1;
-
-  switch (evt->cdevice.type)
+  int i;
+  switch (evts->type)
     {
-    case SDL_CONTROLLERDEVICEADDED:
-      action = "ADD";
-      /* avoid duplicate */
-      instid = evt->cdevice.which;
-      packidx = find_slot(MAX_GAMEPADS, (void**)(app->gcpack),
-			  gamedev_instanceid_eq_p, (void*)instid);
-      if (packidx != -1) /* controller already handled. */
+    case SDL_JOYAXISMOTION:
+      for (i = 0; i < n; i++)
 	{
-	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Re-opening game controller (handle=%d, jsinstance=%ld)\n", packidx, instid);
-	  action = NULL;
-	  break;
+	  PROBE_EVENT(handler_entry, evts + i);
+	  app_on_joyaxis(app, evts + i);
+	  PROBE_EVENT(handler_return, evts + i);
 	}
-      /* find a slot. */
-      packidx = find_slot(MAX_GAMEPADS, (void**)(app->gcpack), NULL, NULL);
-      if (packidx > -1)
+      break;
+    case SDL_CONTROLLERAXISMOTION:
+      for (i = 0; i < n; i++)
 	{
-	  /* found slot; open device. */
-	  devnum = evt->cdevice.which;
-	  SDL_GameController * opengc = SDL_GameControllerOpen(devnum);
-	  if (opengc)
-	    {
-	      n = SDL_snprintf(gcname, sizeof(gcname), "%s", SDL_GameControllerName(opengc));
-	      instid = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(opengc));
-	      app->gcpack[packidx] = opengc;
-	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Opened game controller (handle=%d, jsinstance=%ld, sysid=%d) \"%s\".", packidx, instid, devnum, gcname);
-	    }
-	  else
-	    {
-	      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Unable to open game controller #%d.n", devnum);
-	    }
+	  PROBE_EVENT(handler_entry, evts + i);
+	  app_on_gameaxis(app, evts + i);
+	  PROBE_EVENT(handler_return, evts + i);
 	}
-      else
+      break;
+    case SDL_MOUSEMOTION:
+      for (i = 0; i < n; i++)
 	{
-	  SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Out of handles trying to open game controller #%d.", devnum);
+	  PROBE_EVENT(handler_entry, evts + i);
+	  app_on_mousemove(app, evts + i);
+	  PROBE_EVENT(handler_return, evts + i);
 	}
-
       break;
-    case SDL_CONTROLLERDEVICEREMOVED:
-      action = "REMOVE";
-      instid = evt->cdevice.which;
-      packidx = find_slot(MAX_GAMEPADS, (void**)(app->gcpack),
-			  gamedev_instanceid_eq_p, (void*)instid);
-      if (packidx > -1)
+    case SDL_JOYHATMOTION:
+      for (i = 0; i < n; i++)
 	{
-	  /* found for removal. */
-	  SDL_GameController * gc = app->gcpack[packidx];
-	  instid = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(gc));
-	  n = SDL_snprintf(gcname, sizeof(gcname), "%s", SDL_GameControllerName(gc));
-	  SDL_GameControllerClose(gc);
-	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Closed game controller %d (js #%ld) \"%s\".", packidx, instid, gcname);
-	  app->gcpack[packidx] = NULL;
+	  PROBE_EVENT(handler_entry, evts + i);
+	  app_on_joyhat(app, evts + i);
+	  PROBE_EVENT(handler_return, evts + i);
 	}
       break;
-    case SDL_CONTROLLERDEVICEREMAPPED:
-      action = "REMAP";
-      instid = evt->cdevice.which;
-      packidx = find_slot(MAX_GAMEPADS, (void**)(app->gcpack),
-			  gamedev_instanceid_eq_p, (void*)instid);
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Remapping on game controller %d.", packidx);
+#ifdef HAVE_CONTROLLER_SENSORS
+    case SDL_CONTROLLERSENSORUPDATE:
+      for (i = 0; i < n; i++)
+	{
+	  PROBE_EVENT(handler_entry, evts + i);
+	  app_on_gamesensor(app, evts + i);
+	  PROBE_EVENT(handler_return, evts + i);
+	}
+      break;
+#endif
+    default:
+      for (i = 0; i < n; i++)
+	app_dispatch(app, evts + i);
       break;
     }
-  /* TODO: truncate gcname at 12th glyph, not 12th byte. */
-  if (action)
+  return n;
+}
+
+/* Event line the way it was formatted before templates, with SDL_vsnprintf(); for --bench-format. */
+static
+int bench_printf_line (app_t * app, SDL_Event * evt)
+{
+  switch (evt->type)
+    {
+    case SDL_JOYAXISMOTION:
+      return app_fwrite(app, CAT_JOY, "%d/AXIS/%d: %d", evt->jaxis.which, evt->jaxis.axis, evt->jaxis.value);
+    case SDL_CONTROLLERAXISMOTION:
+      return app_fwrite(app, CAT_CONTROLLER, "%d/AXIS/%d: %d", evt->caxis.which, evt->caxis.axis, evt->caxis.value);
+    case SDL_MOUSEMOTION:
+      return app_fwrite(app, CAT_MOUSE, "MV: %+d%+d:(%d,%d)", evt->motion.xrel, evt->motion.yrel, evt->motion.x, evt->motion.y);
+    default:
+      return app_fwrite(app, CAT_JOY, "%d/PRESS: %d", evt->jbutton.which, evt->jbutton.button);
+    }
+}
+
+/* Synthetic event of the flood types, values spread over their range. */
+static
+void bench_event (SDL_Event * evt, int k)
+{
+  int v = (int)((k * 7919u) % 65536) - 32768;
+  SDL_memset(evt, 0, sizeof(*evt));
+  switch (k % 4)
+    {
+    case 0:
+      evt->type = SDL_JOYAXISMOTION;
+      evt->jaxis.which = k % 16;
+      evt->jaxis.axis = k % 6;
+      evt->jaxis.value = v;
+      break;
+    case 1:
+      evt->type = SDL_CONTROLLERAXISMOTION;
+      evt->caxis.which = k % 16;
+      evt->caxis.axis = k % 6;
+      evt->caxis.value = v;
+      break;
+    case 2:
+      evt->type = SDL_MOUSEMOTION;
+      evt->motion.xrel = v % 97;
+      evt->motion.yrel = -(v % 89);
+      evt->motion.x = k % 1920;
+      evt->motion.y = k % 1080;
+      break;
+    default:
+      evt->type = SDL_JOYBUTTONDOWN;
+      evt->jbutton.which = k % 16;
+      evt->jbutton.button = k % 15;
+      break;
+    }
+}
+
+/* Time event line formatting over n synthetic events, printf path against templates (--bench-format);
+   the two must agree. Returns number of lines that differ. */
+int app_bench_format (app_t * app, int n)
+{
+  SDL_Event evt;
+  int mismatches = 0;
+  for (int k = 0; k < 4096; k++)
+    {
+      char expect[MAX_LINELENGTH];
+      bench_event(&evt, k);
+      int category = (evt.type == SDL_MOUSEMOTION) ? CAT_MOUSE : (evt.type == SDL_CONTROLLERAXISMOTION) ? CAT_CONTROLLER : CAT_JOY;
+      bench_printf_line(app, &evt);
+      SDL_strlcpy(expect, logbuf_get(app->logbuf + category, -1)->line, sizeof(expect));
+      app_dispatch(app, &evt);
+      const char * got = logbuf_get(app->logbuf + category, -1)->line;
+      if (SDL_strcmp(expect, got) != 0)
+	{
+	  if (mismatches++ < 8)
+	    SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "bench-format: \"%s\" != \"%s\"", got, expect);
+	}
+    }
+
+  Uint64 freq = SDL_GetPerformanceFrequency();
+  Uint64 t0 = SDL_GetPerformanceCounter();
+  for (int k = 0; k < n; k++)
+    {
+      bench_event(&evt, k);
+      bench_printf_line(app, &evt);
+    }
+  Uint64 t1 = SDL_GetPerformanceCounter();
+  for (int k = 0; k < n; k++)
+    {
+      bench_event(&evt, k);
+      app_dispatch(app, &evt);
+    }
+  Uint64 t2 = SDL_GetPerformanceCounter();
+  double printf_ns = (double)(t1 - t0) * 1e9 / freq / n;
+  double template_ns = (double)(t2 - t1) * 1e9 / freq / n;
+  SDL_Log("bench-format: %d lines; printf %.1f ns/line, templates %.1f ns/line (%.1fx); %d mismatches",
+	  n, printf_ns, template_ns, printf_ns / template_ns, mismatches);
+
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
     {
-      if (n > 11)
-	gcname[11] = '\0';
-      app_fwrite(app, CAT_CONTROLLER, "%s: %ld=%s",
-		 action,
-		 instid,
-		 gcname);
+      logbuf_clear(app->logbuf + catnum);
+      app->overload[catnum].window = 0;
     }
-  return 0;
+  return mismatches;
 }
 
-int app_on_textinput (app_t * app, SDL_Event * evt)
+/* Count event for metrics, and against its device. */
+static
+void app_metrics_count (app_t * app, const SDL_Event * evt)
 {
-  char buf[MAX_LINELENGTH];
-  snprintf(buf, sizeof(buf), "TEXTINPUT %s", evt->text.text);
-  app_write(app, CAT_MISC, buf);
-  return 0;
+  metrics_count(&app->metrics, evt);
+  int cat = event_category(evt->type);
+  if ((evt->type == SDL_JOYDEVICEADDED) || (evt->type == SDL_CONTROLLERDEVICEADDED))
+    return;  /* device index, not instance id; counted once attached. */
+  if ((cat != CAT_JOY) && (cat != CAT_CONTROLLER))
+    return;
+  /* all joystick and controller events carry instance id in the same place. */
+  gamedev_t * dev = devreg_find(&app->devices, (cat == CAT_JOY) ? evt->jaxis.which : evt->caxis.which);
+  if (dev)
+    dev->events++;
 }
 
-int app_on_textedit (app_t * app, SDL_Event * evt)
+/* Render metrics in Prometheus text format and publish them. */
+void app_metrics_render (app_t * app, long t)
 {
-  (void)evt;
-  app_write(app, CAT_MISC, "TEXTEDITING");
-  return 0;
-}
+  metrics_t * metrics = &app->metrics;
+  char label[2 * sizeof(((gamedev_t*)0)->name)];
+  metrics->len = 0;
+  metrics->refreshed = t;
 
+  metrics_printf(metrics, "# HELP sdl_dumpevents_events_total Events taken from the SDL queue, by column.\n"
+		 "# TYPE sdl_dumpevents_events_total counter\n");
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    metrics_printf(metrics, "sdl_dumpevents_events_total{category=\"%s\"} %llu\n", catlabel[catnum], (unsigned long long)metrics->events[catnum]);
 
-/* Render text at a location for the current presentation cycle (frame). */
-int app_printxy (app_t * app, TTF_Font * fon, int x, int y, const char * msg)
-{
-  SDL_Color fg = { 0xff, 0xff, 0xff, 0xff };
-  SDL_Surface * textsurf = TTF_RenderUTF8_Blended(fon, msg, fg);
-  SDL_Rect dst = { x, y, textsurf->w, textsurf->h };
-  SDL_Texture * blttex = SDL_CreateTextureFromSurface(app->r, textsurf);
-  SDL_RenderCopy(app->r, blttex, NULL, &dst);
+  metrics_printf(metrics, "# HELP sdl_dumpevents_events_by_type_total Events taken from the SDL queue, by SDL event type.\n"
+		 "# TYPE sdl_dumpevents_events_by_type_total counter\n");
+  for (int i = 0; i < metrics->ntypes; i++)
+    {
+      const char * name = event_type_name(metrics->types[i]);
+      if (name)
+	metrics_printf(metrics, "sdl_dumpevents_events_by_type_total{type=\"%s\"} %llu\n", name, (unsigned long long)metrics->typecounts[i]);
+      else
+	metrics_printf(metrics, "sdl_dumpevents_events_by_type_total{type=\"0x%x\"} %llu\n", metrics->types[i], (unsigned long long)metrics->typecounts[i]);
+    }
+  if (metrics->othertypes)
+    metrics_printf(metrics, "sdl_dumpevents_events_by_type_total{type=\"other\"} %llu\n", (unsigned long long)metrics->othertypes);
 
-  SDL_DestroyTexture(blttex);
-  SDL_FreeSurface(textsurf);
+  metrics_printf(metrics, "# HELP sdl_dumpevents_device_events_total Events from each attached joystick or controller.\n"
+		 "# TYPE sdl_dumpevents_device_events_total counter\n");
+  for (int i = 0; i < app->devices.alloc; i++)
+    {
+      const gamedev_t * dev = app->devices.slots[i];
+      if (!dev) continue;
+      metrics_escape(label, sizeof(label), dev->name);
+      metrics_printf(metrics, "sdl_dumpevents_device_events_total{instance=\"%d\",kind=\"%s\",guid=\"%s\",name=\"%s\"} %llu\n",
+		     dev->instid, dev->gc ? "controller" : "joystick", dev->guid, label, (unsigned long long)dev->events);
+    }
 
-  return 0;
-}
+  metrics_histogram(metrics, "sdl_dumpevents_loop_interval_seconds", "Time from one main loop cycle to the next.", &metrics->loop);
+  metrics_histogram(metrics, "sdl_dumpevents_frame_seconds", "Time to draw and present a frame.", &metrics->frame);
+
+  metrics_printf(metrics, "# HELP sdl_dumpevents_text_rasterizations_total Log lines and labels rasterized by TTF.\n"
+		 "# TYPE sdl_dumpevents_text_rasterizations_total counter\n"
+		 "sdl_dumpevents_text_rasterizations_total %d\n", SDL_AtomicGet(&resstats.rasterized));
+  metrics_printf(metrics, "# HELP sdl_dumpevents_textures Textures held.\n"
+		 "# TYPE sdl_dumpevents_textures gauge\n"
+		 "sdl_dumpevents_textures %d\n", SDL_AtomicGet(&resstats.textures));
+  metrics_printf(metrics, "# HELP sdl_dumpevents_texture_bytes Memory of textures held.\n"
+		 "# TYPE sdl_dumpevents_texture_bytes gauge\n"
+		 "sdl_dumpevents_texture_bytes %ld\n", SDL_AtomicGet(&resstats.texturekb) * 1024L);
+  metrics_printf(metrics, "# HELP sdl_dumpevents_surfaces Surfaces held.\n"
+		 "# TYPE sdl_dumpevents_surfaces gauge\n"
+		 "sdl_dumpevents_surfaces %d\n", SDL_AtomicGet(&resstats.surfaces));
+
+  int serve_dropped = 0;
+#ifdef HAVE_EVSERVER
+  if (app->server.path)
+    serve_dropped = SDL_AtomicGet(&app->server.dropped);
+#endif /* HAVE_EVSERVER */
+  metrics_printf(metrics, "# HELP sdl_dumpevents_dropped_events_total Events not recorded (capture) or not sent (serve) for lack of buffer space.\n"
+		 "# TYPE sdl_dumpevents_dropped_events_total counter\n"
+		 "sdl_dumpevents_dropped_events_total{output=\"capture\"} %llu\n"
+		 "sdl_dumpevents_dropped_events_total{output=\"serve\"} %d\n",
+		 (unsigned long long)app->capture.dropped, serve_dropped);
+  metrics_printf(metrics, "# HELP sdl_dumpevents_quiet_axis_changes_total Axis changes within the deadband, not logged.\n"
+		 "# TYPE sdl_dumpevents_quiet_axis_changes_total counter\n"
+		 "sdl_dumpevents_quiet_axis_changes_total %llu\n", (unsigned long long)metrics->quiet);
+  metrics_printf(metrics, "# HELP sdl_dumpevents_overloaded Whether a column is summarizing instead of logging each line.\n"
+		 "# TYPE sdl_dumpevents_overloaded gauge\n");
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    metrics_printf(metrics, "sdl_dumpevents_overloaded{category=\"%s\"} %d\n", catlabel[catnum], app->overload[catnum].active ? 1 : 0);
 
-struct gfxdecor_s * app_get_decor (app_t * app, int decor_idx)
-{
-  if ((decor_idx < 0) || (decor_idx >= MAX_GFXDECOR))
-    return NULL;
-  struct gfxdecor_s * retval = app->decor + decor_idx;
-  if ((! retval->surf) && (! retval->tex))
-    return NULL;
-  return retval;
+  if (metrics->truncated)
+    {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "Metrics exceed %d bytes; cut off.", METRICS_TEXT_MAX);
+      metrics->truncated = SDL_FALSE;
+    }
+  metrics_publish(metrics);
 }
 
-int app_invalidate_decors (app_t * app)
+/* Drain SDL's event queue in batches: pump once, then take up to EVENT_BATCH events per call. */
+int app_cycle_events (app_t * app)
 {
-  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+  struct ingest_s * ingest = &app->ingest;
+  int n;
+  SDL_PumpEvents();
+  do
     {
-      int decor_idx = catnum + DECORID_CATEGORIES;
-      struct gfxdecor_s * retval = app->decor + decor_idx;
-      if (retval->tex)
+      n = SDL_PeepEvents(ingest->buf, EVENT_BATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+      if (n <= 0)
+	break;
+      feed_publish(&app->feed, ingest->buf, n);
+      server_publish(&app->server, ingest->buf, n);
+      capture_write(&app->capture, ingest->buf, n);
+      if (app->metrics.text)
 	{
-	  SDL_DestroyTexture(retval->tex);
-	  retval->tex = NULL;
+	  for (int i = 0; i < n; i++)
+	    app_metrics_count(app, ingest->buf + i);
 	}
-      if (retval->surf)
+      if (PROBE_ENABLED(event_ingest))
 	{
-	  SDL_FreeSurface(retval->surf);
-	  retval->surf = NULL;
+	  for (int i = 0; i < n; i++)
+	    PROBE4(event_ingest, ingest->buf[i].type, ingest->buf[i].jaxis.which, ingest->buf[i].common.timestamp, n);
+	}
+      int bucket = 0;
+      while ((bucket < EVENT_HIST_BUCKETS - 1) && ((2 << bucket) <= n))
+	bucket++;
+      ingest->hist[bucket]++;
+      ingest->nbatches++;
+      ingest->nevents += n;
+      app->frame.events += n;
+
+      for (int i = 0, j; i < n; i = j)
+	{
+	  for (j = i + 1; (j < n) && (ingest->buf[j].type == ingest->buf[i].type); j++)
+	    ;
+	  app_dispatch_run(app, ingest->buf + i, j - i);
+	  ingest->nruns++;
 	}
     }
+  while (n == EVENT_BATCH);
+
   return 0;
 }
 
-/* Generate and store text at a location to be rendered across many presentation cycles. */
-int app_install_text (app_t * app, int decor_idx, TTF_Font * fon, int x, int y, const char * msg)
+/* Log distribution of event batch sizes. */
+void app_ingest_report (app_t * app)
 {
-  SDL_Color fg = { 0xff, 0xff, 0xff, 0xff };
-  SDL_Texture * blttex = NULL;
-  SDL_Surface * textsurf = app->decor[decor_idx].surf;
+  struct ingest_s * ingest = &app->ingest;
+  if (! ingest->nbatches)
+    return;
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "events: %ld in %ld batches, %ld same-type runs",
+	      ingest->nevents, ingest->nbatches, ingest->nruns);
+  for (int i = 0; i < EVENT_HIST_BUCKETS; i++)
+    {
+      if (! ingest->hist[i])
+	continue;
+      int lo = 1 << i;
+      int hi = (i == EVENT_HIST_BUCKETS - 1) ? EVENT_BATCH : (2 << i) - 1;
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "  batch %3d-%3d: %ld (%.1f%%)",
+		  lo, hi, ingest->hist[i], 100.0 * ingest->hist[i] / ingest->nbatches);
+    }
+}
 
-  if (textsurf)
+/* Log live resource counts; returns number of surfaces, textures and fonts held. */
+int app_resource_report (app_t * app)
+{
+  int js = 0, gc = 0;
+  for (int i = 0; i < app->devices.alloc; i++)
     {
-      /* delete in preparation for overwrite. */
-      SDL_FreeSurface(textsurf);
-      textsurf = NULL;
-      blttex = app->decor[decor_idx].tex;
-      if (blttex)
-	{
-	  SDL_DestroyTexture(blttex);
-	  app->decor[decor_idx].tex = NULL;
-	}
+      gamedev_t * dev = app->devices.slots[i];
+      if (!dev) continue;
+      js += (dev->js != NULL);
+      gc += (dev->gc != NULL);
     }
+  int synthjs = 0;
+  for (int i = 0; i < app->synth.nattached; i++)
+    synthjs += (app->synth.js && app->synth.js[i]);
+  char lines[MAX_CATEGORIES * 8];
+  int n = 0;
+  /* SDL_snprintf() returns the untruncated length; stop once the buffer is full. */
+  for (int catnum = 0; (catnum < MAX_CATEGORIES) && (n < (int)sizeof(lines) - 1); catnum++)
+    n += SDL_snprintf(lines + n, sizeof(lines) - n, "%s%d", catnum ? "+" : "", logbuf_len(app->logbuf + catnum));
+
+  int surfaces = SDL_AtomicGet(&resstats.surfaces);
+  int textures = SDL_AtomicGet(&resstats.textures);
+  int fonts = SDL_AtomicGet(&resstats.fonts);
+  int heap = -1;
+#ifdef HAVE_MEMORY_FUNCTIONS
+  heap = SDL_GetNumAllocations();
+#endif /* HAVE_MEMORY_FUNCTIONS */
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+	      "Resources: surfaces %d (%dKB), textures %d (%dKB), rows %d/%d, fonts %d, lines %s, joysticks %d (+%d synth), controllers %d, heap %d allocations",
+	      surfaces, SDL_AtomicGet(&resstats.surfacekb), textures, SDL_AtomicGet(&resstats.texturekb),
+	      app->rows.inuse, app->rows.nsheets * ROWPOOL_SHEET_ROWS, fonts, lines, js, synthjs, gc, heap);
+  return surfaces + textures + fonts;
+}
 
-  textsurf = TTF_RenderUTF8_Blended(fon, msg, fg);
-  blttex = SDL_CreateTextureFromSurface(app->r, textsurf);
-  app->decor[decor_idx].x = x;
-  app->decor[decor_idx].y = y;
-  app->decor[decor_idx].surf = textsurf;
-  app->decor[decor_idx].tex = blttex;
+/* Worker pool for log line rasterization, started when first called (for a line the glyph atlas cannot draw);
+   NULL to rasterize on main thread. */
+static
+rasterpool_t * app_raster_pool (app_t * app)
+{
+  rasterpool_t * pool = &app->raster;
+  if (pool->nworkers)
+    return pool;
+  if ((pool->nthreads == 0) || pool->lock)
+    return NULL;  /* disabled, or failed to start. */
+  app_font_data(app);
+  return rasterpool_start(pool, app->font_data, app->font_size, app->fontlock) ? pool : NULL;
+}
 
-  return 0;
+/* Whether this frame's rasterization budget is used up. */
+static
+SDL_bool app_raster_spent (app_t * app, Uint64 deadline)
+{
+  return (app->raster_budget_ms > 0) && (SDL_GetPerformanceCounter() >= deadline);
 }
 
-/* Render the permanent decorations. */
-int app_render_decor (app_t * app)
+/* Upload surfaces finished by workers to lines still waiting for them, until deadline. */
+static
+int app_raster_collect (app_t * app, rasterpool_t * pool, Uint64 deadline)
 {
-  for (int i = 0; i < MAX_GFXDECOR; i++)
+  rasterjob_t done[16];
+  int total = 0;
+  int n;
+  while (!app_raster_spent(app, deadline) && ((n = rasterpool_collect(pool, done, SDL_arraysize(done))) > 0))
     {
-      struct gfxdecor_s * decor = app->decor + i;
-      SDL_Texture * blttex = decor->tex;
-      SDL_Surface * textsurf = decor->surf;
-      if (! blttex)
+      for (int i = 0; i < n; i++)
 	{
-	  textsurf = decor->surf;
-	  if (!textsurf)
-	    continue;
-	  blttex = SDL_CreateTextureFromSurface(app->r, textsurf);
-	  decor->tex = blttex;
+	  rasterjob_t * job = done + i;
+	  logbuf_t * logbuf = app->logbuf + job->catnum;
+	  logentry_t * entry = (job->slot < logbuf->cap) ? logbuf->buf + job->slot : NULL;
+	  if (!entry || !entry->pending || (entry->gen != job->gen))
+	    {
+	      /* line was overwritten while in flight. */
+	      res_free_surface(job->surf);
+	      continue;
+	    }
+	  entry->pending = SDL_FALSE;
+	  if (app->comp.active)
+	    entry->surf = job->surf;
+	  else
+	    app_upload_line(app, entry, job->surf);
 	}
-      SDL_Rect dst;
-      dst.x = decor->x;
-      dst.y = decor->y;
-      dst.w = textsurf->w;
-      dst.h = textsurf->h;
-
-      SDL_RenderCopy(app->r, blttex, NULL, &dst);
+      total += n;
     }
-
-  return 0;
+  return total;
 }
 
-/* Handle all graphics output. */
-int app_cycle_gfx (app_t * app, long t)
+/* Synchronize text surface and texture of log lines lacking them, newest lines first,
+   within the per-frame time budget; the rest wait for later frames (drawn as placeholders).
+   With worker threads, only queues lines and uploads finished ones, so input handling is never held up by TTF. */
+int app_update_raster (app_t * app)
 {
-  (void)t;
-  SDL_SetRenderDrawColor(app->r, 0,0,0,0);
-  SDL_RenderClear(app->r);
-
-  SDL_SetRenderDrawColor(app->r, 0xff,0xff,0xff,0xff);
+  Uint64 deadline = SDL_GetPerformanceCounter() + (Uint64)app->raster_budget_ms * SDL_GetPerformanceFrequency() / 1000;
+  /* pool (and TTF) only once some line needs more than the glyph atlas. */
+  rasterpool_t * pool = app->raster.nworkers ? &app->raster : NULL;
+  if (pool)
+    app_raster_collect(app, pool, deadline);
 
-  int x0 = 0;
-  int y0 = 40;
-  int x, y;
+  int maxlen = 0;
   for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
     {
-      x = x0 + (catnum * app->width / MAX_CATEGORIES);
-      y = y0;
-      if (catnum > 0)
+      if (logbuf_len(app->logbuf + catnum) > maxlen)
+	maxlen = logbuf_len(app->logbuf + catnum);
+    }
+  /* by age, across all columns. */
+  for (int age = 0; age < maxlen; age++)
+    {
+      for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
 	{
-	  // separator line.
-	  SDL_RenderDrawLine(app->r, x-4, y, x-4, app->height);
+	  struct logbuf_s * logbuf = app->logbuf + catnum;
+	  int linenum = logbuf_len(logbuf) - 1 - age;
+	  if (linenum < 0) continue;
+	  logentry_t * entry = logbuf_get(logbuf, linenum);
+	  if (entry->surf || entry->row || entry->glyphs || entry->pending)
+	    continue;
+	  const char * msg = entry->line;
+	  if (! *msg)
+	    continue;
+	  if (app_glyphs_p(app, FONT_LARGE, msg))
+	    {
+	      entry->glyphs = SDL_TRUE;
+	      continue;
+	    }
+	  if (app_raster_spent(app, deadline))
+	    {
+	      app->frame.deferred++;
+	      continue;
+	    }
+	  if (! pool)
+	    pool = app_raster_pool(app);
+	  if (pool)
+	    {
+	      rasterjob_t job;
+	      job.catnum = catnum;
+	      job.slot = entry - logbuf->buf;
+	      job.gen = entry->gen;
+	      job.fontnum = FONT_LARGE;
+	      job.mask = app->comp.active;
+	      SDL_strlcpy(job.text, msg, sizeof(job.text));
+	      job.surf = NULL;
+	      /* when full, try again next frame. */
+	      entry->pending = (rasterpool_submit(pool, &job) == 0);
+	      continue;
+	    }
+	  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "create text %d,%d", catnum, linenum);
+	  SDL_Surface * textsurf = app_render_text(app, FONT_LARGE, msg);
+	  if (app->comp.active)
+	    entry->surf = textsurf;
+	  else
+	    app_upload_line(app, entry, textsurf);
 	}
+    }
+  return 0;
+}
 
-      /* Place category name as column header. */
-      int decorid_cat = catnum + DECORID_CATEGORIES;
-      if (!app_get_decor(app, decorid_cat))
-	app_install_text(app, decorid_cat, app->fonts[2], x, y, catlabel[catnum]);
-
-      /* Render log lines for current category. */
+/* Calculate age-fade effect of log lines. */
+int app_update_fade (app_t * app, long t)
+{
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+    {
       struct logbuf_s * logbuf = app->logbuf + catnum;
       int maxlines = logbuf->cap;
       for (int linenum = 0; linenum < maxlines; linenum++)
 	{
-	  y += app->rowsize;
-	  logentry_t * entry = logbuf_get(app->logbuf + catnum, linenum);
+	  logentry_t * entry = logbuf_get(logbuf, linenum);
 	  if (!entry) continue;
-	  SDL_Surface * textsurf = entry->surf;
-	  SDL_Texture * blttex = entry->tex;
-	  if (blttex)
+	  long age = t - entry->fade.spawntime;
+	  if (age < app->age_fade_period)
 	    {
-	      /* age-fade effect. */
-	      if (entry->fade.active)
-		{
-		  SDL_SetTextureAlphaMod(blttex, entry->fade.intensity);
-		}
-
-	      /* render destination. */
-	      SDL_Rect dst;
-	      dst.x = x;
-	      dst.y = y;
-	      if (textsurf)
-		{
-		  dst.w = textsurf->w;
-		  dst.h = textsurf->h;
-		}
-	      else
-		{
-		  Uint32 fmt = 0;
-		  int access = 0;
-		  SDL_QueryTexture(blttex, &fmt, &access, &dst.w, &dst.h);
-		}
-
-	      /* render. */
-	      SDL_RenderCopy(app->r, blttex, NULL, &dst);
+	      /* calculate fading effect. */
+	      int age_scaled = (app->age_fade_start - app->age_fade_end) * age / app->age_fade_period;
+	      entry->fade.intensity = app->age_fade_start - age_scaled;
+	      entry->fade.active = SDL_TRUE;
+	    }
+	  else if (age < app->age_fade_period * 2)
+	    {
+	      /* clamp at end effect for a while. */
+	      entry->fade.intensity = app->age_fade_end;
+	      entry->fade.active = SDL_TRUE;
+	    }
+	  else if (entry->fade.active)
+	    {
+	      entry->fade.active = SDL_FALSE;
 	    }
 	}
-
-      /* render the permanent decorations. */
-      app_render_decor(app);
-
     }
+  return 0;
+}
 
-  SDL_RenderPresent(app->r);
+/* Replace column contents with its overload summary: indicator first, then one row per line type. */
+static
+void app_overload_show (app_t * app, int catnum)
+{
+  overload_t * ov = app->overload + catnum;
+  logbuf_t * logbuf = app->logbuf + catnum;
+  char buf[MAX_LINELENGTH];
+  int n;
 
-  return 0;
+  logbuf_clear(logbuf);
+  n = SDL_snprintf(buf, sizeof(buf), "OVERLOAD %d/s, %ld summarized", ov->rate, ov->summarized);
+  logbuf_append(logbuf, buf, n+1);
+  int rows = logbuf->cap - 1 - (ov->other > 0);
+  for (int i = 0; (i < ov->nkeys) && (i < rows); i++)
+    {
+      summary_t * ent = ov->keys + i;
+      n = SDL_snprintf(buf, sizeof(buf), "%s x%ld %d/s %s", ent->key, ent->count, ent->rate, ent->last);
+      logbuf_append(logbuf, buf, SDL_min(n, (int)sizeof(buf)-1)+1);
+    }
+  if (ov->other > 0)
+    {
+      n = SDL_snprintf(buf, sizeof(buf), "(other) x%ld", ov->other);
+      logbuf_append(logbuf, buf, n+1);
+    }
 }
 
-int app_cycle_events (app_t * app)
+/* Sample line rate per column; switch columns into summary when overloaded, and back with hysteresis. */
+int app_update_overload (app_t * app, long t)
 {
-  SDL_Event _evt, *evt=&_evt;
-  while (SDL_PollEvent(evt) > 0)
+  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
     {
-      switch (evt->type)
+      overload_t * ov = app->overload + catnum;
+      long elapsed = t - ov->window_t;
+      if (elapsed < OVERLOAD_WINDOW_MS)
+	continue;
+      ov->rate = ov->window * 1000 / elapsed;
+      ov->window = 0;
+      ov->window_t = t;
+      for (int i = 0; i < ov->nkeys; i++)
 	{
-	case SDL_QUIT:
-	  app->alive = 0;
-	  break;
-	case SDL_WINDOWEVENT:
-	  app_on_window(app, evt);
-	  break;
-	case SDL_KEYDOWN:
-	  app_on_keydown(app, evt);
-	  break;
-	case SDL_KEYUP:
-	  app_on_keyup(app, evt);
-	  break;
-	case SDL_MOUSEMOTION:
-	  app_on_mousemove(app, evt);
-	  break;
-	case SDL_MOUSEBUTTONDOWN:
-	  app_on_mousebdown(app, evt);
-	  break;
-	case SDL_MOUSEBUTTONUP:
-	  app_on_mousebup(app, evt);
-	  break;
-	case SDL_MOUSEWHEEL:
-	  app_on_mousewheel(app, evt);
-	  break;
-	case SDL_JOYAXISMOTION:
-	  app_on_joyaxis(app, evt);
-	  break;
-	case SDL_JOYHATMOTION:
-	  app_on_joyhat(app, evt);
-	  break;
-	case SDL_JOYBALLMOTION:
-	  app_on_joyball(app, evt);
-	  break;
-	case SDL_JOYBUTTONDOWN:
-	  app_on_joybdown(app, evt);
-	  break;
-	case SDL_JOYBUTTONUP:
-	  app_on_joybup(app, evt);
-	  break;
-	case SDL_JOYDEVICEADDED:
-	case SDL_JOYDEVICEREMOVED:
-	  app_on_joydev(app, evt);
-	  break;
-	case SDL_CONTROLLERAXISMOTION:
-	  app_on_gameaxis(app, evt);
-	  break;
-	case SDL_CONTROLLERBUTTONDOWN:
-	  app_on_gamebdown(app, evt);
-	  break;
-	case SDL_CONTROLLERBUTTONUP:
-	  app_on_gamebup(app, evt);
-	  break;
-	case SDL_CONTROLLERDEVICEADDED:
-	case SDL_CONTROLLERDEVICEREMOVED:
-	case SDL_CONTROLLERDEVICEREMAPPED:
-	  app_on_gamedev(app, evt);
-	  break;
-	case SDL_TEXTINPUT:
-	  app_on_textinput(app, evt);
-	  break;
-	case SDL_TEXTEDITING:
-	  app_on_textedit(app, evt);
-	  break;
-	default:
-	  break;
+	  ov->keys[i].rate = ov->keys[i].window * 1000 / elapsed;
+	  ov->keys[i].window = 0;
 	}
-    }
 
+      int threshold = app->logbuf[catnum].cap * OVERLOAD_NOMINAL_FPS;
+      if (! ov->active)
+	{
+	  if (ov->rate <= threshold)
+	    continue;
+	  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "%s overloaded at %d lines/s; summarizing.", catlabel[catnum], ov->rate);
+	  capture_trigger(&app->capture, t);
+	  ov->active = SDL_TRUE;
+	  ov->summarized = ov->other = 0;
+	  ov->nkeys = 0;
+	  ov->calm_t = 0;
+	}
+      else if (ov->rate < threshold / OVERLOAD_EXIT_RATIO)
+	{
+	  if (! ov->calm_t)
+	    ov->calm_t = t;
+	  if (t - ov->calm_t >= OVERLOAD_HOLD_MS)
+	    {
+	      char buf[MAX_LINELENGTH];
+	      int n = SDL_snprintf(buf, sizeof(buf), "OVERLOAD ended, %ld summarized", ov->summarized);
+	      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "%s: %s.", catlabel[catnum], buf);
+	      ov->active = SDL_FALSE;
+	      logbuf_clear(app->logbuf + catnum);
+	      logbuf_append(app->logbuf + catnum, buf, n+1);
+	      continue;
+	    }
+	}
+      else
+	{
+	  ov->calm_t = 0;
+	}
+      app_overload_show(app, catnum);
+    }
   return 0;
 }
 
@@ -1565,73 +9044,110 @@ int app_cycle_updates (app_t * app, long t)
       SDL_snprintf(buf, sizeof(buf), "%s +%d x̄=%ld σ=%ld", which ? heart0 : heart1, delta, mean, sigma);
       int x = 0;
       int y = app->height - 20;
-      app_install_text(app, MAX_GFXDECOR-1, app->fonts[2], x, y, buf);
+      app_install_text(app, MAX_GFXDECOR-1, FONT_LARGE, x, y, buf);
     };
   heartbeats->n++;
 
   /* banner text at top of surface. */
   if (!app_get_decor(app, DECORID_BANNER))
-    app_install_text(app, DECORID_BANNER, app->fonts[2], 0, 0, BANNER);
+    app_install_text(app, DECORID_BANNER, FONT_LARGE, 0, 0, BANNER);
   if (!app_get_decor(app, DECORID_ENTRYBOX))
-    app_install_text(app, DECORID_ENTRYBOX, app->fonts[2], 0, 0, app->entrybox.buf[0].line);
+    app_install_text(app, DECORID_ENTRYBOX, FONT_LARGE, 0, 0, app->entrybox.buf[0].line);
 
+  app_update_overload(app, t);
+  app_update_sensors(app, t);
 
-  for (int catnum = 0; catnum < MAX_CATEGORIES; catnum++)
+  if (app->resource_log_s && (t - app->resource_log_t >= app->resource_log_s * 1000L))
     {
-      struct logbuf_s * logbuf = app->logbuf + catnum;
-      int maxlines = logbuf->cap;
-      for (int linenum = 0; linenum < maxlines; linenum++)
-	{
-	  /* Synchronize associated text surface. */
-	  logentry_t * entry = logbuf_get(logbuf, linenum);
-	  if (!entry) continue;
-	  if (! entry->surf)
-	    {
-	      SDL_Color fg = { 0xff, 0xff, 0xff, 0xff };
-	      TTF_Font * fon = app->fonts[2];
-	      const char * msg = entry ? entry->line : NULL;
-	      if (msg && *msg)
-		{
-		  SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "create text %d,%d", catnum, linenum);
-		  SDL_Surface * textsurf = TTF_RenderUTF8_Blended(fon, msg, fg);
-		  entry->tex = SDL_CreateTextureFromSurface(app->r, textsurf);
-		  entry->surf = textsurf;
-		}
-	    }
-
-	  /* Calculate age-fade effect. */
-	  long age = t - entry->fade.spawntime;
-	  if (age < app->age_fade_period)
-	    {
-	      /* calculate fading effect. */
-	      int age_scaled = (app->age_fade_start - app->age_fade_end) * age / app->age_fade_period;
-	      entry->fade.intensity = app->age_fade_start - age_scaled;
-	      entry->fade.active = SDL_TRUE;
-	    }
-	  else if (age < app->age_fade_period * 2)
-	    {
-	      /* clamp at end effect for a while. */
-	      entry->fade.intensity = app->age_fade_end;
-	      entry->fade.active = SDL_TRUE;
-	    }
-	  else if (entry->fade.active)
-	    {
-	      entry->fade.active = SDL_FALSE;
-	    }
-	}
+      app_resource_report(app);
+      app->resource_log_t = t;
     }
 
+  TRACE_BEGIN(TRACE_UPDATES_RASTER);
+  app_update_raster(app);
+  TRACE_END(TRACE_UPDATES_RASTER);
+
+  TRACE_BEGIN(TRACE_UPDATES_FADE);
+  app_update_fade(app, t);
+  TRACE_END(TRACE_UPDATES_FADE);
+
   return 0;
 }
 
+/* Tally frames that allocated once warm (--check-alloc); ends the run with a verdict when time is up. */
+static
+void app_check_alloc (app_t * app, long t)
+{
+  struct checkalloc_s * chk = &app->checkalloc;
+  if (chk->seconds <= 0)
+    return;
+  if (! chk->t0)
+    chk->t0 = t;
+  long elapsed = t - chk->t0;
+  if (elapsed < CHECK_ALLOC_WARMUP_MS)
+    return;
+  chk->frames++;
+  if (app->frame.allocs > 0)
+    {
+      if (chk->dirty < CHECK_ALLOC_REPORT)
+	SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "check-alloc: frame %ld made %d allocations, %ld bytes.",
+		    chk->frames, app->frame.allocs, app->frame.allocbytes);
+      chk->dirty++;
+      chk->allocs += app->frame.allocs;
+      chk->bytes += app->frame.allocbytes;
+    }
+  if (elapsed < CHECK_ALLOC_WARMUP_MS + chk->seconds * 1000L)
+    return;
+  chk->failed = (chk->dirty > 0);
+  SDL_Log("check-alloc: %ld of %ld frames allocated (%ld allocations, %ld bytes): %s",
+	  chk->dirty, chk->frames, chk->allocs, chk->bytes, chk->failed ? "FAIL" : "ok");
+  app->alive = 0;
+}
+
 /* One step of main loop. */
 int app_cycle (app_t * app, long t)
 {
+  if (mapdb_poll(&app->mapdb, t))
+    app_fwrite(app, CAT_CONTROLLER, "MAPS: %d applied", app->mapdb.napplied);
+  capture_poll(&app->capture, t);
+  Uint64 cyclestart = SDL_GetPerformanceCounter();
+  if (app->metrics.cyclemark)
+    metrics_observe(&app->metrics, &app->metrics.loop, cyclestart - app->metrics.cyclemark);
+  app->metrics.cyclemark = cyclestart;
+
+  TRACE_BEGIN(TRACE_CYCLE_EVENTS);
   app_cycle_events(app);
+  TRACE_END(TRACE_CYCLE_EVENTS);
 
+  TRACE_BEGIN(TRACE_CYCLE_UPDATES);
   app_cycle_updates(app, t);
+  TRACE_END(TRACE_CYCLE_UPDATES);
 
+  TRACE_BEGIN(TRACE_CYCLE_GFX);
+  Uint64 gfxstart = SDL_GetPerformanceCounter();
   app_cycle_gfx(app, t);
+  metrics_observe(&app->metrics, &app->metrics.frame, SDL_GetPerformanceCounter() - gfxstart);
+  TRACE_END(TRACE_CYCLE_GFX);
+
+  TRACE_COUNTER(TRACE_COUNT_EVENTS, app->frame.events);
+  TRACE_COUNTER(TRACE_COUNT_TEXTURES, app->frame.textures);
+  TRACE_COUNTER(TRACE_COUNT_LINES, app->frame.lines);
+  TRACE_COUNTER(TRACE_COUNT_DRAWCALLS, app->frame.drawcalls);
+
+  Uint32 allocs = (Uint32)SDL_AtomicGet(&allocstats.count);
+  Uint32 allocbytes = (Uint32)SDL_AtomicGet(&allocstats.bytes);
+  app->frame.allocs = (int)(allocs - app->allocmark);
+  app->frame.allocbytes = allocbytes - app->allocbytesmark;
+  app->allocmark = allocs;
+  app->allocbytesmark = allocbytes;
+  app_check_alloc(app, t);
+
+  app->metrics.quiet += app->frame.quiet;
+  if (app->metrics.text && (t - app->metrics.refreshed >= METRICS_REFRESH_MS))
+    app_metrics_render(app, t);
+
+  app->stats = app->frame;
+  SDL_memset(&app->frame, 0, sizeof(app->frame));
   return 0;
 }
 
@@ -1644,6 +9160,11 @@ int app_main (app_t * app)
     {
       long t = SDL_GetTicks();
       app_cycle(app, t);
+      if (app->startup.trace)
+	{
+	  app_startup_phase(app, "first frame");
+	  app_startup_report(app);
+	}
     }
 
   return 0;
@@ -1655,9 +9176,10 @@ app_t _app, *app=&_app;
 int main (int argc, char *argv[])
 {
   if (!app_init(app, argc, argv))
-    return 1;
+    return app->exitcode;
   app_main(app);
+  int status = app->checkalloc.failed ? 1 : 0;
   app_destroy(app);
-  return 0;
+  return status;
 }
 
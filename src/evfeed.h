@@ -0,0 +1,129 @@
+/*
+    Shared-memory event feed layout for SDL_DumpEvents.
+    Copyright (C) 2018  Fred Lee <fredslee27@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+/*
+   With --feed=NAME, SDL_DumpEvents publishes every event it ingests into the POSIX shared
+   memory object NAME: one evfeed_header_t, then a ring of nrecords evfeed_record_t.
+   There is one writer; any number of readers map it read-only (shm_open(NAME, O_RDONLY, 0),
+   mmap(PROT_READ, MAP_SHARED)) and follow it without locks or system calls:
+
+   1. Check magic and version; take recsize and nrecords from the header.
+   2. Pick the first sequence number s to read: head + 1 for new events only, or 1.
+   3. While head < s, nothing new; poll again later.
+   4. Copy the record in slot (s - 1) % nrecords.  It is valid if its seq equals s
+      both before and after the copy (acquire ordering on both reads).
+   5. Otherwise, or if head - s >= nrecords, the writer lapped the reader and records
+      from s on were overwritten; resume at head - nrecords + 1 and count the loss.
+
+   Sequence numbers start at 1 and are never reused while the writer runs.
+   Multi-byte fields are in the writer's native byte order.
+
+   The same records are sent to binary --serve subscribers, and written to capture files
+   by --record: one evcapture_header_t, then metasize bytes listing the devices attached
+   when the file was started, then records back to back until end of file.  The device
+   list is one line per device, "INSTANCE joystick|controller GUID NAME\n", padded with
+   NUL bytes to a multiple of recsize.  In capture files only, each joystick or controller
+   device-added record is followed by an evcapture_device_t naming the device, so a file
+   names every device its records refer to.  Version 1 files have no device list, and
+   versions before 3 no device records.
+*/
+#ifndef EVFEED_H
+#define EVFEED_H
+
+#include <stdint.h>
+
+#define EVFEED_MAGIC 0x44465645u  /* "EVFD" */
+#define EVFEED_VERSION 1
+
+/* Header, two cache lines; head sits alone in the second one. */
+typedef struct evfeed_header_s {
+    uint32_t magic;      /* EVFEED_MAGIC, set once the rest of the header is valid. */
+    uint16_t version;    /* EVFEED_VERSION; readers must reject others. */
+    uint16_t recsize;    /* sizeof(evfeed_record_t). */
+    uint32_t nrecords;   /* ring length, a power of two. */
+    uint32_t pid;        /* writer process. */
+    uint64_t frequency;  /* counter ticks per second. */
+    uint8_t reserved0[40];
+    volatile uint64_t head;  /* sequence number of newest record published; 0 if none. */
+    uint8_t reserved1[56];
+} evfeed_header_t;
+
+/* One event, one cache line.  Fields by event type (SDL_EventType values):
+   joystick/controller axis:   which, index = axis, value
+   joystick hat:               which, index = hat, value
+   joystick ball:              which, index = ball, xrel, yrel
+   joystick/controller button: which, index = button, value = state
+   joystick/controller device: which (device index when added, instance id otherwise)
+   mouse motion:               which, value = button state, x, y, xrel, yrel
+   mouse button:               which, index = button, value = state, x, y
+   mouse wheel:                which, x, y
+   key:                        which = window id, index = scancode, value = keycode, x = modifiers, y = repeat
+   controller sensor:          which, index = sensor type, x, y, value = data[0..2] x 1000
+   standalone sensor:          which = sensor instance id, x, y, value = data[0..2] x 1000
+   controller touchpad:        which, index = touchpad, value = finger, x, y, xrel = pressure (x 65535)
+   finger:                     which = touch id, index = finger id (low 32 bits), value = pressure,
+                               x, y, xrel = dx, yrel = dy (x 65535)
+   other types:                which = -1; type and timestamps only.
+*/
+typedef struct evfeed_record_s {
+    volatile uint64_t seq;  /* written last; 0 while the slot is being rewritten. */
+    uint64_t counter;       /* writer's performance counter when the event was ingested. */
+    uint32_t type;
+    uint32_t timestamp;     /* SDL event timestamp, ms. */
+    int32_t which;
+    int32_t index;
+    int32_t value;
+    int32_t x;
+    int32_t y;
+    int32_t xrel;
+    int32_t yrel;
+    uint8_t reserved[12];
+} evfeed_record_t;
+
+#define EVCAPTURE_MAGIC 0x50435645u  /* "EVCP" */
+#define EVCAPTURE_VERSION 3
+
+/* Capture file header, one cache line. */
+typedef struct evcapture_header_s {
+    uint32_t magic;      /* EVCAPTURE_MAGIC. */
+    uint16_t version;    /* EVCAPTURE_VERSION. */
+    uint16_t recsize;    /* sizeof(evfeed_record_t). */
+    uint64_t frequency;  /* counter ticks per second. */
+    uint64_t t0;         /* counter when recording started. */
+    uint32_t metasize;   /* bytes of device list after header (version 2). */
+    uint8_t reserved[36];
+} evcapture_header_t;
+
+/* Record type of evcapture_device_t; outside the range of SDL event types. */
+#define EVCAPTURE_DEVICE 0xFFFF0001u
+
+/* Device record in a capture file (version 3), laid out over one evfeed_record_t. */
+typedef struct evcapture_device_s {
+    uint64_t seq;         /* same as the device-added record before it. */
+    uint64_t counter;
+    uint32_t type;        /* EVCAPTURE_DEVICE. */
+    uint32_t timestamp;
+    int32_t which;        /* instance id, as later records of the device carry. */
+    int32_t index;        /* device index, as in the device-added record. */
+    int32_t controller;   /* 1 if a game controller, else 0. */
+    uint8_t guid[16];
+    char name[12];        /* start of device name, NUL-padded; unterminated if cut. */
+} evcapture_device_t;
+
+#endif /* EVFEED_H */
@@ -0,0 +1,175 @@
+/* gcc `pkg-config --cflags --libs sdl2 SDL2_ttf`
+
+-Wall -Wextra -pedantic -Wstrict-prototypes
+*/
+/*
+    Bake glyph atlas header for SDL_DumpEvents.
+    Copyright (C) 2018  Fred Lee <fredslee27@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+/*
+   Rasterize the glyphs SDL_DumpEvents displays from a monospace TTF at build time,
+   and write them to stdout as a C header of 8-bit coverage cells.
+
+   usage: mkatlas FONT.ttf PTSIZE > glyph_atlas.h
+*/
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+/* Codepoints beyond printable ASCII used by the heartbeat report. */
+static const Uint16 extra_codepoints[] = {
+    0x0304,  /* COMBINING MACRON (x-bar) */
+    0x03C3,  /* GREEK SMALL LETTER SIGMA */
+    0x2661,  /* WHITE HEART SUIT */
+    0x2665,  /* BLACK HEART SUIT */
+};
+
+/* Encode codepoint as UTF-8; returns bytes written (no terminator). */
+static
+int utf8_encode (char * out, Uint16 cp)
+{
+  if (cp < 0x80)
+    {
+      out[0] = cp;
+      return 1;
+    }
+  if (cp < 0x800)
+    {
+      out[0] = 0xc0 | (cp >> 6);
+      out[1] = 0x80 | (cp & 0x3f);
+      return 2;
+    }
+  out[0] = 0xe0 | (cp >> 12);
+  out[1] = 0x80 | ((cp >> 6) & 0x3f);
+  out[2] = 0x80 | (cp & 0x3f);
+  return 3;
+}
+
+/* Emit one cell of coverage for codepoint; returns 0 if it cannot be rendered. */
+static
+int emit_cell (TTF_Font * fon, Uint16 cp, int cell_w, int cell_h)
+{
+  char text[8] = { 0, };
+  int n = 0;
+  SDL_bool combining = (0x0300 <= cp) && (cp < 0x0370);
+  if (combining)
+    {
+      /* combining marks have no advance; render over a no-break space to place it in a cell. */
+      n = utf8_encode(text, 0x00a0);
+    }
+  utf8_encode(text + n, cp);
+
+  SDL_Color fg = { 0xff, 0xff, 0xff, 0xff };
+  SDL_Surface * rendered = TTF_RenderUTF8_Blended(fon, text, fg);
+  if (! rendered)
+    return 0;
+  SDL_Surface * surf = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_ARGB8888, 0);
+  SDL_FreeSurface(rendered);
+  if (! surf)
+    return 0;
+
+  printf("  /* U+%04X */\n ", cp);
+  SDL_LockSurface(surf);
+  for (int y = 0; y < cell_h; y++)
+    {
+      for (int x = 0; x < cell_w; x++)
+	{
+	  Uint8 cov = 0;
+	  if ((x < surf->w) && (y < surf->h))
+	    {
+	      Uint32 px = ((Uint32*)((Uint8*)surf->pixels + y * surf->pitch))[x];
+	      cov = px >> 24;
+	    }
+	  printf(" %d,", cov);
+	}
+      printf("\n ");
+    }
+  printf("\n");
+  SDL_UnlockSurface(surf);
+  SDL_FreeSurface(surf);
+  return 1;
+}
+
+int main (int argc, char * argv[])
+{
+  if (argc < 3)
+    {
+      fprintf(stderr, "usage: %s FONT.ttf PTSIZE > glyph_atlas.h\n", argv[0]);
+      return 1;
+    }
+  const char * path = argv[1];
+  int ptsize = SDL_atoi(argv[2]);
+
+  if (TTF_Init() < 0)
+    {
+      fprintf(stderr, "TTF_Init: %s\n", TTF_GetError());
+      return 1;
+    }
+  TTF_Font * fon = TTF_OpenFont(path, ptsize);
+  if (! fon)
+    {
+      fprintf(stderr, "%s: %s\n", path, TTF_GetError());
+      return 1;
+    }
+
+  /* monospace: every glyph advances as 'M' does. */
+  int cell_w = 0, cell_h = 0;
+  TTF_SizeUTF8(fon, "M", &cell_w, &cell_h);
+
+  Uint16 codepoints[128 + SDL_arraysize(extra_codepoints)];
+  int ncodepoints = 0;
+  for (Uint16 cp = 0x20; cp < 0x7f; cp++)
+    codepoints[ncodepoints++] = cp;
+  for (size_t i = 0; i < SDL_arraysize(extra_codepoints); i++)
+    codepoints[ncodepoints++] = extra_codepoints[i];
+
+  printf("/* Generated by mkatlas from %s at %dpt; do not edit. */\n", path, ptsize);
+  printf("#define GLYPH_ATLAS_PTSIZE %d\n", ptsize);
+  printf("#define GLYPH_ATLAS_CELL_W %d\n", cell_w);
+  printf("#define GLYPH_ATLAS_CELL_H %d\n", cell_h);
+  printf("static const Uint8 glyph_atlas_coverage[][GLYPH_ATLAS_CELL_H * GLYPH_ATLAS_CELL_W] = {\n");
+  int nbaked = 0;
+  Uint16 baked[SDL_arraysize(codepoints)];
+  for (int i = 0; i < ncodepoints; i++)
+    {
+      Uint16 cp = codepoints[i];
+      SDL_bool provided = TTF_GlyphIsProvided(fon, cp) ? SDL_TRUE : SDL_FALSE;
+      if (!provided && (cp >= 0x7f))
+	{
+	  fprintf(stderr, "mkatlas: no glyph for U+%04X; skipped.\n", cp);
+	  continue;
+	}
+      /* keep ASCII indices direct; missing glyph is a blank cell. */
+      printf(" {\n");
+      if (!provided || !emit_cell(fon, cp, cell_w, cell_h))
+	printf("  0\n");
+      printf(" },\n");
+      baked[nbaked++] = cp;
+    }
+  printf("};\n");
+  /* extra codepoints follow ASCII, in ascending order. */
+  printf("#define GLYPH_ATLAS_COUNT %d\n", nbaked);
+  printf("static const Uint16 glyph_atlas_codepoints[GLYPH_ATLAS_COUNT] = {");
+  for (int i = 0; i < nbaked; i++)
+    printf("%s0x%04X,", (i % 12) ? " " : "\n  ", baked[i]);
+  printf("\n};\n");
+
+  TTF_CloseFont(fon);
+  TTF_Quit();
+  return 0;
+}
@@ -0,0 +1,128 @@
+/*
+    Check that capture analysis reports the same however many threads it runs on.
+    Copyright (C) 2018  Fred Lee <fredslee27@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+*/
+
+/*
+   Writes a capture whose runs for 4 threads all start inside a burst, with more anomalies than
+   ANALYZE_MAX_NOTES, then compares --analyze output on 1 and 4 threads (past the first line,
+   which has the timing and thread count).
+
+   usage: analyze_threads  (exit status 0 if the reports match)
+*/
+
+#define main sdl_dumpevents_main
+#include "../src/SDL_DumpEvents.c"
+#undef main
+
+#define TEST_CAPTURE "analyze_threads.evc"
+#define TEST_RECORDS (5 * ANALYZE_MIN_CHUNK)
+/* One burst per cycle of reports; run boundaries (multiples of TEST_RECORDS / 4) fall inside one. */
+#define TEST_CYCLE 64
+#define TEST_BURST_START (TEST_CYCLE - ANALYZE_BURST_REPORTS / 2)
+
+/* Capture of one joystick reporting every 4 ms, but every TEST_CYCLE reports it sends 25 within 2.5 ms. */
+static
+int write_capture (const char * path)
+{
+  FILE * fp = fopen(path, "wb");
+  if (! fp)
+    return -1;
+  evcapture_header_t hdr;
+  SDL_memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = EVCAPTURE_MAGIC;
+  hdr.version = EVCAPTURE_VERSION;
+  hdr.recsize = sizeof(evfeed_record_t);
+  hdr.frequency = 1000000;
+  fwrite(&hdr, sizeof(hdr), 1, fp);
+
+  evfeed_record_t rec;
+  Uint64 counter = 1000000;
+  for (long i = 0; i < TEST_RECORDS; i++)
+    {
+      int phase = (i + TEST_CYCLE - TEST_BURST_START) % TEST_CYCLE;
+      counter += (phase < ANALYZE_BURST_REPORTS + 5) ? 100 : 4000;
+      SDL_memset(&rec, 0, sizeof(rec));
+      rec.seq = i + 1;
+      rec.counter = counter;
+      rec.type = (i == 0) ? SDL_JOYDEVICEADDED : SDL_JOYAXISMOTION;
+      rec.value = (Sint16)(i * 97);
+      fwrite(&rec, sizeof(rec), 1, fp);
+    }
+  return fclose(fp);
+}
+
+/* Report of analyze_run() on nthreads, to file. */
+static
+int analyze_to (const char * out, int nthreads)
+{
+  fflush(stdout);
+  if (! freopen(out, "w", stdout))
+    return -1;
+  int status = analyze_run(TEST_CAPTURE, nthreads);
+  fflush(stdout);
+  return status;
+}
+
+/* Compare files past their first line; returns 0 if equal. */
+static
+int compare_reports (const char * a, const char * b)
+{
+  FILE * fa = fopen(a, "r");
+  FILE * fb = fopen(b, "r");
+  char la[512], lb[512];
+  int line = 0, differ = (!fa || !fb);
+  while (!differ)
+    {
+      char * ga = fgets(la, sizeof(la), fa);
+      char * gb = fgets(lb, sizeof(lb), fb);
+      line++;
+      if (!ga || !gb)
+	{
+	  differ = (ga != gb);
+	  break;
+	}
+      if ((line > 1) && SDL_strcmp(la, lb))
+	{
+	  fprintf(stderr, "line %d differs:\n  1 thread:  %s  4 threads: %s", line, la, lb);
+	  differ = 1;
+	}
+    }
+  if (fa) fclose(fa);
+  if (fb) fclose(fb);
+  return differ;
+}
+
+int main (void)
+{
+  if (write_capture(TEST_CAPTURE) != 0)
+    {
+      perror(TEST_CAPTURE);
+      return 2;
+    }
+  int failed = (analyze_to("analyze_threads.1", 1) != 0)
+    || (analyze_to("analyze_threads.4", 4) != 0)
+    || compare_reports("analyze_threads.1", "analyze_threads.4");
+  fprintf(stderr, "analyze_threads: %s\n", failed ? "FAIL" : "ok");
+  if (! failed)
+    {
+      remove(TEST_CAPTURE);
+      remove("analyze_threads.1");
+      remove("analyze_threads.4");
+    }
+  return failed;
+}